@@ -0,0 +1,1785 @@
+#include "storage_mgr.h"
+#include "buffer_mgr.h"
+#include "dberror.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Benchmarks for the buffer manager. Run "./bench <name>" for a single
+// benchmark or "./bench" for all of them.
+
+typedef struct BenchCase {
+  const char *name;
+  const char *help;
+  void (*run) (void);
+} BenchCase;
+
+// helper methods
+static double nowSeconds (void);
+static unsigned int nextRandom (unsigned int *state);
+static void createBenchFile (char *fileName, int numPages);
+
+// benchmarks
+static void benchIndependentPools (void);
+static void benchThreadScaling (void);
+static void benchPolicyLatch (void);
+static void benchScanPollution (void);
+static void benchVictimCost (void);
+static void benchShiftingHotSet (void);
+static void benchHitRatios (void);
+static void benchBackgroundWriter (void);
+static void benchPrefetch (void);
+static void benchReadAhead (void);
+static void benchBulkRing (void);
+static void benchPinPages (void);
+static void benchFlush (void);
+static void benchMapped (void);
+static void benchDirectIO (void);
+static void benchAsyncIOPS (void);
+static void benchFileGrowth (void);
+static void benchSnapshot (void);
+static void benchFrameScan (void);
+static void benchOptimisticReads (void);
+
+static const BenchCase benchCases[] = {
+  { "pools", "N independent pools, one per thread and page file", benchIndependentPools },
+  { "scaling", "1 to 64 threads sharing one pool: global mutex vs partitioned latches", benchThreadScaling },
+  { "policy", "1 to 64 threads sharing one pool per strategy: every hit under the policy latch vs batched", benchPolicyLatch },
+  { "lruk", "point lookups polluted by periodic scans: LRU vs LRU-K", benchScanPollution },
+  { "victim", "cost of a pin per strategy as the pool grows, one in three pins misses", benchVictimCost },
+  { "lfu", "LFU with and without aging when the hot set moves", benchShiftingHotSet },
+  { "arc", "hit ratio of every strategy on the test patterns and synthetic traces", benchHitRatios },
+  { "bgwriter", "write-heavy misses with and without the background writer", benchBackgroundWriter },
+  { "prefetch", "scans of an uncached file with and without prefetchPages", benchPrefetch },
+  { "readahead", "full scan of an uncached file with and without sequential read-ahead", benchReadAhead },
+  { "ring", "hot lookups mixed with full scans, scans with pinPage vs a bulk ring", benchBulkRing },
+  { "pinpages", "clustered batches of an uncached file: one pinPage per page vs pinPages", benchPinPages },
+  { "flush", "flushing a large pool of dirty pages: page by page vs coalesced writes", benchFlush },
+  { "mmap", "read-only lookups and scans of a file larger than the pool: frames vs the mapped file", benchMapped },
+  { "direct", "random pins of an uncached file: page cache vs direct I/O, and the cache it leaves", benchDirectIO },
+  { "iops", "random 4 KB reads of an uncached file by queue depth: io_uring vs a thread pool", benchAsyncIOPS },
+  { "grow", "growing a file to 256 MB: zero page writes vs preallocation, and a bulk load", benchFileGrowth },
+  { "snapshot", "polling the state of a million frame pool: the three getters vs getPoolSnapshot", benchSnapshot },
+  { "scan", "misses that scan a nearly all pinned pool, and clean flushes: scalar vs SSE2 vs AVX2", benchFrameScan },
+  { "optimistic", "1 to 64 threads reading a few hot pages: pinned vs latched vs optimistic reads", benchOptimisticReads },
+};
+
+#define NUM_BENCH_CASES ((int) (sizeof(benchCases) / sizeof(benchCases[0])))
+
+// main method
+int
+main (int argc, char *argv[])
+{
+  int i;
+  int ran = 0;
+
+  initStorageManager();
+
+  for (i = 0; i < NUM_BENCH_CASES; i++)
+    {
+      if (argc > 1 && strcmp(argv[1], benchCases[i].name) != 0)
+        continue;
+      printf("== %s: %s\n", benchCases[i].name, benchCases[i].help);
+      benchCases[i].run();
+      printf("\n");
+      ran++;
+    }
+
+  if (ran == 0)
+    {
+      printf("usage: %s [benchmark]\n", argv[0]);
+      for (i = 0; i < NUM_BENCH_CASES; i++)
+        printf("  %-12s %s\n", benchCases[i].name, benchCases[i].help);
+      return 1;
+    }
+  return 0;
+}
+
+static double
+nowSeconds (void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// xorshift, so every worker has its own reproducible request stream
+static unsigned int
+nextRandom (unsigned int *state)
+{
+  unsigned int x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+static void
+createBenchFile (char *fileName, int numPages)
+{
+  SM_FileHandle fh;
+
+  CHECK(createPageFile(fileName));
+  CHECK(openPageFile(fileName, &fh));
+  CHECK(ensureCapacity(numPages, &fh));
+  CHECK(closePageFile(&fh));
+}
+
+/************************************************************
+ *                  independent pools                       *
+ ************************************************************/
+
+#define POOLS_FILE_PAGES 512
+#define POOLS_POOL_FRAMES 64
+#define POOLS_OPS 200000
+#define POOLS_MAX 8
+
+typedef struct PoolWorker {
+  char fileName[64];
+  unsigned int seed;
+  int readIO;
+  int writeIO;
+} PoolWorker;
+
+// 80% of the requests go to 20% of the pages, one in ten pins dirties its page
+static void *
+runPoolWorker (void *arg)
+{
+  PoolWorker *w = (PoolWorker *) arg;
+  BM_BufferPool bm;
+  BM_PageHandle h;
+  unsigned int state = w->seed;
+  int i;
+
+  CHECK(initBufferPool(&bm, w->fileName, POOLS_POOL_FRAMES, RS_LRU, NULL));
+  for (i = 0; i < POOLS_OPS; i++)
+    {
+      unsigned int r = nextRandom(&state);
+      int pageNum = (r % 10 < 8) ? (int) ((r >> 8) % (POOLS_FILE_PAGES / 5))
+                                 : (int) ((r >> 8) % POOLS_FILE_PAGES);
+
+      CHECK(pinPage(&bm, &h, pageNum));
+      if ((r >> 4) % 10 == 0)
+        CHECK(markDirty(&bm, &h));
+      CHECK(unpinPage(&bm, &h));
+    }
+  w->readIO = getNumReadIO(&bm);
+  w->writeIO = getNumWriteIO(&bm);
+  CHECK(shutdownBufferPool(&bm));
+  return NULL;
+}
+
+static void
+benchIndependentPools (void)
+{
+  PoolWorker workers[POOLS_MAX];
+  pthread_t threads[POOLS_MAX];
+  PoolWorker reference;
+  int numPools, i;
+
+  for (i = 0; i < POOLS_MAX; i++)
+    {
+      sprintf(workers[i].fileName, "benchpool_%i.bin", i);
+      createBenchFile(workers[i].fileName, POOLS_FILE_PAGES);
+    }
+
+  // the counters a pool reports when it runs on its own
+  reference = workers[0];
+  reference.seed = 42;
+  runPoolWorker(&reference);
+
+  printf("%6s %12s %14s %10s\n", "pools", "seconds", "pins/s", "crosstalk");
+  for (numPools = 1; numPools <= POOLS_MAX; numPools *= 2)
+    {
+      int mismatches = 0;
+      double start = nowSeconds();
+      double elapsed;
+
+      for (i = 0; i < numPools; i++)
+        {
+          workers[i].seed = 42;
+          pthread_create(&threads[i], NULL, runPoolWorker, &workers[i]);
+        }
+      for (i = 0; i < numPools; i++)
+        pthread_join(threads[i], NULL);
+      elapsed = nowSeconds() - start;
+
+      // same request stream on every pool, so every pool has to match the reference
+      for (i = 0; i < numPools; i++)
+        if (workers[i].readIO != reference.readIO || workers[i].writeIO != reference.writeIO)
+          mismatches++;
+
+      printf("%6i %12.3f %14.0f %10s\n", numPools, elapsed,
+             (double) numPools * POOLS_OPS / elapsed, mismatches ? "YES" : "none");
+    }
+
+  for (i = 0; i < POOLS_MAX; i++)
+    CHECK(destroyPageFile(workers[i].fileName));
+}
+
+/************************************************************
+ *                  thread scaling                          *
+ ************************************************************/
+
+#define SCALING_FILE_PAGES 4096
+#define SCALING_POOL_FRAMES 1024
+#define SCALING_HOT_PAGES 800
+#define SCALING_TOTAL_OPS 400000
+#define SCALING_MAX_THREADS 64
+
+typedef struct ScalingWorker {
+  BM_BufferPool *bm;
+  pthread_mutex_t *globalLatch; // NULL when the pool does its own latching
+  unsigned int seed;
+  int ops;
+  int errors;
+} ScalingWorker;
+
+// 90% of the pins go to a hot set that fits in the pool
+static void *
+runScalingWorker (void *arg)
+{
+  ScalingWorker *w = (ScalingWorker *) arg;
+  BM_PageHandle h;
+  unsigned int state = w->seed;
+  int i;
+
+  for (i = 0; i < w->ops; i++)
+    {
+      unsigned int r = nextRandom(&state);
+      int pageNum = (r % 10 != 0) ? (int) ((r >> 8) % SCALING_HOT_PAGES)
+                                  : (int) ((r >> 8) % SCALING_FILE_PAGES);
+
+      if (w->globalLatch != NULL)
+        pthread_mutex_lock(w->globalLatch);
+      if (pinPage(w->bm, &h, pageNum) != RC_OK)
+        w->errors++;
+      if (w->globalLatch != NULL)
+        pthread_mutex_unlock(w->globalLatch);
+
+      if (w->globalLatch != NULL)
+        pthread_mutex_lock(w->globalLatch);
+      unpinPage(w->bm, &h);
+      if (w->globalLatch != NULL)
+        pthread_mutex_unlock(w->globalLatch);
+    }
+  return NULL;
+}
+
+static double
+runThreads (BM_BufferPool *bm, pthread_mutex_t *globalLatch, int numThreads)
+{
+  static ScalingWorker workers[SCALING_MAX_THREADS];
+  static pthread_t threads[SCALING_MAX_THREADS];
+  double start, elapsed;
+  int i, errors = 0;
+
+  start = nowSeconds();
+  for (i = 0; i < numThreads; i++)
+    {
+      workers[i].bm = bm;
+      workers[i].globalLatch = globalLatch;
+      workers[i].seed = 1000 + i;
+      workers[i].ops = SCALING_TOTAL_OPS / numThreads;
+      workers[i].errors = 0;
+      pthread_create(&threads[i], NULL, runScalingWorker, &workers[i]);
+    }
+  for (i = 0; i < numThreads; i++)
+    {
+      pthread_join(threads[i], NULL);
+      errors += workers[i].errors;
+    }
+  elapsed = nowSeconds() - start;
+
+  if (errors > 0)
+    printf("  %i failed pins with %i threads\n", errors, numThreads);
+  return (double) (SCALING_TOTAL_OPS / numThreads) * numThreads / elapsed;
+}
+
+static double
+runScaling (int numThreads, bool partitioned)
+{
+  BM_BufferPool bm;
+  BM_PoolOptions options = { .concurrent = true, .numPartitions = 64 };
+  pthread_mutex_t globalLatch = PTHREAD_MUTEX_INITIALIZER;
+  double opsPerSecond;
+
+  if (partitioned)
+    {
+      CHECK(initBufferPoolWithOptions(&bm, "benchscaling.bin", SCALING_POOL_FRAMES, RS_CLOCK, NULL, &options));
+    }
+  else
+    {
+      CHECK(initBufferPool(&bm, "benchscaling.bin", SCALING_POOL_FRAMES, RS_CLOCK, NULL));
+    }
+
+  opsPerSecond = runThreads(&bm, partitioned ? NULL : &globalLatch, numThreads);
+  CHECK(shutdownBufferPool(&bm));
+  return opsPerSecond;
+}
+
+static void
+benchThreadScaling (void)
+{
+  int numThreads;
+
+  createBenchFile("benchscaling.bin", SCALING_FILE_PAGES);
+
+  printf("%8s %16s %16s\n", "threads", "global mutex/s", "partitioned/s");
+  for (numThreads = 1; numThreads <= SCALING_MAX_THREADS; numThreads *= 2)
+    printf("%8i %16.0f %16.0f\n", numThreads, runScaling(numThreads, false), runScaling(numThreads, true));
+
+  CHECK(destroyPageFile("benchscaling.bin"));
+}
+
+// The same workload with the strategies that keep their state under the
+// policy latch: with referenceBatch 1 every hit and unpin takes the latch,
+// by default threads queue them and take it once per batch
+static double
+runPolicyLatch (int numThreads, ReplacementStrategy strategy, int referenceBatch)
+{
+  BM_BufferPool bm;
+  BM_PoolOptions options = { .concurrent = true, .numPartitions = 64, .referenceBatch = referenceBatch };
+  double opsPerSecond;
+
+  CHECK(initBufferPoolWithOptions(&bm, "benchscaling.bin", SCALING_POOL_FRAMES, strategy, NULL, &options));
+  opsPerSecond = runThreads(&bm, NULL, numThreads);
+  CHECK(shutdownBufferPool(&bm));
+  return opsPerSecond;
+}
+
+static void
+benchPolicyLatch (void)
+{
+  const char *names[] = { "LRU", "LFU", "LRU-K", "ARC" };
+  ReplacementStrategy strategies[] = { RS_LRU, RS_LFU, RS_LRU_K, RS_ARC };
+  int s, numThreads;
+
+  createBenchFile("benchscaling.bin", SCALING_FILE_PAGES);
+
+  printf("%-8s %8s %16s %16s\n", "strategy", "threads", "every hit/s", "batched/s");
+  for (s = 0; s < 4; s++)
+    for (numThreads = 1; numThreads <= SCALING_MAX_THREADS; numThreads *= 4)
+      printf("%-8s %8i %16.0f %16.0f\n", names[s], numThreads,
+             runPolicyLatch(numThreads, strategies[s], 1), runPolicyLatch(numThreads, strategies[s], 0));
+
+  CHECK(destroyPageFile("benchscaling.bin"));
+}
+
+/************************************************************
+ *                  scan pollution                          *
+ ************************************************************/
+
+#define SCAN_FILE_PAGES 5000
+#define SCAN_POOL_FRAMES 200
+#define SCAN_HOT_PAGES 150
+#define SCAN_ROUNDS 50
+#define SCAN_LOOKUPS 2000
+#define SCAN_LENGTH 1000
+
+// every round does random lookups on a hot set that fits in the pool and then
+// one sequential scan over pages outside of it; only the lookups hit ratio
+// tells whether the scans flushed the hot set
+static void
+runScanPollution (const char *label, ReplacementStrategy strategy, void *stratData)
+{
+  BM_BufferPool bm;
+  BM_PageHandle h;
+  unsigned int state = 7;
+  int round, i, lookupMisses = 0, pins = 0;
+  double start, elapsed;
+
+  CHECK(initBufferPool(&bm, "benchscan.bin", SCAN_POOL_FRAMES, strategy, stratData));
+  start = nowSeconds();
+  for (round = 0; round < SCAN_ROUNDS; round++)
+    {
+      int before = getNumReadIO(&bm);
+      int scanStart = SCAN_HOT_PAGES + (round * SCAN_LENGTH) % (SCAN_FILE_PAGES - SCAN_HOT_PAGES - SCAN_LENGTH);
+
+      for (i = 0; i < SCAN_LOOKUPS; i++)
+        {
+          CHECK(pinPage(&bm, &h, nextRandom(&state) % SCAN_HOT_PAGES));
+          CHECK(unpinPage(&bm, &h));
+        }
+      lookupMisses += getNumReadIO(&bm) - before;
+
+      for (i = 0; i < SCAN_LENGTH; i++)
+        {
+          CHECK(pinPage(&bm, &h, scanStart + i));
+          CHECK(unpinPage(&bm, &h));
+        }
+      pins += SCAN_LOOKUPS + SCAN_LENGTH;
+    }
+  elapsed = nowSeconds() - start;
+
+  printf("%-18s %10.3f %14.3f %14.3f\n", label, elapsed,
+         1.0 - (double) getNumReadIO(&bm) / pins,
+         1.0 - (double) lookupMisses / (SCAN_ROUNDS * SCAN_LOOKUPS));
+  CHECK(shutdownBufferPool(&bm));
+}
+
+static void
+benchScanPollution (void)
+{
+  BM_LRUKParams lru2 = { .k = 2 };
+  BM_LRUKParams lru3 = { .k = 3 };
+  BM_LRUKParams lru2Correlated = { .k = 2, .correlatedPeriod = 50 };
+
+  createBenchFile("benchscan.bin", SCAN_FILE_PAGES);
+
+  printf("%-18s %10s %14s %14s\n", "strategy", "seconds", "hit ratio", "lookup hits");
+  runScanPollution("LRU", RS_LRU, NULL);
+  runScanPollution("LRU-2", RS_LRU_K, &lru2);
+  runScanPollution("LRU-3", RS_LRU_K, &lru3);
+  runScanPollution("LRU-2, period 50", RS_LRU_K, &lru2Correlated);
+
+  CHECK(destroyPageFile("benchscan.bin"));
+}
+
+/************************************************************
+ *                  victim selection cost                   *
+ ************************************************************/
+
+#define VICTIM_OPS 60000
+
+// random pins over a file half again as large as the pool, so a third of the
+// pins have to replace a page; with a linear victim search the cost grows
+// with the pool even though the I/O per miss stays the same
+static double
+runVictimCost (ReplacementStrategy strategy, int numFrames)
+{
+  BM_BufferPool bm;
+  BM_PageHandle h;
+  unsigned int state = 99;
+  int filePages = numFrames + numFrames / 2;
+  double start;
+  int i;
+
+  CHECK(initBufferPool(&bm, "benchvictim.bin", numFrames, strategy, NULL));
+  // warm up so the pool is full before the clock starts
+  for (i = 0; i < numFrames; i++)
+    {
+      CHECK(pinPage(&bm, &h, i));
+      CHECK(unpinPage(&bm, &h));
+    }
+
+  start = nowSeconds();
+  for (i = 0; i < VICTIM_OPS; i++)
+    {
+      CHECK(pinPage(&bm, &h, nextRandom(&state) % filePages));
+      CHECK(unpinPage(&bm, &h));
+    }
+  start = (nowSeconds() - start) * 1e9 / VICTIM_OPS;
+
+  CHECK(shutdownBufferPool(&bm));
+  return start;
+}
+
+static void
+benchVictimCost (void)
+{
+  static const struct { const char *name; ReplacementStrategy strategy; } strategies[] = {
+    { "FIFO", RS_FIFO }, { "LRU", RS_LRU }, { "CLOCK", RS_CLOCK }, { "LFU", RS_LFU },
+  };
+  int numStrategies = (int) (sizeof(strategies) / sizeof(strategies[0]));
+  int numFrames, i;
+
+  createBenchFile("benchvictim.bin", 16384 + 8192);
+
+  printf("%8s", "frames");
+  for (i = 0; i < numStrategies; i++)
+    printf(" %10s", strategies[i].name);
+  printf("   (ns per pin)\n");
+  for (numFrames = 256; numFrames <= 16384; numFrames *= 4)
+    {
+      printf("%8i", numFrames);
+      for (i = 0; i < numStrategies; i++)
+        printf(" %10.0f", runVictimCost(strategies[i].strategy, numFrames));
+      printf("\n");
+    }
+
+  CHECK(destroyPageFile("benchvictim.bin"));
+}
+
+/************************************************************
+ *                  shifting hot set                        *
+ ************************************************************/
+
+#define SHIFT_FILE_PAGES 4000
+#define SHIFT_POOL_FRAMES 200
+#define SHIFT_HOT_PAGES 150
+#define SHIFT_PHASES 5
+#define SHIFT_PHASE_OPS 60000
+
+// 90% of the pins go to a hot set that moves to other pages every phase;
+// counts that never decay keep the first phase's pages in the pool
+static void
+runShiftingHotSet (const char *label, ReplacementStrategy strategy, void *stratData)
+{
+  BM_BufferPool bm;
+  BM_PageHandle h;
+  unsigned int state = 3;
+  int phase, i;
+  double start, elapsed;
+
+  CHECK(initBufferPool(&bm, "benchshift.bin", SHIFT_POOL_FRAMES, strategy, stratData));
+  start = nowSeconds();
+  for (phase = 0; phase < SHIFT_PHASES; phase++)
+    for (i = 0; i < SHIFT_PHASE_OPS; i++)
+      {
+        unsigned int r = nextRandom(&state);
+        int pageNum = (r % 10 != 0) ? (int) (phase * SHIFT_HOT_PAGES + (r >> 8) % SHIFT_HOT_PAGES)
+                                    : (int) ((r >> 8) % SHIFT_FILE_PAGES);
+
+        CHECK(pinPage(&bm, &h, pageNum));
+        CHECK(unpinPage(&bm, &h));
+      }
+  elapsed = nowSeconds() - start;
+
+  printf("%-22s %14.3f %14.0f\n", label,
+         1.0 - (double) getNumReadIO(&bm) / (SHIFT_PHASES * SHIFT_PHASE_OPS),
+         elapsed * 1e9 / (SHIFT_PHASES * SHIFT_PHASE_OPS));
+  CHECK(shutdownBufferPool(&bm));
+}
+
+static void
+benchShiftingHotSet (void)
+{
+  BM_LFUParams fastAging = { .agingInterval = 1000 };
+  BM_LFUParams slowAging = { .agingInterval = 20000 };
+
+  createBenchFile("benchshift.bin", SHIFT_FILE_PAGES);
+
+  printf("%-22s %14s %14s\n", "strategy", "hit ratio", "ns per pin");
+  runShiftingHotSet("LRU", RS_LRU, NULL);
+  runShiftingHotSet("LFU", RS_LFU, NULL);
+  runShiftingHotSet("LFU, aging every 20000", RS_LFU, &slowAging);
+  runShiftingHotSet("LFU, aging every 1000", RS_LFU, &fastAging);
+
+  CHECK(destroyPageFile("benchshift.bin"));
+}
+
+/************************************************************
+ *                  hit ratios                              *
+ ************************************************************/
+
+#define TRACE_FILE_PAGES 5000
+#define TRACE_POOL_FRAMES 200
+#define TRACE_LENGTH 200000
+
+typedef struct Trace {
+  const char *name;
+  int numFrames;
+  int length;
+  int *pages;
+} Trace;
+
+static const struct { const char *name; ReplacementStrategy strategy; } traceStrategies[] = {
+  { "FIFO", RS_FIFO }, { "LRU", RS_LRU }, { "CLOCK", RS_CLOCK }, { "LFU", RS_LFU },
+  { "GCLOCK", RS_GCLOCK }, { "LRU-2", RS_LRU_K }, { "ARC", RS_ARC },
+};
+
+#define NUM_TRACE_STRATEGIES ((int) (sizeof(traceStrategies) / sizeof(traceStrategies[0])))
+
+static double
+runTrace (const Trace *trace, ReplacementStrategy strategy)
+{
+  BM_BufferPool bm;
+  BM_PageHandle h;
+  double ratio;
+  int i;
+
+  CHECK(initBufferPool(&bm, "benchtrace.bin", trace->numFrames, strategy, NULL));
+  for (i = 0; i < trace->length; i++)
+    {
+      CHECK(pinPage(&bm, &h, trace->pages[i]));
+      CHECK(unpinPage(&bm, &h));
+    }
+  ratio = 1.0 - (double) getNumReadIO(&bm) / trace->length;
+  CHECK(shutdownBufferPool(&bm));
+  return ratio;
+}
+
+// the synthetic traces all run against a 200 frame pool
+static int *
+makeTrace (int kind)
+{
+  int *pages = malloc(sizeof(int) * TRACE_LENGTH);
+  unsigned int state = 11;
+  int i;
+
+  for (i = 0; i < TRACE_LENGTH; i++)
+    {
+      unsigned int r = nextRandom(&state);
+
+      switch (kind)
+        {
+        case 0: // 80% of the pins on 20% of 1000 pages
+          pages[i] = (r % 10 < 8) ? (int) ((r >> 8) % 200) : (int) ((r >> 8) % 1000);
+          break;
+        case 1: // lookups on 150 hot pages, a 1000 page scan after every 2000 of them
+          pages[i] = (i % 3000 < 2000) ? (int) ((r >> 8) % 150)
+                                       : 150 + (i / 3000 * 1000 + i % 3000 - 2000) % (TRACE_FILE_PAGES - 150);
+          break;
+        case 2: // the 150 page hot set moves every 40000 pins
+          pages[i] = (r % 10 != 0) ? (int) (i / 40000 * 150 + (r >> 8) % 150) : (int) ((r >> 8) % TRACE_FILE_PAGES);
+          break;
+        default: // a loop over 250 pages, slightly more than the pool holds
+          pages[i] = i % 250;
+          break;
+        }
+    }
+  return pages;
+}
+
+static void
+benchHitRatios (void)
+{
+  static int fifoPattern[] = {0,1,2,3,4,4,5,6,0};
+  static int lruPattern[] = {0,1,2,3,4,3,4,0,2,1,5,6,7,8,9};
+  static int clockPattern[] = {3,2,0,8,4,2,5,0,9,8,3,2};
+  static int lfuPattern[] = {3,7,6,4,6,2,1,9,2,8};
+  Trace traces[] = {
+    { "FIFO test", 3, 9, fifoPattern },
+    { "LRU test", 5, 15, lruPattern },
+    { "CLOCK test", 4, 12, clockPattern },
+    { "LFU test", 3, 10, lfuPattern },
+    { "skewed 80/20", TRACE_POOL_FRAMES, TRACE_LENGTH, makeTrace(0) },
+    { "lookups + scans", TRACE_POOL_FRAMES, TRACE_LENGTH, makeTrace(1) },
+    { "moving hot set", TRACE_POOL_FRAMES, TRACE_LENGTH, makeTrace(2) },
+    { "loop > pool", TRACE_POOL_FRAMES, TRACE_LENGTH, makeTrace(3) },
+  };
+  int numTraces = (int) (sizeof(traces) / sizeof(traces[0]));
+  int t, i;
+
+  createBenchFile("benchtrace.bin", TRACE_FILE_PAGES);
+
+  printf("%-16s", "trace");
+  for (i = 0; i < NUM_TRACE_STRATEGIES; i++)
+    printf(" %8s", traceStrategies[i].name);
+  printf("\n");
+  for (t = 0; t < numTraces; t++)
+    {
+      printf("%-16s", traces[t].name);
+      for (i = 0; i < NUM_TRACE_STRATEGIES; i++)
+        printf(" %8.3f", runTrace(&traces[t], traceStrategies[i].strategy));
+      printf("\n");
+    }
+
+  for (t = 4; t < numTraces; t++)
+    free(traces[t].pages);
+  CHECK(destroyPageFile("benchtrace.bin"));
+}
+
+/************************************************************
+ *                  background writer                       *
+ ************************************************************/
+
+#define BGW_FILE_PAGES 4096
+#define BGW_POOL_FRAMES 256
+#define BGW_OPS 200000
+
+// skewed pins on a file much larger than the pool, every third pin dirties
+// its page, so many victims are dirty unless somebody cleans them first
+static void
+runBackgroundWriter (const char *label, const BM_PoolOptions *options)
+{
+  BM_BufferPool bm;
+  BM_PageHandle h;
+  unsigned int state = 5;
+  double start, elapsed;
+  int i;
+
+  CHECK(initBufferPoolWithOptions(&bm, "benchbgw.bin", BGW_POOL_FRAMES, RS_CLOCK, NULL, options));
+  start = nowSeconds();
+  for (i = 0; i < BGW_OPS; i++)
+    {
+      unsigned int r = nextRandom(&state);
+      int pageNum = (r % 10 < 7) ? (int) ((r >> 8) % 200) : (int) ((r >> 8) % BGW_FILE_PAGES);
+
+      CHECK(pinPage(&bm, &h, pageNum));
+      if ((r >> 4) % 3 == 0)
+        CHECK(markDirty(&bm, &h));
+      CHECK(unpinPage(&bm, &h));
+    }
+  elapsed = nowSeconds() - start;
+
+  printf("%-26s %10.3f %12.0f %12i %12i\n", label, elapsed, elapsed * 1e9 / BGW_OPS,
+         getNumSyncWriteIO(&bm), getNumBackgroundWriteIO(&bm));
+  CHECK(shutdownBufferPool(&bm));
+}
+
+static void
+benchBackgroundWriter (void)
+{
+  BM_PoolOptions none = { .concurrent = true };
+  BM_PoolOptions slow = { .backgroundWriter = true, .writerDelayMs = 10, .writerBatchSize = 16 };
+  BM_PoolOptions fast = { .backgroundWriter = true, .writerDelayMs = 1, .writerBatchSize = 64 };
+
+  createBenchFile("benchbgw.bin", BGW_FILE_PAGES);
+
+  printf("%-26s %10s %12s %12s %12s\n", "writer", "seconds", "ns per pin", "sync writes", "bg writes");
+  runBackgroundWriter("none", &none);
+  runBackgroundWriter("10 ms, 16 pages", &slow);
+  runBackgroundWriter("1 ms, 64 pages", &fast);
+
+  CHECK(destroyPageFile("benchbgw.bin"));
+}
+
+/************************************************************
+ *                  prefetch                                *
+ ************************************************************/
+
+#define PREFETCH_FILE_PAGES 8192
+#define PREFETCH_POOL_FRAMES 256
+#define PREFETCH_WORK 2000
+
+static PageNumber prefetchOrder[PREFETCH_FILE_PAGES];
+static volatile unsigned int prefetchSink;
+
+// write the file out and drop it from the OS page cache, so every read of
+// the next run goes to the device
+static void
+dropFileCache (char *fileName)
+{
+  int fd = open(fileName, O_RDONLY);
+
+  if (fd < 0)
+    return;
+  fdatasync(fd);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+}
+
+// visit every page once in prefetchOrder, doing a little work per page; with
+// a window the scan asks for the next window pages every half window, like a
+// scan following the leaf chain of an index
+static void
+runPrefetchScan (const char *label, int threads, int window)
+{
+  BM_BufferPool bm;
+  BM_PageHandle h;
+  BM_PoolOptions options = { .concurrent = true, .prefetchThreads = threads };
+  unsigned int sum = 0;
+  double start, elapsed;
+  int i, j;
+
+  dropFileCache("benchprefetch.bin");
+  CHECK(initBufferPoolWithOptions(&bm, "benchprefetch.bin", PREFETCH_POOL_FRAMES, RS_LRU, NULL, &options));
+  start = nowSeconds();
+  for (i = 0; i < PREFETCH_FILE_PAGES; i++)
+    {
+      if (window > 0 && i % (window / 2) == 0)
+        CHECK(prefetchPages(&bm, prefetchOrder + i,
+                            i + window <= PREFETCH_FILE_PAGES ? window : PREFETCH_FILE_PAGES - i));
+      CHECK(pinPage(&bm, &h, prefetchOrder[i]));
+      for (j = 0; j < PREFETCH_WORK; j++)
+        sum += (unsigned char) h.data[j % PAGE_SIZE] + j;
+      CHECK(unpinPage(&bm, &h));
+    }
+  elapsed = nowSeconds() - start;
+  prefetchSink = sum;
+
+  printf("%-24s %10.3f %14.1f %10i %12i\n", label, elapsed, elapsed * 1e6 / PREFETCH_FILE_PAGES,
+         getNumReadIO(&bm), getNumPrefetchIO(&bm));
+  CHECK(shutdownBufferPool(&bm));
+}
+
+static void
+runPrefetchScans (void)
+{
+  printf("%-24s %10s %14s %10s %12s\n", "prefetch", "seconds", "us per page", "reads", "prefetched");
+  runPrefetchScan("none", 0, 0);
+  runPrefetchScan("1 thread, 16 pages", 1, 16);
+  runPrefetchScan("4 threads, 32 pages", 4, 32);
+  runPrefetchScan("8 threads, 64 pages", 8, 64);
+}
+
+static void
+benchPrefetch (void)
+{
+  unsigned int state = 11;
+  int i;
+
+  createBenchFile("benchprefetch.bin", PREFETCH_FILE_PAGES);
+
+  // in file order the kernel's own read-ahead already hides most reads
+  printf("sequential pages\n");
+  for (i = 0; i < PREFETCH_FILE_PAGES; i++)
+    prefetchOrder[i] = i;
+  runPrefetchScans();
+
+  // shuffled pages, where only an explicit prefetch helps
+  printf("\nscattered pages\n");
+  for (i = PREFETCH_FILE_PAGES - 1; i > 0; i--)
+    {
+      int k = nextRandom(&state) % (i + 1);
+      PageNumber tmp = prefetchOrder[i];
+
+      prefetchOrder[i] = prefetchOrder[k];
+      prefetchOrder[k] = tmp;
+    }
+  runPrefetchScans();
+
+  CHECK(destroyPageFile("benchprefetch.bin"));
+}
+
+/************************************************************
+ *                  sequential read-ahead                   *
+ ************************************************************/
+
+#define READAHEAD_FILE_PAGES 16384
+#define READAHEAD_POOL_FRAMES 1024
+#define READAHEAD_CHUNK 256
+
+static void
+printScanRate (const char *label, double elapsed, int reads)
+{
+  printf("%-22s %10.3f %10.0f %10i\n", label, elapsed,
+         (double) READAHEAD_FILE_PAGES * PAGE_SIZE / (1024 * 1024) / elapsed, reads);
+}
+
+static void
+runReadAheadScan (const char *label, int window)
+{
+  BM_BufferPool bm;
+  BM_PageHandle h;
+  BM_PoolOptions options = { .readAheadPages = window };
+  double start;
+  int i;
+
+  dropFileCache("benchreadahead.bin");
+  CHECK(initBufferPoolWithOptions(&bm, "benchreadahead.bin", READAHEAD_POOL_FRAMES, RS_LRU, NULL, &options));
+  start = nowSeconds();
+  for (i = 0; i < READAHEAD_FILE_PAGES; i++)
+    {
+      CHECK(pinPage(&bm, &h, i));
+      CHECK(unpinPage(&bm, &h));
+    }
+  printScanRate(label, nowSeconds() - start, getNumReadIO(&bm));
+  CHECK(shutdownBufferPool(&bm));
+}
+
+// what the device delivers to 1 MB reads straight from the storage manager
+static void
+runRawScan (void)
+{
+  SM_FileHandle fh;
+  SM_PageHandle pages[READAHEAD_CHUNK];
+  char *buffer = malloc((size_t) READAHEAD_CHUNK * PAGE_SIZE);
+  double start;
+  int i;
+
+  for (i = 0; i < READAHEAD_CHUNK; i++)
+    pages[i] = buffer + (size_t) i * PAGE_SIZE;
+  dropFileCache("benchreadahead.bin");
+  CHECK(openPageFile("benchreadahead.bin", &fh));
+  start = nowSeconds();
+  for (i = 0; i < READAHEAD_FILE_PAGES; i += READAHEAD_CHUNK)
+    CHECK(readBlocks(i, READAHEAD_CHUNK, &fh, pages));
+  printScanRate("raw 1 MB reads", nowSeconds() - start, READAHEAD_FILE_PAGES);
+  CHECK(closePageFile(&fh));
+  free(buffer);
+}
+
+static void
+benchReadAhead (void)
+{
+  createBenchFile("benchreadahead.bin", READAHEAD_FILE_PAGES);
+
+  printf("%-22s %10s %10s %10s\n", "read-ahead", "seconds", "MB/s", "pages read");
+  runReadAheadScan("none", 0);
+  runReadAheadScan("up to 8 pages", 8);
+  runReadAheadScan("up to 32 pages", 32);
+  runReadAheadScan("up to 256 pages", 256);
+  runRawScan();
+
+  CHECK(destroyPageFile("benchreadahead.bin"));
+}
+
+/************************************************************
+ *                  bulk read ring                          *
+ ************************************************************/
+
+#define RING_FILE_PAGES 5000
+#define RING_POOL_FRAMES 200
+#define RING_HOT_PAGES 150
+#define RING_ROUNDS 50
+#define RING_LOOKUPS 1000
+
+// rounds of random lookups on a hot set that fits in the pool, each followed
+// by a scan of the whole file, either with pinPage or through a bulk ring
+static void
+runRingScans (const char *label, ReplacementStrategy strategy, bool useRing)
+{
+  BM_BufferPool bm;
+  BM_PageHandle h;
+  BM_BulkRing ring;
+  unsigned int state = 9;
+  int round, i, lookupMisses = 0;
+  double start, elapsed;
+
+  CHECK(initBufferPool(&bm, "benchring.bin", RING_POOL_FRAMES, strategy, NULL));
+  CHECK(initBulkRing(&bm, &ring, 16));
+  start = nowSeconds();
+  for (round = 0; round < RING_ROUNDS; round++)
+    {
+      int before = getNumReadIO(&bm);
+
+      for (i = 0; i < RING_LOOKUPS; i++)
+        {
+          CHECK(pinPage(&bm, &h, nextRandom(&state) % RING_HOT_PAGES));
+          CHECK(unpinPage(&bm, &h));
+        }
+      lookupMisses += getNumReadIO(&bm) - before;
+
+      for (i = 0; i < RING_FILE_PAGES; i++)
+        {
+          CHECK(useRing ? pinPageBulk(&bm, &h, i, &ring) : pinPage(&bm, &h, i));
+          CHECK(unpinPage(&bm, &h));
+        }
+    }
+  elapsed = nowSeconds() - start;
+
+  printf("%-16s %-8s %10.3f %14.3f\n", label, useRing ? "ring" : "pinPage", elapsed,
+         1.0 - (double) lookupMisses / (RING_ROUNDS * RING_LOOKUPS));
+  CHECK(freeBulkRing(&bm, &ring));
+  CHECK(shutdownBufferPool(&bm));
+}
+
+static void
+benchBulkRing (void)
+{
+  const char *labels[] = { "FIFO", "LRU", "CLOCK", "LFU", "LRU-2", "ARC" };
+  const ReplacementStrategy strategies[] = { RS_FIFO, RS_LRU, RS_CLOCK, RS_LFU, RS_LRU_K, RS_ARC };
+  int i;
+
+  createBenchFile("benchring.bin", RING_FILE_PAGES);
+
+  printf("%-16s %-8s %10s %14s\n", "strategy", "scan", "seconds", "lookup hits");
+  for (i = 0; i < 6; i++)
+    {
+      runRingScans(labels[i], strategies[i], false);
+      runRingScans(labels[i], strategies[i], true);
+    }
+
+  CHECK(destroyPageFile("benchring.bin"));
+}
+
+/************************************************************
+ *                  batched pins                            *
+ ************************************************************/
+
+#define BATCH_FILE_PAGES 16384
+#define BATCH_POOL_FRAMES 512
+#define BATCH_SIZE 64
+#define BATCH_RUNS 2000
+
+static PageNumber batchPages[BATCH_RUNS][BATCH_SIZE];
+
+// every batch is what an index probe hands back: a few clusters of adjacent
+// pages in key order, not in page order
+static void
+makeBatches (int clusterPages)
+{
+  unsigned int state = 13;
+  int b, i;
+
+  for (b = 0; b < BATCH_RUNS; b++)
+    {
+      for (i = 0; i < BATCH_SIZE; i++)
+        {
+          if (i % clusterPages == 0)
+            batchPages[b][i] = nextRandom(&state) % (BATCH_FILE_PAGES - clusterPages);
+          else
+            batchPages[b][i] = batchPages[b][i - 1] + 1;
+        }
+      for (i = BATCH_SIZE - 1; i > 0; i--)
+        {
+          int k = nextRandom(&state) % (i + 1);
+          PageNumber tmp = batchPages[b][i];
+
+          batchPages[b][i] = batchPages[b][k];
+          batchPages[b][k] = tmp;
+        }
+    }
+}
+
+static void
+runBatches (const char *label, bool batched)
+{
+  BM_BufferPool bm;
+  BM_PageHandle handles[BATCH_SIZE];
+  double start, elapsed;
+  int b, i;
+
+  dropFileCache("benchbatch.bin");
+  CHECK(initBufferPool(&bm, "benchbatch.bin", BATCH_POOL_FRAMES, RS_LRU, NULL));
+  start = nowSeconds();
+  for (b = 0; b < BATCH_RUNS; b++)
+    {
+      if (batched)
+        {
+          CHECK(pinPages(&bm, handles, batchPages[b], BATCH_SIZE));
+        }
+      else
+        {
+          for (i = 0; i < BATCH_SIZE; i++)
+            CHECK(pinPage(&bm, &handles[i], batchPages[b][i]));
+        }
+      for (i = 0; i < BATCH_SIZE; i++)
+        CHECK(unpinPage(&bm, &handles[i]));
+    }
+  elapsed = nowSeconds() - start;
+
+  printf("%-26s %10.3f %14.2f %10i\n", label, elapsed,
+         elapsed * 1e6 / (BATCH_RUNS * BATCH_SIZE), getNumReadIO(&bm));
+  CHECK(shutdownBufferPool(&bm));
+}
+
+static void
+benchPinPages (void)
+{
+  const int clusters[] = { 1, 4, 16 };
+  char label[64];
+  int c;
+
+  createBenchFile("benchbatch.bin", BATCH_FILE_PAGES);
+
+  printf("%-26s %10s %14s %10s\n", "batch", "seconds", "us per page", "pages read");
+  for (c = 0; c < 3; c++)
+    {
+      makeBatches(clusters[c]);
+      sprintf(label, "%i-page clusters, pinPage", clusters[c]);
+      runBatches(label, false);
+      sprintf(label, "%i-page clusters, pinPages", clusters[c]);
+      runBatches(label, true);
+    }
+
+  CHECK(destroyPageFile("benchbatch.bin"));
+}
+
+/************************************************************
+ *                  coalesced flush                         *
+ ************************************************************/
+
+#define FLUSH_POOL_FRAMES 32768
+#define FLUSH_ROUNDS 3
+
+static PageNumber flushOrder[FLUSH_POOL_FRAMES];
+
+// dirty every page of the pool, the pages are loaded in random order so
+// slot order is not page order
+static void
+dirtyPool (BM_BufferPool *bm)
+{
+  BM_PageHandle h;
+  int i;
+
+  for (i = 0; i < FLUSH_POOL_FRAMES; i++)
+    {
+      CHECK(pinPage(bm, &h, flushOrder[i]));
+      h.data[0]++;
+      CHECK(markDirty(bm, &h));
+      CHECK(unpinPage(bm, &h));
+    }
+}
+
+// pageByPage does what forceFlushPool used to: one write per frame, in slot order
+static void
+runFlush (const char *label, int threads, bool pageByPage)
+{
+  BM_BufferPool bm;
+  BM_PageHandle h;
+  BM_PoolOptions options = { .flushThreads = threads };
+  PageNumber *frameContents;
+  double elapsed = 0, start;
+  int round, i;
+
+  CHECK(initBufferPoolWithOptions(&bm, "benchflush.bin", FLUSH_POOL_FRAMES, RS_LRU, NULL, &options));
+  for (round = 0; round < FLUSH_ROUNDS; round++)
+    {
+      dirtyPool(&bm);
+      frameContents = getFrameContents(&bm);
+      start = nowSeconds();
+      if (pageByPage)
+        {
+          for (i = 0; i < FLUSH_POOL_FRAMES; i++)
+            {
+              h.pageNum = frameContents[i];
+              CHECK(forcePage(&bm, &h));
+            }
+        }
+      else
+        {
+          CHECK(forceFlushPool(&bm));
+        }
+      elapsed += nowSeconds() - start;
+      free(frameContents);
+    }
+
+  printf("%-26s %10.3f %10.0f %10i\n", label, elapsed / FLUSH_ROUNDS,
+         (double) FLUSH_ROUNDS * FLUSH_POOL_FRAMES * PAGE_SIZE / (1024 * 1024) / elapsed,
+         getNumWriteIO(&bm));
+  CHECK(shutdownBufferPool(&bm));
+}
+
+static void
+benchFlush (void)
+{
+  unsigned int state = 17;
+  int i;
+
+  for (i = 0; i < FLUSH_POOL_FRAMES; i++)
+    flushOrder[i] = i;
+  for (i = FLUSH_POOL_FRAMES - 1; i > 0; i--)
+    {
+      int k = nextRandom(&state) % (i + 1);
+      PageNumber tmp = flushOrder[i];
+
+      flushOrder[i] = flushOrder[k];
+      flushOrder[k] = tmp;
+    }
+  createBenchFile("benchflush.bin", FLUSH_POOL_FRAMES);
+
+  printf("%-26s %10s %10s %10s\n", "flush", "seconds", "MB/s", "pages");
+  runFlush("page by page", 1, true);
+  runFlush("coalesced, 1 thread", 1, false);
+  runFlush("coalesced, 2 threads", 2, false);
+  runFlush("coalesced, 4 threads", 4, false);
+
+  CHECK(destroyPageFile("benchflush.bin"));
+}
+
+/************************************************************
+ *                  mapped read-only pins                   *
+ ************************************************************/
+
+#define MAPPED_FILE_PAGES 16384
+#define MAPPED_POOL_FRAMES 1024
+#define MAPPED_LOOKUPS 1000000
+
+static volatile unsigned int mappedSink;
+
+// random lookups, then two full scans, all read-only
+static void
+runMapped (const char *label, bool mapped)
+{
+  BM_BufferPool bm;
+  BM_PageHandle h;
+  BM_PoolOptions options = { .mmapFile = mapped, .accessPattern = BM_ACCESS_RANDOM };
+  unsigned int state = 21, sum = 0;
+  double start, lookups, scans;
+  int i;
+
+  CHECK(initBufferPoolWithOptions(&bm, "benchmapped.bin", MAPPED_POOL_FRAMES, RS_CLOCK, NULL, &options));
+  start = nowSeconds();
+  for (i = 0; i < MAPPED_LOOKUPS; i++)
+    {
+      CHECK(pinPageReadOnly(&bm, &h, nextRandom(&state) % MAPPED_FILE_PAGES));
+      sum += (unsigned char) h.data[i % PAGE_SIZE];
+      CHECK(unpinPage(&bm, &h));
+    }
+  lookups = nowSeconds() - start;
+
+  CHECK(setAccessPattern(&bm, BM_ACCESS_SEQUENTIAL));
+  start = nowSeconds();
+  for (i = 0; i < 2 * MAPPED_FILE_PAGES; i++)
+    {
+      CHECK(pinPageReadOnly(&bm, &h, i % MAPPED_FILE_PAGES));
+      sum += (unsigned char) h.data[i % PAGE_SIZE];
+      CHECK(unpinPage(&bm, &h));
+    }
+  scans = nowSeconds() - start;
+  mappedSink = sum;
+
+  printf("%-16s %16.0f %14.0f %10i\n", label, lookups * 1e9 / MAPPED_LOOKUPS,
+         scans * 1e9 / (2 * MAPPED_FILE_PAGES), getNumReadIO(&bm));
+  CHECK(shutdownBufferPool(&bm));
+}
+
+static void
+benchMapped (void)
+{
+  createBenchFile("benchmapped.bin", MAPPED_FILE_PAGES);
+
+  printf("%-16s %16s %14s %10s\n", "pins", "ns per lookup", "ns per scan", "reads");
+  runMapped("frames", false);
+  runMapped("mapped file", true);
+
+  CHECK(destroyPageFile("benchmapped.bin"));
+}
+
+/************************************************************
+ *                  direct I/O                              *
+ ************************************************************/
+
+#define DIRECT_FILE_PAGES 16384
+#define DIRECT_POOL_FRAMES 1024
+#define DIRECT_PINS 100000
+
+// pages of the file in the kernel's page cache
+static int
+cachedPages (char *fileName, int numPages)
+{
+  size_t size = (size_t) numPages * PAGE_SIZE;
+  long osPage = sysconf(_SC_PAGESIZE);
+  unsigned char *resident = malloc(size / osPage);
+  int fd = open(fileName, O_RDONLY);
+  void *map = fd >= 0 ? mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+  int cached = -1;
+  size_t i;
+
+  if (map != MAP_FAILED && resident != NULL && mincore(map, size, resident) == 0)
+    for (cached = 0, i = 0; i < size / osPage; i++)
+      cached += resident[i] & 1;
+  if (map != MAP_FAILED)
+    munmap(map, size);
+  if (fd >= 0)
+    close(fd);
+  free(resident);
+  return cached < 0 ? -1 : (int) ((long) cached * osPage / PAGE_SIZE);
+}
+
+static void
+runDirectIO (const char *label, bool direct)
+{
+  BM_BufferPool bm;
+  BM_PageHandle h;
+  BM_PoolOptions options = { .directIO = direct };
+  unsigned int state = 23;
+  double start, elapsed;
+  int i;
+
+  dropFileCache("benchdirect.bin");
+  CHECK(initBufferPoolWithOptions(&bm, "benchdirect.bin", DIRECT_POOL_FRAMES, RS_CLOCK, NULL, &options));
+  start = nowSeconds();
+  for (i = 0; i < DIRECT_PINS; i++)
+    {
+      CHECK(pinPage(&bm, &h, nextRandom(&state) % DIRECT_FILE_PAGES));
+      if (i % 4 == 0)
+        CHECK(markDirty(&bm, &h));
+      CHECK(unpinPage(&bm, &h));
+    }
+  elapsed = nowSeconds() - start;
+
+  printf("%-14s %10.3f %12.2f %10i %14i\n", label, elapsed, elapsed * 1e6 / DIRECT_PINS,
+         getNumReadIO(&bm), cachedPages("benchdirect.bin", DIRECT_FILE_PAGES));
+  CHECK(shutdownBufferPool(&bm));
+}
+
+static void
+benchDirectIO (void)
+{
+  createBenchFile("benchdirect.bin", DIRECT_FILE_PAGES);
+
+  printf("%-14s %10s %12s %10s %14s\n", "I/O", "seconds", "us per pin", "reads", "cached pages");
+  runDirectIO("page cache", false);
+  runDirectIO("direct", true);
+
+  CHECK(destroyPageFile("benchdirect.bin"));
+}
+
+/************************************************************
+ *                  asynchronous IOPS                       *
+ ************************************************************/
+
+#define IOPS_FILE_PAGES 16384
+#define IOPS_READS 20000
+#define IOPS_MAX_DEPTH 128
+
+typedef struct IopsRun {
+  SM_PageHandle buffers[IOPS_MAX_DEPTH];
+  int freeSlots[IOPS_MAX_DEPTH];
+  int numFree;
+  int done;
+  int errors;
+} IopsRun;
+
+typedef struct IopsSlot {
+  IopsRun *run;
+  int index;
+} IopsSlot;
+
+static void
+iopsDone (RC rc, void *arg)
+{
+  IopsSlot *slot = (IopsSlot *) arg;
+
+  slot->run->done++;
+  if (rc != RC_OK)
+    slot->run->errors++;
+  slot->run->freeSlots[slot->run->numFree++] = slot->index;
+}
+
+// keep depth random reads in flight until IOPS_READS are done; the file is
+// opened with direct I/O where possible so every read goes to the device
+static void
+runAsyncIOPS (const char *label, int backend, int depth)
+{
+  SM_FileHandle fh;
+  SM_AsyncEngine engine;
+  IopsRun run = { .numFree = 0, .done = 0, .errors = 0 };
+  IopsSlot slots[IOPS_MAX_DEPTH];
+  unsigned int state = 31;
+  double start, elapsed;
+  int issued = 0, i;
+
+  dropFileCache("benchiops.bin");
+  if (openPageFileDirect("benchiops.bin", &fh) != RC_OK)
+    CHECK(openPageFile("benchiops.bin", &fh));
+  if (openAsyncEngine(&fh, depth, backend, &engine) != RC_OK)
+    {
+      printf("%-14s %6i %14s\n", label, depth, "unavailable");
+      CHECK(closePageFile(&fh));
+      return;
+    }
+  for (i = 0; i < depth; i++)
+    {
+      if (posix_memalign((void **) &run.buffers[i], 4096, PAGE_SIZE) != 0)
+        exit(1);
+      slots[i] = (IopsSlot) { &run, i };
+      run.freeSlots[run.numFree++] = i;
+    }
+
+  start = nowSeconds();
+  while (run.done < IOPS_READS)
+    {
+      while (issued < IOPS_READS && run.numFree > 0)
+        {
+          int index = run.freeSlots[--run.numFree];
+          CHECK(readBlockAsync(nextRandom(&state) % IOPS_FILE_PAGES, &engine,
+                               run.buffers[index], iopsDone, &slots[index]));
+          issued++;
+        }
+      pollAsyncIO(&engine, 1);
+    }
+  elapsed = nowSeconds() - start;
+
+  if (backend == SM_ASYNC_ANY && !engine.kernelQueue)
+    label = "no io_uring";
+  printf("%-14s %6i %10.3f %12.0f %10i\n", label, depth, elapsed, IOPS_READS / elapsed, run.errors);
+  CHECK(closeAsyncEngine(&engine));
+  CHECK(closePageFile(&fh));
+  for (i = 0; i < depth; i++)
+    free(run.buffers[i]);
+}
+
+static void
+benchAsyncIOPS (void)
+{
+  int depths[] = { 1, 4, 16, 64, IOPS_MAX_DEPTH };
+  int d;
+
+  createBenchFile("benchiops.bin", IOPS_FILE_PAGES);
+
+  printf("%-14s %6s %10s %12s %10s\n", "engine", "depth", "seconds", "reads/s", "errors");
+  for (d = 0; d < (int) (sizeof(depths) / sizeof(depths[0])); d++)
+    {
+      runAsyncIOPS("io_uring", SM_ASYNC_ANY, depths[d]);
+      runAsyncIOPS("thread pool", SM_ASYNC_THREAD_POOL, depths[d]);
+    }
+
+  CHECK(destroyPageFile("benchiops.bin"));
+}
+
+/************************************************************
+ *                  file growth                             *
+ ************************************************************/
+
+#define GROW_PAGES 65536
+#define GROW_EXTENT 256
+#define GROW_LOAD_PAGES 16384
+#define GROW_LOAD_FRAMES 256
+
+// grow a one page file to GROW_PAGES pages: 0 writes a zero page behind the
+// last one at a time, 1 appends pages one by one, 2 appends them in one call
+static void
+runGrowth (const char *label, int mode, int extent)
+{
+  SM_FileHandle fh;
+  SM_PageHandle zeros = calloc(PAGE_SIZE, 1);
+  double start, elapsed;
+
+  CHECK(createPageFile("benchgrow.bin"));
+  CHECK(openPageFile("benchgrow.bin", &fh));
+  CHECK(setGrowthExtent(&fh, extent));
+  start = nowSeconds();
+  if (mode == 2)
+    CHECK(appendEmptyBlocks(GROW_PAGES - 1, &fh));
+  while (fh.totalNumPages < GROW_PAGES)
+    {
+      if (mode == 0)
+        {
+          CHECK(writeBlock(fh.totalNumPages, &fh, zeros));
+        }
+      else
+        {
+          CHECK(appendEmptyBlock(&fh));
+        }
+    }
+  elapsed = nowSeconds() - start;
+  CHECK(closePageFile(&fh));
+
+  printf("%-28s %10.4f %12.3f\n", label, elapsed, elapsed * 1e6 / GROW_PAGES);
+  CHECK(destroyPageFile("benchgrow.bin"));
+  free(zeros);
+}
+
+// fill a new file through a small pool, every pin past the end grows it
+static void
+runBulkLoad (const char *label, int extent)
+{
+  BM_BufferPool bm;
+  BM_PageHandle h;
+  BM_PoolOptions options = { .fileExtentPages = extent };
+  double start, elapsed;
+  int i;
+
+  CHECK(createPageFile("benchgrow.bin"));
+  CHECK(initBufferPoolWithOptions(&bm, "benchgrow.bin", GROW_LOAD_FRAMES, RS_FIFO, NULL, &options));
+  start = nowSeconds();
+  for (i = 0; i < GROW_LOAD_PAGES; i++)
+    {
+      CHECK(pinPage(&bm, &h, i));
+      memset(h.data, i & 0xff, PAGE_SIZE);
+      CHECK(markDirty(&bm, &h));
+      CHECK(unpinPage(&bm, &h));
+    }
+  CHECK(shutdownBufferPool(&bm));
+  elapsed = nowSeconds() - start;
+
+  printf("%-28s %10.4f %12.3f\n", label, elapsed, elapsed * 1e6 / GROW_LOAD_PAGES);
+  CHECK(destroyPageFile("benchgrow.bin"));
+}
+
+static void
+benchFileGrowth (void)
+{
+  printf("%-28s %10s %12s\n", "growth", "seconds", "us per page");
+  runGrowth("zero page writes", 0, 0);
+  runGrowth("appendEmptyBlock", 1, 0);
+  runGrowth("appendEmptyBlock, 1 MB extent", 1, GROW_EXTENT);
+  runGrowth("appendEmptyBlocks", 2, 0);
+  runBulkLoad("bulk load", 0);
+  runBulkLoad("bulk load, 1 MB extent", GROW_EXTENT);
+}
+
+/************************************************************
+ *                  pool snapshots                          *
+ ************************************************************/
+
+#define SNAPSHOT_FRAMES (1 << 20)
+#define SNAPSHOT_POLLS 20
+
+static void
+benchSnapshot (void)
+{
+  BM_BufferPool bm;
+  BM_PageHandle h;
+  BM_PoolSnapshot snapshot;
+  PageNumber *pageNums;
+  bool *dirty;
+  int *fixCounts;
+  long long sum = 0;
+  double start, getters, snapshots;
+  int poll, i;
+
+  createBenchFile("benchsnapshot.bin", 1024);
+  CHECK(initBufferPool(&bm, "benchsnapshot.bin", SNAPSHOT_FRAMES, RS_FIFO, NULL));
+  for (i = 0; i < 1024; i++)
+    {
+      CHECK(pinPage(&bm, &h, i));
+      CHECK(unpinPage(&bm, &h));
+    }
+
+  // what printPoolContent did: three fresh arrays per poll
+  start = nowSeconds();
+  for (poll = 0; poll < SNAPSHOT_POLLS; poll++)
+    {
+      pageNums = getFrameContents(&bm);
+      dirty = getDirtyFlags(&bm);
+      fixCounts = getFixCounts(&bm);
+      sum += pageNums[poll] + dirty[poll] + fixCounts[poll];
+      free(pageNums);
+      free(dirty);
+      free(fixCounts);
+    }
+  getters = (nowSeconds() - start) / SNAPSHOT_POLLS;
+
+  // one pass into arrays allocated once
+  pageNums = malloc(sizeof(PageNumber) * SNAPSHOT_FRAMES);
+  dirty = malloc(sizeof(bool) * SNAPSHOT_FRAMES);
+  fixCounts = malloc(sizeof(int) * SNAPSHOT_FRAMES);
+  start = nowSeconds();
+  for (poll = 0; poll < SNAPSHOT_POLLS; poll++)
+    {
+      snapshot = (BM_PoolSnapshot) { 0, SNAPSHOT_FRAMES, pageNums, dirty, fixCounts };
+      CHECK(getPoolSnapshot(&bm, &snapshot));
+      sum += pageNums[poll] + dirty[poll] + fixCounts[poll];
+    }
+  snapshots = (nowSeconds() - start) / SNAPSHOT_POLLS;
+
+  printf("%-20s %12s\n", "poll", "ms per poll");
+  printf("%-20s %12.3f\n", "three getters", getters * 1e3);
+  printf("%-20s %12.3f\n", "getPoolSnapshot", snapshots * 1e3);
+  if (sum < 0)
+    printf("\n");
+
+  free(pageNums);
+  free(dirty);
+  free(fixCounts);
+  CHECK(shutdownBufferPool(&bm));
+  CHECK(destroyPageFile("benchsnapshot.bin"));
+}
+
+/************************************************************
+ *                  frame scans                             *
+ ************************************************************/
+
+#define FRAME_SCAN_MAX_FRAMES 65536
+#define FRAME_SCAN_WORK (1 << 26)
+
+// all frames but one stay pinned, so every miss looks at the whole pool
+// before it finds the free one; returns ns per miss
+static double
+runPinnedScan (ReplacementStrategy strategy, int numFrames)
+{
+  BM_BufferPool bm;
+  BM_PageHandle h;
+  int ops = FRAME_SCAN_WORK / numFrames;
+  double start;
+  int i;
+
+  CHECK(initBufferPool(&bm, "benchscan.bin", numFrames, strategy, NULL));
+  for (i = 0; i < numFrames - 1; i++)
+    CHECK(pinPage(&bm, &h, i));
+
+  start = nowSeconds();
+  for (i = 0; i < ops; i++)
+    {
+      CHECK(pinPage(&bm, &h, numFrames + i % 2));
+      CHECK(unpinPage(&bm, &h));
+    }
+  start = (nowSeconds() - start) * 1e9 / ops;
+
+  // shutdownBufferPool refuses a pool with pinned pages
+  for (i = 0; i < numFrames - 1; i++)
+    {
+      h.pageNum = i;
+      CHECK(unpinPage(&bm, &h));
+    }
+  CHECK(shutdownBufferPool(&bm));
+  return start;
+}
+
+// forceFlushPool on a full pool without a single dirty page: all scan
+static double
+runCleanFlush (int numFrames)
+{
+  BM_BufferPool bm;
+  BM_PageHandle h;
+  int ops = FRAME_SCAN_WORK / numFrames;
+  double start;
+  int i;
+
+  CHECK(initBufferPool(&bm, "benchscan.bin", numFrames, RS_FIFO, NULL));
+  for (i = 0; i < numFrames; i++)
+    {
+      CHECK(pinPage(&bm, &h, i));
+      CHECK(unpinPage(&bm, &h));
+    }
+
+  start = nowSeconds();
+  for (i = 0; i < ops; i++)
+    CHECK(forceFlushPool(&bm));
+  start = (nowSeconds() - start) * 1e9 / ops;
+
+  CHECK(shutdownBufferPool(&bm));
+  return start;
+}
+
+// BM_SCAN_KERNEL is read when a pool is initialized, so each pool below
+// gets the kernel set just before
+static void
+benchFrameScan (void)
+{
+  static const char *kernels[] = { "scalar", "sse2", "avx2" };
+  int numKernels = (int) (sizeof(kernels) / sizeof(kernels[0]));
+  int numFrames, k;
+
+  createBenchFile("benchscan.bin", FRAME_SCAN_MAX_FRAMES + 2);
+
+  printf("%-8s %8s", "case", "frames");
+  for (k = 0; k < numKernels; k++)
+    printf(" %10s", kernels[k]);
+  printf("   (ns per miss or flush)\n");
+  for (numFrames = 1024; numFrames <= FRAME_SCAN_MAX_FRAMES; numFrames *= 8)
+    {
+      printf("%-8s %8i", "FIFO", numFrames);
+      for (k = 0; k < numKernels; k++)
+        {
+          setenv("BM_SCAN_KERNEL", kernels[k], 1);
+          printf(" %10.0f", runPinnedScan(RS_FIFO, numFrames));
+        }
+      printf("\n%-8s %8i", "CLOCK", numFrames);
+      for (k = 0; k < numKernels; k++)
+        {
+          setenv("BM_SCAN_KERNEL", kernels[k], 1);
+          printf(" %10.0f", runPinnedScan(RS_CLOCK, numFrames));
+        }
+      printf("\n%-8s %8i", "flush", numFrames);
+      for (k = 0; k < numKernels; k++)
+        {
+          setenv("BM_SCAN_KERNEL", kernels[k], 1);
+          printf(" %10.0f", runCleanFlush(numFrames));
+        }
+      printf("\n");
+    }
+  unsetenv("BM_SCAN_KERNEL");
+
+  CHECK(destroyPageFile("benchscan.bin"));
+}
+
+/************************************************************
+ *                  optimistic reads                        *
+ ************************************************************/
+
+#define OPTIMISTIC_HOT_PAGES 8
+#define OPTIMISTIC_TOTAL_OPS 2000000
+#define OPTIMISTIC_MAX_THREADS 64
+#define OPTIMISTIC_WORDS 16
+
+#define READ_PINNED 0
+#define READ_SHARED 1
+#define READ_OPTIMISTIC 2
+
+typedef struct OptimisticWorker {
+  BM_BufferPool *bm;
+  int mode;
+  int writeEvery;  // every this many reads one exclusive write, 0 for none
+  unsigned int seed;
+  int ops;
+  int errors;
+  int retries;
+  long long sum;
+} OptimisticWorker;
+
+// every read looks at a few words of a hot page, like a search in the inner
+// node of an index
+static void *
+runOptimisticWorker (void *arg)
+{
+  OptimisticWorker *w = (OptimisticWorker *) arg;
+  BM_OptimisticRead read;
+  BM_PageHandle h;
+  unsigned int state = w->seed;
+  int i, k;
+
+  for (i = 0; i < w->ops; i++)
+    {
+      int pageNum = (int) (nextRandom(&state) % OPTIMISTIC_HOT_PAGES);
+      int sum = 0;
+
+      if (w->writeEvery > 0 && i % w->writeEvery == 0)
+        {
+          if (pinPageExclusive(w->bm, &h, pageNum) != RC_OK)
+            w->errors++;
+          ((int *) h.data)[0]++;
+          if (markDirty(w->bm, &h) != RC_OK || unpinPage(w->bm, &h) != RC_OK)
+            w->errors++;
+        }
+      else if (w->mode == READ_OPTIMISTIC)
+        {
+          do
+            {
+              if (startOptimisticRead(w->bm, &read, pageNum) != RC_OK)
+                {
+                  w->errors++;
+                  break;
+                }
+              for (k = 0, sum = 0; k < OPTIMISTIC_WORDS; k++)
+                sum += ((volatile int *) read.data)[k];
+            }
+          while (validateOptimisticRead(w->bm, &read) != RC_OK && ++w->retries);
+        }
+      else
+        {
+          if ((w->mode == READ_SHARED ? pinPageShared(w->bm, &h, pageNum) : pinPage(w->bm, &h, pageNum)) != RC_OK)
+            {
+              w->errors++;
+              continue;
+            }
+          for (k = 0; k < OPTIMISTIC_WORDS; k++)
+            sum += ((int *) h.data)[k];
+          unpinPage(w->bm, &h);
+        }
+      w->sum += sum;
+    }
+  return NULL;
+}
+
+// reads per second of numThreads threads; retries counts the optimistic
+// reads that had to start over
+static double
+runOptimisticReads (int numThreads, int mode, int writeEvery, int *retries)
+{
+  static OptimisticWorker workers[OPTIMISTIC_MAX_THREADS];
+  static pthread_t threads[OPTIMISTIC_MAX_THREADS];
+  BM_BufferPool bm;
+  BM_PoolOptions options = { .concurrent = true };
+  double start, elapsed;
+  int i, errors = 0;
+
+  CHECK(initBufferPoolWithOptions(&bm, "benchoptimistic.bin", 64, RS_CLOCK, NULL, &options));
+
+  start = nowSeconds();
+  for (i = 0; i < numThreads; i++)
+    {
+      workers[i] = (OptimisticWorker) { &bm, mode, writeEvery, 1000 + i, OPTIMISTIC_TOTAL_OPS / numThreads, 0, 0, 0 };
+      pthread_create(&threads[i], NULL, runOptimisticWorker, &workers[i]);
+    }
+  for (i = 0, *retries = 0; i < numThreads; i++)
+    {
+      pthread_join(threads[i], NULL);
+      errors += workers[i].errors;
+      *retries += workers[i].retries;
+    }
+  elapsed = nowSeconds() - start;
+
+  if (errors > 0)
+    printf("  %i failed reads with %i threads\n", errors, numThreads);
+  CHECK(shutdownBufferPool(&bm));
+  return (double) (OPTIMISTIC_TOTAL_OPS / numThreads) * numThreads / elapsed;
+}
+
+static void
+benchOptimisticReads (void)
+{
+  int numThreads, retries;
+
+  createBenchFile("benchoptimistic.bin", OPTIMISTIC_HOT_PAGES);
+
+  printf("%8s %12s %12s %12s %12s   (optimistic with 1%% exclusive writes)\n",
+         "threads", "pinPage/s", "shared/s", "optimistic/s", "writes/s");
+  for (numThreads = 1; numThreads <= OPTIMISTIC_MAX_THREADS; numThreads *= 4)
+    {
+      printf("%8i", numThreads);
+      printf(" %12.0f", runOptimisticReads(numThreads, READ_PINNED, 0, &retries));
+      printf(" %12.0f", runOptimisticReads(numThreads, READ_SHARED, 0, &retries));
+      printf(" %12.0f", runOptimisticReads(numThreads, READ_OPTIMISTIC, 0, &retries));
+      printf(" %12.0f", runOptimisticReads(numThreads, READ_OPTIMISTIC, 100, &retries));
+      printf(" (%i retries)\n", retries);
+    }
+
+  CHECK(destroyPageFile("benchoptimistic.bin"));
+}
@@ -1,489 +1,3446 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "buffer_mgr.h"
 #include "storage_mgr.h"
 #include <math.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stddef.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Frame fields that other threads read without holding a latch (fixCount,
+// dirtyBit, the replacement hints, pageNum during a victim search) are
+// accessed through these relaxed atomics.
+#define ATOMIC_READ(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define ATOMIC_WRITE(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+#define ATOMIC_ADD(field, value) __atomic_add_fetch(&(field), (value), __ATOMIC_RELAXED)
+
+// The fields of a frame kept in the pool's per-field arrays
+#define FIX_COUNT(mgmt, frame) ((mgmt)->fixCounts[(frame) - (mgmt)->frames])
+#define DIRTY_BIT(mgmt, frame) ((mgmt)->dirtyBits[(frame) - (mgmt)->frames])
+#define HIT_NUM(mgmt, frame) ((mgmt)->hitNums[(frame) - (mgmt)->frames])
+#define LATCH_EXCLUSIVE 0x40000000 // page latch word: held exclusively
+#define LATCH_WAITING 0x20000000   // page latch word: a writer waits, no new readers
+#define LATCH_READERS 0x1fffffff   // page latch word: number of shared holders
+#define MAX_HELD_LATCHES 64        // page latches a thread is known to hold, see heldLatches
+#define CACHE_LINE 64
+
+#define DEFAULT_PARTITIONS 16
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define DEFAULT_LRUK_K 2
+#define DEFAULT_GCLOCK_MAX 4
+#define DEFAULT_WRITER_DELAY_MS 10
+#define DEFAULT_WRITER_BATCH 16
+#define READ_AHEAD_TRIGGER 2   // pins of consecutive pages that make a run
+#define READ_AHEAD_MIN 4       // first window of a run
+#define MAX_IO_PAGES 256       // largest vectored read or write, 1 MB
+#define MIN_MAP_PAGES 256      // smallest mapping of the page file, 1 MB
+#define DEFAULT_RING_SIZE 16
+#define STAT_SHARDS 16         // statistics counter shards, threads spread over them
+#define REF_BATCH_MAX 128      // references a thread shard queues at most
+#define DEFAULT_REF_BATCH 32   // queued references a thread tries to apply at once
+#define HIT_SAMPLE_RATE 16     // every this many pins of a thread the hit latency is timed
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+// One LFU frequency bucket: the frames referenced freq times, in the order
+// they reached that count. Buckets form a list sorted by freq.
+typedef struct LFUBucket {
+    int freq;
+    int head;
+    int tail;
+    int prev;
+    int next; // also links the unused buckets
+} LFUBucket;
+
+// An intrusive list of frames threaded through listPrev/listNext, the most
+// recent frame at the head
+typedef struct FrameList {
+    int head;
+    int tail;
+    int size;
+} FrameList;
+
+#define NO_LIST -1
+#define LRU_LIST 0  // RS_LRU: unpinned frames by recency
+#define ARC_T1 0    // RS_ARC: pages referenced once recently
+#define ARC_T2 1    // RS_ARC: pages referenced at least twice recently
+#define ARC_FREE 2  // RS_ARC: frames left without a page
+#define NUM_FRAME_LISTS 3
+
+// Histograms of BM_PoolStats
+#define PIN_HIT_LATENCY 0
+#define PIN_MISS_LATENCY 1
+#define FLUSH_LATENCY 2
+#define NUM_LATENCIES 3
+
+// Statistics counters for the threads that share a shard. Each shard has its
+// own cache lines, so threads counting pins don't fight over one counter;
+// the snapshot adds the shards up.
+typedef struct StatShard {
+    long long hits;
+    long long misses;
+    long long pinWaits;
+    long long reads;
+    long long evictions;
+    long long syncEvictions;
+    BM_LatencyHistogram latency[NUM_LATENCIES];
+} __attribute__((aligned(64))) StatShard;
+
+// A page number remembered by ARC after its page was evicted
+typedef struct GhostEntry {
+    PageNumber pageNum;
+    int listId;   // ARC_T1 for ghost list B1, ARC_T2 for B2
+    int prev;     // neighbours on the ghost list, most recent at the head
+    int next;     // also links the unused entries
+    int hashNext; // next entry in the same ghost table bucket
+} GhostEntry;
+
+// One read-only mapping of the page file, see pinPageReadOnly(). It spans
+// more than the file, which grows into it without being mapped again.
+typedef struct MapRegion {
+    char *base;
+    int numPages;             // pages of the file that can be handed out
+    int capacity;             // pages the mapping spans
+    int refs;                 // read-only pins into it, plus one while it is the current mapping
+    bool unmapped;            // the last reference is gone and the range unmapped
+    struct MapRegion *older;  // the mapping this one replaced, its struct kept until shutdown
+} MapRegion;
+
+// Finds the first frame in from .. to - 1 that is unpinned and, with
+// dirtyBits given, dirty; returns to if there is none
+typedef int (*FrameScan)(const int *fixCounts, const int *dirtyBits, int from, int to);
+
+// A client reference to a buffered page that has not reached the replacement
+// strategy yet, see referenceFrame()
+typedef struct Reference {
+    int frame;
+    PageNumber pageNum; // the page referenced, dropped if the frame holds another one by then
+    int stamp;          // logical time of the reference, for LRU-K
+} Reference;
+
+// The references of one thread shard waiting for the policy latch
+typedef struct RefBatch {
+    pthread_mutex_t latch;
+    int count;
+    Reference refs[REF_BATCH_MAX];
+} __attribute__((aligned(64))) RefBatch;
+
+// Applies one reference to the strategy's state, callers hold the policy latch
+struct BM_PoolMgmt;
+typedef void (*ApplyReference)(struct BM_PoolMgmt *mgmt, const Reference *ref);
+
+// A frame's pin count, dirty bit and CLOCK counter are not kept here but in
+// the pool's fixCounts, dirtyBits and hitNums arrays, see BM_PoolMgmt
+typedef struct Page {
+    SM_PageHandle data;
+    PageNumber pageNum;
+    int refNum;
+    int hashNext; // next frame in the same page table bucket, -1 ends the chain
+    int listId;   // strategy list holding the frame (LRU recency, ARC T1/T2), NO_LIST when in none
+    int listPrev; // neighbours on that list, -1 at either end
+    int listNext;
+    int lfuBucket; // LFU frequency bucket holding the frame, -1 when in none
+    int lfuPrev;   // neighbours within that bucket, oldest at the head
+    int lfuNext;
+    int ioInProgress; // set while the page is being read, pins of the page wait for it
+    int ioError;      // the read failed, waiting pins give up and retry
+    int prefetched;   // read by a prefetch thread, its first pin is not another reference
+    int ringOwner;    // id of the bulk ring that read the page, 0 once anybody else pins it
+} PageFrame;
+
+// Bookkeeping stored behind BM_BufferPool.mgmtData. Everything a pool needs
+// lives here, so any number of pools can be used side by side.
+//
+// The page table maps a page number to the frame holding it: every bucket
+// stores the first frame of its chain and the frames link to each other
+// through hashNext, so lookups and updates are O(1) and never allocate.
+//
+// In concurrent mode the buckets are split into partitions, each guarded by
+// its own latch. A page's mapping and the pin count of its frame only change
+// under that page's partition latch, and no code path ever holds two
+// partition latches at once.
+typedef struct BM_PoolMgmt {
+    PageFrame *frames;
+    // The frame fields the victim and flush scans read, one array per field
+    // in frame order, each starting on a cache line: a scan of the pin counts
+    // reads 16 frames per cache line instead of one.
+    int *fixCounts;
+    int *dirtyBits;
+    int *hitNums;     // CLOCK/GCLOCK reference counters
+    int *pageLatches; // reader-writer latch words of pinPageShared/pinPageExclusive
+    int *versions;    // frame versions of optimistic reads, odd while the page changes
+    FrameScan scanFrames; // the widest scan kernel the CPU runs, see pickFrameScan()
+    int *buckets;
+    int bucketShift;
+    int numUsedFrames; // frames are filled in slot order until the pool is full
+    SM_FileHandle fileHandle; // page file, open for the lifetime of the pool
+    char *arena;       // one page-aligned slab holding every frame's page, frame i at i * PAGE_SIZE
+    size_t arenaSize;
+
+    bool concurrent;
+    pthread_mutex_t *partitionLatches;
+    unsigned int partitionMask;
+    pthread_mutex_t fileLatch; // serializes growing the page file
+
+    int bufferSize;   // number of frames in the pool
+    int rearIndex;    // index of the most recent frame fill, -1 before the first one
+    int writeCount;   // pages written back to disk
+    int syncWriteCount;       // dirty victims written inside pinPage
+    int backgroundWriteCount; // pages cleaned by the background writer
+    int flushThreads;         // threads sharing the writes of forceFlushPool
+    bool strictLatches;       // markDirty only for holders of the exclusive page latch
+    int hit;          // logical clock of page references
+    StatShard *stats; // STAT_SHARDS counter shards, see getPoolStats()
+    // Frame lists of the list based strategies. For LRU, lists[LRU_LIST]
+    // holds the unpinned frames; frames join it when they are unpinned and
+    // pinned frames are dropped from it lazily when the victim search meets
+    // them at the tail.
+    bool recencyList;
+    FrameList lists[NUM_FRAME_LISTS];
+
+    // ARC state, allocated for RS_ARC only. ghostLists[ARC_T1] and
+    // ghostLists[ARC_T2] are B1 and B2, the pages recently evicted from T1
+    // and T2; a hash table over the entries finds a page in O(1).
+    bool adaptive;
+    int arcTarget;            // p, the target size of T1
+    GhostEntry *ghosts;
+    int *ghostBuckets;
+    int ghostShift;
+    int freeGhost;            // first unused entry
+    FrameList ghostLists[2];
+    unsigned int clockPointer; // CLOCK hand, only moved by the victim search
+    int clockMax;     // cap of the reference counters, 1 for CLOCK
+    int clockInitial; // counter of a freshly read page
+
+    // LFU frequency buckets, allocated for RS_LFU only. A frame's count is its
+    // refNum: 1 when loaded, one more per hit, 0 for a frame without a page.
+    bool freqBuckets;
+    LFUBucket *lfuBuckets;
+    int lfuLowest;        // bucket with the smallest count, -1 when empty
+    int lfuFreeBucket;    // first unused bucket
+    int lfuAgingInterval; // halve all counts after this many references, 0 never
+    int lfuSinceAging;
+
+    // LRU-K state, only allocated for RS_LRU_K. Reference times are hit + 1,
+    // so 0 means "no such reference". Frame i's times are lrukHist[i * lrukK]
+    // (most recent) to lrukHist[i * lrukK + lrukK - 1] (K-th most recent).
+    // The history of evicted pages is kept in a direct-mapped table of
+    // lrukHistoryMask + 1 slots, a newer page simply overwrites its slot.
+    int lrukK;
+    int lrukPeriod;           // correlated reference period
+    int *lrukHist;
+    int *lrukLast;            // time of each frame's last reference, correlated or not
+    PageNumber *lrukOwner;    // page whose history a frame holds
+    PageNumber *lrukHistoryPages;
+    int *lrukHistoryTimes;
+    unsigned int lrukHistoryMask;
+    pthread_mutex_t policyLatch; // guards the frame lists, LFU buckets, ARC and LRU-K state in concurrent mode
+    // References queued per thread shard in concurrent mode, so that hits and
+    // unpins do not take the policy latch one by one; NULL applies each
+    // reference at once. See referenceFrame().
+    RefBatch *refBatches;
+    int refBatchSize;
+    ApplyReference applyReference;
+
+    // Background writer, see backgroundWriter()
+    ReplacementStrategy strategy;
+    bool writerRunning;
+    bool writerStop;
+    int writerDelayMs;
+    int writerBatchSize;
+    int writerCursor;       // sweep position for strategies without a cheap eviction order
+    int *writerCandidates;
+    pthread_t writer;
+    pthread_mutex_t writerLatch;
+    pthread_cond_t writerWake;
+
+    // Prefetch threads, see prefetchWorker(). Requested pages wait in a ring
+    // buffer of prefetchCapacity entries guarded by prefetchLatch.
+    BM_BufferPool *pool;      // the pool the threads load pages into
+    int prefetchThreads;      // threads running
+    pthread_t *prefetchers;
+    PageNumber *prefetchQueue;
+    int prefetchCapacity;
+    int prefetchHead;         // oldest queued page
+    int prefetchQueued;
+    int prefetchActive;       // pages being read by the threads right now
+    bool prefetchStop;
+    int prefetchReadCount;    // pages read by the prefetch threads
+    int prefetchWriteCount;   // dirty victims written back to make room for a prefetch
+    pthread_mutex_t prefetchLatch;
+    pthread_cond_t prefetchWake; // a page was queued or the threads have to stop
+    pthread_cond_t prefetchIdle; // the queue ran empty and no read is in flight
+
+    // Sequential read-ahead, see readAhead(). Guarded by readAheadLatch in
+    // concurrent mode.
+    int readAheadMax;         // largest window, 0 when read-ahead is off
+    PageNumber raLast;        // page of the previous pin
+    int raRun;                // length of the ascending run ending at raLast
+    int raWindow;             // current window, doubles while the run goes on
+    PageNumber raFrontier;    // first page behind the pages read ahead so far
+    pthread_mutex_t readAheadLatch;
+
+    int lastRingId;           // bulk rings are numbered from 1, see pinPageBulk()
+
+    // The mapped page file, NULL unless mmapFile is set. When the file grows
+    // past the mapping it is mapped again, twice as large; an older mapping
+    // stays until the last page pinned from it is unpinned.
+    MapRegion *mapping;
+    int retiredMappings;      // older mappings not unmapped yet
+    int mapFd;
+    BM_AccessPattern accessPattern;
+    pthread_mutex_t mapLatch; // serializes remapping
+
+    // Asynchronous I/O for batched misses, flushes and prefetches, used when
+    // ioQueueDepth is set. Completions run in whichever pool call polls next.
+    bool asyncIO;
+    SM_AsyncEngine engine;
+    int asyncReads;           // asynchronous reads into frames not completed yet
+} BM_PoolMgmt;
+
+
+// Page table helpers
+
+static unsigned int hashPage(const BM_PoolMgmt *mgmt, PageNumber pageNum) {
+    // Fibonacci hashing spreads consecutive page numbers over the buckets
+    return ((unsigned int)pageNum * 2654435769u) >> mgmt->bucketShift;
+}
+
+static void lockPartition(BM_PoolMgmt *mgmt, PageNumber pageNum) {
+    if (mgmt->concurrent)
+        pthread_mutex_lock(&mgmt->partitionLatches[hashPage(mgmt, pageNum) & mgmt->partitionMask]);
+}
+
+static void unlockPartition(BM_PoolMgmt *mgmt, PageNumber pageNum) {
+    if (mgmt->concurrent)
+        pthread_mutex_unlock(&mgmt->partitionLatches[hashPage(mgmt, pageNum) & mgmt->partitionMask]);
+}
+
+// Apply a thread shard's queued references, see referenceFrame(). Callers
+// hold the batch latch and the policy latch, which this releases.
+static void applyBatch(BM_PoolMgmt *mgmt, RefBatch *batch) {
+    for (int i = 0; i < batch->count; i++)
+        mgmt->applyReference(mgmt, &batch->refs[i]);
+    ATOMIC_WRITE(batch->count, 0);
+    pthread_mutex_unlock(&mgmt->policyLatch);
+}
+
+// Replacement state that is not kept in plain per-frame fields is guarded by
+// the policy latch in concurrent mode. Queued references are applied before
+// the latch is handed out, so victim searches, misses and evictions see every
+// reference queued before them, in the order of the pool's own updates.
+// Latches are taken batch first, policy second, like in referenceFrame.
+static void lockPolicy(BM_PoolMgmt *mgmt) {
+    for (int s = 0; mgmt->refBatches != NULL && s < STAT_SHARDS; s++) {
+        RefBatch *batch = &mgmt->refBatches[s];
+        if (ATOMIC_READ(batch->count) == 0)
+            continue;
+        pthread_mutex_lock(&batch->latch);
+        pthread_mutex_lock(&mgmt->policyLatch);
+        applyBatch(mgmt, batch);
+        pthread_mutex_unlock(&batch->latch);
+    }
+    if (mgmt->concurrent)
+        pthread_mutex_lock(&mgmt->policyLatch);
+}
+
+static void unlockPolicy(BM_PoolMgmt *mgmt) {
+    if (mgmt->concurrent)
+        pthread_mutex_unlock(&mgmt->policyLatch);
+}
+
+// Callers hold the partition latch of pageNum in all page table helpers
+static int lookupFrame(const BM_PoolMgmt *mgmt, PageNumber pageNum) {
+    int idx = mgmt->buckets[hashPage(mgmt, pageNum)];
+
+    while (idx != -1 && mgmt->frames[idx].pageNum != pageNum)
+        idx = mgmt->frames[idx].hashNext;
+    return idx; // -1 when the page is not in the pool
+}
+
+// peekFrame walks the chains without a latch, so the links are published with
+// release stores: a walker that reaches a frame also sees the frame's pageNum
+// and its own link set before it.
+static void insertFrame(BM_PoolMgmt *mgmt, int frameIdx) {
+    unsigned int bucket = hashPage(mgmt, mgmt->frames[frameIdx].pageNum);
+
+    __atomic_store_n(&mgmt->frames[frameIdx].hashNext, mgmt->buckets[bucket], __ATOMIC_RELEASE);
+    __atomic_store_n(&mgmt->buckets[bucket], frameIdx, __ATOMIC_RELEASE);
+}
+
+static void removeFrame(BM_PoolMgmt *mgmt, int frameIdx) {
+    int *link = &mgmt->buckets[hashPage(mgmt, mgmt->frames[frameIdx].pageNum)];
+
+    // Walk the chain to the link that points at this frame and unhook it
+    while (*link != -1 && *link != frameIdx)
+        link = &mgmt->frames[*link].hashNext;
+    if (*link == frameIdx)
+        __atomic_store_n(link, mgmt->frames[frameIdx].hashNext, __ATOMIC_RELEASE);
+    __atomic_store_n(&mgmt->frames[frameIdx].hashNext, -1, __ATOMIC_RELEASE);
+}
+
+
+// Page I/O helpers, all going through the pool's open file handle
+
+// A private copy of the pool's file handle, so threads doing I/O at the same
+// time never race on the handle's position fields
+static SM_FileHandle ioHandle(BM_PoolMgmt *mgmt) {
+    SM_FileHandle fh = mgmt->fileHandle;
+
+    fh.totalNumPages = ATOMIC_READ(mgmt->fileHandle.totalNumPages);
+    return fh;
+}
+
+static int adviceFor(BM_AccessPattern pattern) {
+    return pattern == BM_ACCESS_SEQUENTIAL ? MADV_SEQUENTIAL : pattern == BM_ACCESS_RANDOM ? MADV_RANDOM : MADV_NORMAL;
+}
+
+// Drop a reference to a mapping. The last one of a mapping that was replaced
+// unmaps it; a late holdMapping may revive the count for a moment, so the
+// unmapped flag makes sure it is unmapped once.
+static void releaseMapping(BM_PoolMgmt *mgmt, MapRegion *region) {
+    if (__atomic_sub_fetch(&region->refs, 1, __ATOMIC_SEQ_CST) == 0 &&
+        !__atomic_exchange_n(&region->unmapped, true, __ATOMIC_SEQ_CST)) {
+        munmap(region->base, (size_t)region->capacity * PAGE_SIZE);
+        __atomic_sub_fetch(&mgmt->retiredMappings, 1, __ATOMIC_RELEASE);
+    }
+}
+
+// Take a reference to the current mapping, which keeps it mapped while the
+// caller uses it even if the file is mapped again meanwhile
+static MapRegion *holdMapping(BM_PoolMgmt *mgmt) {
+    while (true) {
+        MapRegion *region = __atomic_load_n(&mgmt->mapping, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&region->refs, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&mgmt->mapping, __ATOMIC_SEQ_CST) == region)
+            return region;
+        releaseMapping(mgmt, region); // Replaced in between, take the new one
+    }
+}
+
+// Make the pages the file grew by visible. Pages that still fit the current
+// mapping only raise its page count; past it the file is mapped again with
+// twice its size, so a file growing page by page is mapped O(log n) times and
+// the address space stays O(n). The old mapping goes away with its last pin.
+// Returns the current mapping, NULL if the file was never mapped.
+static MapRegion *remapFile(BM_PoolMgmt *mgmt) {
+    if (mgmt->concurrent)
+        pthread_mutex_lock(&mgmt->mapLatch);
+    MapRegion *current = mgmt->mapping;
+    int numPages = ATOMIC_READ(mgmt->fileHandle.totalNumPages);
+    if (current != NULL && numPages <= current->capacity) {
+        if (ATOMIC_READ(current->numPages) < numPages)
+            ATOMIC_WRITE(current->numPages, numPages);
+    } else {
+        int capacity = MAX(numPages * 2, MIN_MAP_PAGES);
+        size_t size = (size_t)capacity * PAGE_SIZE;
+        MapRegion *region = malloc(sizeof(MapRegion));
+        // Mapping past the end of the file is fine as long as nobody touches
+        // those pages before the file grows into them
+        void *base = region != NULL ? mmap(NULL, size, PROT_READ, MAP_SHARED, mgmt->mapFd, 0) : MAP_FAILED;
+        if (base != MAP_FAILED) {
+            madvise(base, size, adviceFor(mgmt->accessPattern));
+            *region = (MapRegion){.base = base, .numPages = numPages, .capacity = capacity,
+                                  .refs = 1, .unmapped = false, .older = current};
+            if (current != NULL)
+                __atomic_add_fetch(&mgmt->retiredMappings, 1, __ATOMIC_RELEASE);
+            __atomic_store_n(&mgmt->mapping, region, __ATOMIC_SEQ_CST);
+            if (current != NULL)
+                releaseMapping(mgmt, current); // Its own reference as the current mapping
+            current = region;
+        } else {
+            free(region); // Keep the old mapping, the pages past it are not mapped yet
+        }
+    }
+    if (mgmt->concurrent)
+        pthread_mutex_unlock(&mgmt->mapLatch);
+    return current;
+}
+
+static bool inMapping(const MapRegion *region, const char *data) {
+    return (uintptr_t)data - (uintptr_t)region->base < (size_t)region->capacity * PAGE_SIZE;
+}
+
+// The mapping of the page file data points into, NULL if it points into none.
+// Unless pages pinned from an older mapping are still out, only the current
+// mapping is checked.
+static MapRegion *mappedRegion(BM_PoolMgmt *mgmt, const char *data) {
+    MapRegion *region = __atomic_load_n(&mgmt->mapping, __ATOMIC_ACQUIRE);
+
+    if (inMapping(region, data))
+        return region;
+    if (__atomic_load_n(&mgmt->retiredMappings, __ATOMIC_ACQUIRE) == 0)
+        return NULL;
+    for (region = region->older; region != NULL; region = region->older)
+        if (!ATOMIC_READ(region->unmapped) && inMapping(region, data))
+            return region;
+    return NULL;
+}
+
+// Write a mapped page's changes in the page cache through to the disk
+static RC syncMappedPage(BM_PoolMgmt *mgmt, PageNumber pageNum) {
+    MapRegion *region = holdMapping(mgmt);
+
+    if (pageNum >= ATOMIC_READ(region->numPages)) {
+        releaseMapping(mgmt, region);
+        remapFile(mgmt);
+        region = holdMapping(mgmt);
+    }
+    RC rc = RC_OK; // Past the end of the file there is nothing to write
+    if (pageNum < ATOMIC_READ(region->numPages) &&
+        msync(region->base + (size_t)pageNum * PAGE_SIZE, PAGE_SIZE, MS_SYNC) != 0)
+        rc = RC_WRITE_FAILED;
+    releaseMapping(mgmt, region);
+    return rc;
+}
+
+// Grow the page file to at least numPages pages, and the mapping with it
+static RC growFile(BM_PoolMgmt *mgmt, int numPages) {
+    if (numPages <= ATOMIC_READ(mgmt->fileHandle.totalNumPages))
+        return RC_OK;
+    if (mgmt->concurrent)
+        pthread_mutex_lock(&mgmt->fileLatch);
+    RC rc = ensureCapacity(numPages, &mgmt->fileHandle);
+    if (mgmt->concurrent)
+        pthread_mutex_unlock(&mgmt->fileLatch);
+    if (rc == RC_OK && mgmt->mapping != NULL)
+        remapFile(mgmt);
+    return rc;
+}
+
+static RC loadPage(BM_PoolMgmt *mgmt, PageNumber pageNum, SM_PageHandle data) {
+    // Pinning a page past the end of the file grows the file to hold it
+    RC rc = growFile(mgmt, pageNum + 1);
+    if (rc != RC_OK)
+        return rc;
+
+    SM_FileHandle fh = ioHandle(mgmt);
+    return readBlock(pageNum, &fh, data);
+}
+
+// The caller keeps the frame pinned or otherwise private while it is written
+static RC writeBackPage(BM_PoolMgmt *mgmt, PageFrame *frame) {
+    SM_FileHandle fh = ioHandle(mgmt);
+
+    // Clear the dirty bit before writing so a change made during the write marks the page dirty again
+    ATOMIC_WRITE(DIRTY_BIT(mgmt, frame), 0);
+    RC rc = writeBlock(frame->pageNum, &fh, frame->data);
+
+    if (rc == RC_OK)
+        ATOMIC_ADD(mgmt->writeCount, 1); // Count the write against this pool
+    else
+        ATOMIC_WRITE(DIRTY_BIT(mgmt, frame), 1);
+    return rc;
+}
+
+
+// A page and the frame or caller slot it belongs to, for work done in page order
+typedef struct PageSlot {
+    PageNumber pageNum;
+    int slot;
+} PageSlot;
+
+static int comparePageSlots(const void *a, const void *b) {
+    PageNumber x = ((const PageSlot *)a)->pageNum;
+    PageNumber y = ((const PageSlot *)b)->pageNum;
+    return (x > y) - (x < y);
+}
+
+// Run completions until *pending drops to zero
+static void waitForPending(BM_PoolMgmt *mgmt, int *pending) {
+    while (__atomic_load_n(pending, __ATOMIC_ACQUIRE) > 0)
+        if (pollAsyncIO(&mgmt->engine, 1) == 0)
+            sched_yield(); // Another thread is running the completion
+}
+
+// A run of pages written, count it or mark its frames dirty again
+static void runWritten(BM_PoolMgmt *mgmt, const PageSlot *pages, int count, RC rc) {
+    if (rc == RC_OK) {
+        ATOMIC_ADD(mgmt->writeCount, count);
+        return;
+    }
+    for (int k = 0; k < count; k++)
+        ATOMIC_WRITE(mgmt->dirtyBits[pages[k].slot], 1);
+}
+
+// A run written through the asynchronous engine, see writeRuns()
+typedef struct AsyncRun {
+    BM_PoolMgmt *mgmt;
+    const PageSlot *pages;
+    int count;
+    RC rc;
+    int *pending;
+} AsyncRun;
+
+static void runDone(RC rc, void *arg) {
+    AsyncRun *run = (AsyncRun *)arg;
+
+    runWritten(run->mgmt, run->pages, run->count, rc);
+    run->rc = rc;
+    __atomic_sub_fetch(run->pending, 1, __ATOMIC_RELEASE);
+}
+
+// Write the dirty frames pages[k].slot, claimed by the caller and sorted by
+// page number, with one vectored write per run of adjacent pages. With
+// asynchronous I/O all runs are in flight at once, up to the queue depth.
+static RC writeRuns(BM_PoolMgmt *mgmt, const PageSlot *pages, int n) {
+    SM_FileHandle fh = ioHandle(mgmt);
+    SM_PageHandle data[MAX_IO_PAGES];
+    AsyncRun *runs = mgmt->asyncIO && n > 0 ? malloc(sizeof(AsyncRun) * n) : NULL;
+    int numRuns = 0, pending = 0;
+    RC result = RC_OK;
+
+    for (int first = 0, count; first < n; first += count) {
+        for (count = 1; first + count < n && count < MAX_IO_PAGES; count++)
+            if (pages[first + count].pageNum != pages[first].pageNum + count)
+                break;
+
+        // Dirty bits are cleared before the write, like in writeBackPage()
+        for (int k = 0; k < count; k++) {
+            PageFrame *frame = &mgmt->frames[pages[first + k].slot];
+            ATOMIC_WRITE(DIRTY_BIT(mgmt, frame), 0);
+            data[k] = frame->data;
+        }
+        if (runs != NULL) {
+            AsyncRun *run = &runs[numRuns++];
+            *run = (AsyncRun){mgmt, pages + first, count, RC_OK, &pending};
+            ATOMIC_ADD(pending, 1);
+            RC rc = writeBlocksAsync(pages[first].pageNum, count, &mgmt->engine, data, runDone, run);
+            if (rc != RC_OK)
+                runDone(rc, run);
+            continue;
+        }
+        RC rc = writeBlocks(pages[first].pageNum, count, &fh, data);
+        runWritten(mgmt, pages + first, count, rc);
+        if (rc != RC_OK)
+            result = rc;
+    }
+
+    if (runs != NULL) {
+        waitForPending(mgmt, &pending);
+        for (int r = 0; r < numRuns && result == RC_OK; r++)
+            result = runs[r].rc;
+        free(runs);
+    }
+    return result;
+}
+
+
+// Frame list helpers, callers hold the policy latch
+
+static void listRemove(BM_PoolMgmt *mgmt, int frameIdx) {
+    PageFrame *frame = &mgmt->frames[frameIdx];
+
+    if (frame->listId == NO_LIST)
+        return;
+    FrameList *list = &mgmt->lists[frame->listId];
+    if (frame->listPrev != -1)
+        mgmt->frames[frame->listPrev].listNext = frame->listNext;
+    else
+        list->head = frame->listNext;
+    if (frame->listNext != -1)
+        mgmt->frames[frame->listNext].listPrev = frame->listPrev;
+    else
+        list->tail = frame->listPrev;
+    list->size--;
+    frame->listPrev = frame->listNext = -1;
+    frame->listId = NO_LIST;
+}
+
+static void listPush(BM_PoolMgmt *mgmt, int listId, int frameIdx, bool mostRecent) {
+    PageFrame *frame = &mgmt->frames[frameIdx];
+    FrameList *list = &mgmt->lists[listId];
+
+    if (mostRecent) {
+        frame->listPrev = -1;
+        frame->listNext = list->head;
+        if (list->head != -1)
+            mgmt->frames[list->head].listPrev = frameIdx;
+        else
+            list->tail = frameIdx;
+        list->head = frameIdx;
+    } else {
+        frame->listNext = -1;
+        frame->listPrev = list->tail;
+        if (list->tail != -1)
+            mgmt->frames[list->tail].listNext = frameIdx;
+        else
+            list->head = frameIdx;
+        list->tail = frameIdx;
+    }
+    list->size++;
+    frame->listId = listId;
+}
+
+// ARC keeps frames left without a page on a list of their own, reused first
+static void releaseARC(BM_PoolMgmt *mgmt, int frameIdx) {
+    lockPolicy(mgmt);
+    listRemove(mgmt, frameIdx);
+    listPush(mgmt, ARC_FREE, frameIdx, false);
+    unlockPolicy(mgmt);
+}
+
+// A frame's pin count dropped: an unpinned frame goes to the head of the list
+// when a client has just used its page, to the tail when it holds no page or
+// a page only a bulk ring has read, and otherwise keeps its place. The state is read under the policy latch,
+// so whichever unpin or re-pin comes last leaves the list right.
+static void placeRecency(BM_PoolMgmt *mgmt, PageFrame *frame, bool used) {
+    int frameIdx = frame - mgmt->frames;
+
+    if (ATOMIC_READ(FIX_COUNT(mgmt, frame)) == 0) {
+        if (ATOMIC_READ(frame->pageNum) == NO_PAGE || ATOMIC_READ(frame->ringOwner) != 0) {
+            listRemove(mgmt, frameIdx);
+            listPush(mgmt, LRU_LIST, frameIdx, false);
+        } else if (used || frame->listId == NO_LIST) {
+            listRemove(mgmt, frameIdx);
+            listPush(mgmt, LRU_LIST, frameIdx, true);
+        }
+    }
+}
+
+static void updateRecency(BM_PoolMgmt *mgmt, PageFrame *frame, bool used) {
+    lockPolicy(mgmt);
+    placeRecency(mgmt, frame, used);
+    unlockPolicy(mgmt);
+}
+
+// A client unpinned the page of ref, which makes it the most recent one
+static void applyLRU(BM_PoolMgmt *mgmt, const Reference *ref) {
+    if (ATOMIC_READ(mgmt->frames[ref->frame].pageNum) == ref->pageNum)
+        placeRecency(mgmt, &mgmt->frames[ref->frame], true);
+}
+
+
+// LFU frequency bucket helpers, callers hold the policy latch
+
+// Take an unused bucket for count freq and link it after bucket prev, or in
+// front of all buckets when prev is -1
+static int newBucket(BM_PoolMgmt *mgmt, int freq, int prev) {
+    LFUBucket *buckets = mgmt->lfuBuckets;
+    int b = mgmt->lfuFreeBucket;
+
+    mgmt->lfuFreeBucket = buckets[b].next;
+    buckets[b] = (LFUBucket){.freq = freq, .head = -1, .tail = -1, .prev = prev,
+                             .next = prev == -1 ? mgmt->lfuLowest : buckets[prev].next};
+    if (buckets[b].next != -1)
+        buckets[buckets[b].next].prev = b;
+    if (prev == -1)
+        mgmt->lfuLowest = b;
+    else
+        buckets[prev].next = b;
+    return b;
+}
+
+// The bucket for count freq right after bucket prev, created when missing.
+// Counts only ever move to the neighbouring bucket, which keeps this O(1).
+static int bucketFor(BM_PoolMgmt *mgmt, int prev, int freq) {
+    int b = prev == -1 ? mgmt->lfuLowest : mgmt->lfuBuckets[prev].next;
+
+    if (b != -1 && mgmt->lfuBuckets[b].freq == freq)
+        return b;
+    return newBucket(mgmt, freq, prev);
+}
+
+static void appendToBucket(BM_PoolMgmt *mgmt, int b, int frameIdx) {
+    LFUBucket *bucket = &mgmt->lfuBuckets[b];
+    PageFrame *frame = &mgmt->frames[frameIdx];
+
+    frame->lfuBucket = b;
+    frame->lfuPrev = bucket->tail;
+    frame->lfuNext = -1;
+    if (bucket->tail != -1)
+        mgmt->frames[bucket->tail].lfuNext = frameIdx;
+    else
+        bucket->head = frameIdx;
+    bucket->tail = frameIdx;
+}
+
+// Take a frame out of its bucket and give the bucket up once it is empty
+static void unlinkFromBucket(BM_PoolMgmt *mgmt, int frameIdx) {
+    PageFrame *frame = &mgmt->frames[frameIdx];
+    int b = frame->lfuBucket;
+
+    if (b == -1)
+        return;
+    LFUBucket *bucket = &mgmt->lfuBuckets[b];
+    if (frame->lfuPrev != -1)
+        mgmt->frames[frame->lfuPrev].lfuNext = frame->lfuNext;
+    else
+        bucket->head = frame->lfuNext;
+    if (frame->lfuNext != -1)
+        mgmt->frames[frame->lfuNext].lfuPrev = frame->lfuPrev;
+    else
+        bucket->tail = frame->lfuPrev;
+    frame->lfuBucket = frame->lfuPrev = frame->lfuNext = -1;
+
+    if (bucket->head == -1) {
+        if (bucket->prev != -1)
+            mgmt->lfuBuckets[bucket->prev].next = bucket->next;
+        else
+            mgmt->lfuLowest = bucket->next;
+        if (bucket->next != -1)
+            mgmt->lfuBuckets[bucket->next].prev = bucket->prev;
+        bucket->next = mgmt->lfuFreeBucket;
+        mgmt->lfuFreeBucket = b;
+    }
+}
+
+// Halve every count so pages that were popular a long time ago do not stay
+// in the pool forever. Halving keeps the order of the counts, so the buckets
+// are rebuilt in one pass from the lowest to the highest.
+static void ageFrequencies(BM_PoolMgmt *mgmt) {
+    int old = mgmt->lfuLowest;
+    int last = -1;
+
+    mgmt->lfuLowest = -1;
+    while (old != -1) {
+        int frameIdx = mgmt->lfuBuckets[old].head;
+        int nextOld = mgmt->lfuBuckets[old].next;
+
+        // The old bucket is not needed any more, its frames are walked below
+        mgmt->lfuBuckets[old].next = mgmt->lfuFreeBucket;
+        mgmt->lfuFreeBucket = old;
+
+        while (frameIdx != -1) {
+            PageFrame *frame = &mgmt->frames[frameIdx];
+            int nextFrame = frame->lfuNext;
+            int freq = (frame->refNum + 1) / 2;
+
+            if (last == -1 || mgmt->lfuBuckets[last].freq != freq)
+                last = newBucket(mgmt, freq, last);
+            appendToBucket(mgmt, last, frameIdx);
+            ATOMIC_WRITE(frame->refNum, freq);
+            frameIdx = nextFrame;
+        }
+        old = nextOld;
+    }
+}
+
+static void countReference(BM_PoolMgmt *mgmt) {
+    if (mgmt->lfuAgingInterval > 0 && ++mgmt->lfuSinceAging >= mgmt->lfuAgingInterval) {
+        mgmt->lfuSinceAging = 0;
+        ageFrequencies(mgmt);
+    }
+}
+
+// A buffered page is referenced again: move it to the next count's bucket
+static void applyLFU(BM_PoolMgmt *mgmt, const Reference *ref) {
+    PageFrame *frame = &mgmt->frames[ref->frame];
+
+    if (frame->lfuBucket != -1 && ATOMIC_READ(frame->pageNum) == ref->pageNum) {
+        int from = frame->lfuBucket;
+        int to = bucketFor(mgmt, from, frame->refNum + 1);
+
+        unlinkFromBucket(mgmt, ref->frame);
+        appendToBucket(mgmt, to, ref->frame);
+        ATOMIC_WRITE(frame->refNum, frame->refNum + 1);
+    }
+    countReference(mgmt);
+}
+
+// A page was read into a frame: it starts with a count of one, after the
+// frames without a page that may sit in a bucket of their own
+static void loadLFU(BM_PoolMgmt *mgmt, int frameIdx) {
+    lockPolicy(mgmt);
+    unlinkFromBucket(mgmt, frameIdx);
+    int empty = mgmt->lfuLowest != -1 && mgmt->lfuBuckets[mgmt->lfuLowest].freq == 0 ? mgmt->lfuLowest : -1;
+    appendToBucket(mgmt, bucketFor(mgmt, empty, 1), frameIdx);
+    ATOMIC_WRITE(mgmt->frames[frameIdx].refNum, 1);
+    countReference(mgmt);
+    unlockPolicy(mgmt);
+}
+
+// A frame left without a page goes to the count 0 bucket, the first to be reused
+static void releaseLFU(BM_PoolMgmt *mgmt, int frameIdx) {
+    lockPolicy(mgmt);
+    unlinkFromBucket(mgmt, frameIdx);
+    appendToBucket(mgmt, bucketFor(mgmt, -1, 0), frameIdx);
+    ATOMIC_WRITE(mgmt->frames[frameIdx].refNum, 0);
+    unlockPolicy(mgmt);
+}
+
+// A claimed frame gives up its page and with it the page's count
+static void evictLFU(BM_PoolMgmt *mgmt, int frameIdx) {
+    lockPolicy(mgmt);
+    unlinkFromBucket(mgmt, frameIdx);
+    unlockPolicy(mgmt);
+}
+
+
+// Statistics
+
+static int nextStatShard;
+static __thread int statShard = -1;
+static __thread unsigned int statPins;
+
+// The calling thread's shard, handed out round robin on first use. It picks
+// the thread's counters and its batch of queued references.
+static int myShard(void) {
+    if (statShard < 0)
+        statShard = __atomic_fetch_add(&nextStatShard, 1, __ATOMIC_RELAXED) % STAT_SHARDS;
+    return statShard;
+}
+
+static StatShard *myStats(BM_PoolMgmt *mgmt) {
+    return &mgmt->stats[myShard()];
+}
+
+static long long nowNs(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// Add one operation that started at start to a latency histogram
+static void recordLatency(BM_PoolMgmt *mgmt, int histogram, long long start) {
+    BM_LatencyHistogram *h = &myStats(mgmt)->latency[histogram];
+    long long ns = nowNs() - start;
+    int bucket = ns > 1 ? 63 - __builtin_clzll(ns) : 0;
+
+    ATOMIC_ADD(h->count, 1);
+    ATOMIC_ADD(h->totalNs, ns);
+    ATOMIC_ADD(h->buckets[MIN(bucket, BM_LATENCY_BUCKETS - 1)], 1);
+}
+
+static void countStat(BM_PoolMgmt *mgmt, size_t field, long long n) {
+    __atomic_add_fetch((long long *)((char *)myStats(mgmt) + field), n, __ATOMIC_RELAXED);
+}
+#define COUNT(mgmt, field, n) countStat((mgmt), offsetof(StatShard, field), (n))
+
+// A page left the pool to make room; sync tells whether a pin waited for it
+static void countEviction(BM_PoolMgmt *mgmt, PageNumber evicted, bool sync) {
+    if (evicted == NO_PAGE)
+        return;
+    COUNT(mgmt, evictions, 1);
+    if (sync)
+        COUNT(mgmt, syncEvictions, 1);
+}
+
+
+// Batched references (BP-Wrapper, Ding et al.)
+
+// A client referenced the buffered page pageNum in frameIdx: a hit, or with
+// LRU the unpin that ends its use. In concurrent mode the reference is queued
+// in the calling thread's batch instead of taking the policy latch, which all
+// threads share, on every hit. A batch of refBatchSize references is applied
+// if the policy latch is free; otherwise the thread goes on queueing, and only
+// a batch twice as large waits for the latch. The strategy sees references a
+// little late and, across threads, slightly out of order; a victim search
+// sees every queued reference, see lockPolicy.
+static void referenceFrame(BM_PoolMgmt *mgmt, int frameIdx, PageNumber pageNum, int stamp) {
+    Reference ref = {.frame = frameIdx, .pageNum = pageNum, .stamp = stamp};
+
+    if (mgmt->refBatches == NULL) {
+        lockPolicy(mgmt);
+        mgmt->applyReference(mgmt, &ref);
+        unlockPolicy(mgmt);
+        return;
+    }
+    RefBatch *batch = &mgmt->refBatches[myShard()];
+    pthread_mutex_lock(&batch->latch);
+    batch->refs[batch->count] = ref;
+    ATOMIC_WRITE(batch->count, batch->count + 1);
+    if (batch->count >= 2 * mgmt->refBatchSize) {
+        pthread_mutex_lock(&mgmt->policyLatch);
+        applyBatch(mgmt, batch);
+    } else if (batch->count >= mgmt->refBatchSize && pthread_mutex_trylock(&mgmt->policyLatch) == 0) {
+        applyBatch(mgmt, batch);
+    }
+    pthread_mutex_unlock(&batch->latch);
+}
+
+
+// Frame ownership helpers
+
+// Drop one pin. used tells whether a client reference to the page ended, as
+// opposed to a pin the pool took for itself (write back, eviction).
+static void unpinFrame(BM_PoolMgmt *mgmt, PageFrame *frame, bool used) {
+    __atomic_sub_fetch(&FIX_COUNT(mgmt, frame), 1, __ATOMIC_RELEASE);
+    if (mgmt->recencyList)
+        updateRecency(mgmt, frame, used);
+}
+
+// Wait until a concurrent read of the frame's page has finished
+static RC waitForLoad(BM_PoolMgmt *mgmt, PageFrame *frame) {
+    // An asynchronous read finishes once somebody polls the engine
+    while (__atomic_load_n(&frame->ioInProgress, __ATOMIC_ACQUIRE))
+        if (!mgmt->asyncIO || pollAsyncIO(&mgmt->engine, 0) == 0)
+            sched_yield();
+    return ATOMIC_READ(frame->ioError) ? RC_ERROR : RC_OK;
+}
+
+// Page latches of pinPageShared and pinPageExclusive. A latch word counts its
+// shared holders, or has LATCH_EXCLUSIVE set while a writer holds it. Readers
+// take the latch with a single atomic add and never wait for each other; a
+// writer that finds readers sets LATCH_WAITING, which keeps new readers out
+// until it had its turn. Latches are only held on pinned frames, so a latched
+// frame is never replaced, and unpinPage releases the latch before the pin.
+static void latchShared(int *word) {
+    while (true) {
+        if ((__atomic_add_fetch(word, 1, __ATOMIC_ACQUIRE) & (LATCH_EXCLUSIVE | LATCH_WAITING)) == 0)
+            return;
+        // Back out and let the writer go first
+        __atomic_sub_fetch(word, 1, __ATOMIC_RELAXED);
+        while (__atomic_load_n(word, __ATOMIC_RELAXED) & (LATCH_EXCLUSIVE | LATCH_WAITING))
+            sched_yield();
+    }
+}
+
+static void latchExclusive(int *word) {
+    int w = __atomic_load_n(word, __ATOMIC_RELAXED);
+
+    while (true) {
+        // Free apart from waiting writers, which includes this one
+        if ((w & (LATCH_EXCLUSIVE | LATCH_READERS)) == 0) {
+            if (__atomic_compare_exchange_n(word, &w, LATCH_EXCLUSIVE, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                return;
+            continue;
+        }
+        if ((w & LATCH_WAITING) == 0)
+            __atomic_fetch_or(word, LATCH_WAITING, __ATOMIC_RELAXED);
+        sched_yield();
+        w = __atomic_load_n(word, __ATOMIC_RELAXED);
+    }
+}
+
+// The page latches the calling thread holds, one entry per latch taken. The
+// latch word does not say who holds it, so without this a thread that wants
+// the exclusive latch of a page it already latched would wait for itself
+// forever, and so would a second shared latch once a writer waits behind the
+// first. Latches past the first MAX_HELD_LATCHES a thread holds at once are
+// not recorded, and their re-entry is not caught.
+typedef struct HeldLatch {
+    const int *word;
+    BM_LatchMode mode;
+} HeldLatch;
+
+static __thread HeldLatch heldLatches[MAX_HELD_LATCHES];
+static __thread int numHeldLatches;
+
+// The mode the calling thread holds the latch in, BM_LATCH_NONE if it does not
+static BM_LatchMode heldMode(const int *word) {
+    for (int i = 0; i < numHeldLatches; i++)
+        if (heldLatches[i].word == word)
+            return heldLatches[i].mode;
+    return BM_LATCH_NONE;
+}
+
+static void rememberLatch(const int *word, BM_LatchMode mode) {
+    if (numHeldLatches < MAX_HELD_LATCHES)
+        heldLatches[numHeldLatches++] = (HeldLatch){.word = word, .mode = mode};
+}
+
+static void forgetLatch(const int *word) {
+    for (int i = 0; i < numHeldLatches; i++)
+        if (heldLatches[i].word == word) {
+            heldLatches[i] = heldLatches[--numHeldLatches];
+            return;
+        }
+}
+
+static void unlatch(int *word, BM_LatchMode mode) {
+    // Readers backing out of an exclusive latch may have left their count in
+    // the word for a moment, so the writer only clears its own bit
+    if (mode == BM_LATCH_EXCLUSIVE)
+        __atomic_fetch_and(word, ~LATCH_EXCLUSIVE, __ATOMIC_RELEASE);
+    else
+        __atomic_sub_fetch(word, 1, __ATOMIC_RELEASE);
+}
+
+// Frame versions for optimistic reads (see startOptimisticRead): a frame's
+// version is odd while its page is being replaced or changed under the
+// exclusive latch, and every change moves it on. The full barrier orders the
+// bump before the writes to the page that follow it.
+static void bumpVersion(BM_PoolMgmt *mgmt, int frameIdx, int by) {
+    __atomic_add_fetch(&mgmt->versions[frameIdx], by, __ATOMIC_SEQ_CST);
+}
+
+// The frame a handle from pinPage points into, -1 if it points elsewhere
+static int handleFrame(const BM_PoolMgmt *mgmt, const BM_PageHandle *page) {
+    uintptr_t offset = (uintptr_t)page->data - (uintptr_t)mgmt->arena;
+
+    return offset < mgmt->arenaSize ? (int)(offset / PAGE_SIZE) : -1;
+}
+
+// Whether the handle's latch field is backed by its frame: the handle points
+// into frameIdx and the latch word is held in that mode. Callers may fill a
+// handle themselves or reuse one for another page, so the field alone proves
+// nothing.
+static bool holdsLatch(const BM_PoolMgmt *mgmt, const BM_PageHandle *page, int frameIdx) {
+    if (frameIdx == -1 || page->latch == BM_LATCH_NONE || handleFrame(mgmt, page) != frameIdx)
+        return false;
+    int word = ATOMIC_READ(mgmt->pageLatches[frameIdx]);
+    if (page->latch == BM_LATCH_EXCLUSIVE)
+        return (word & LATCH_EXCLUSIVE) != 0;
+    return page->latch == BM_LATCH_SHARED && (word & LATCH_READERS) != 0;
+}
+
+// Take an unpinned frame out of circulation so its page can be replaced.
+// On success the frame is pinned once by the caller, clean and no longer in
+// the page table, and evicted tells which page it held. A dirty page is
+// written back while it is still mapped, so nobody can read a stale copy of
+// it from disk in between; sync tells whether a pin waits for that write.
+static bool claimFrame(BM_PoolMgmt *mgmt, int frameIdx, bool sync, PageNumber *evicted) {
+    PageFrame *frame = &mgmt->frames[frameIdx];
+    PageNumber oldPage = ATOMIC_READ(frame->pageNum);
+
+    *evicted = NO_PAGE;
+    // A frame without a page is not in the page table, pinning it is enough
+    if (oldPage == NO_PAGE) {
+        int expected = 0;
+        if (!__atomic_compare_exchange_n(&FIX_COUNT(mgmt, frame), &expected, 1, false,
+                                         __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return false;
+        bumpVersion(mgmt, frameIdx, 1); // Even again once publishFrame() maps the next page
+        return true;
+    }
+
+    // The page may have been replaced since the search looked at the frame
+    lockPartition(mgmt, oldPage);
+    if (ATOMIC_READ(frame->pageNum) != oldPage || ATOMIC_READ(FIX_COUNT(mgmt, frame)) != 0) {
+        unlockPartition(mgmt, oldPage);
+        return false;
+    }
+    ATOMIC_WRITE(FIX_COUNT(mgmt, frame), 1);
+
+    if (ATOMIC_READ(DIRTY_BIT(mgmt, frame))) {
+        unlockPartition(mgmt, oldPage);
+        RC rc = writeBackPage(mgmt, frame);
+        if (rc == RC_OK)
+            ATOMIC_ADD(*(sync ? &mgmt->syncWriteCount : &mgmt->prefetchWriteCount), 1);
+        // The background writer is falling behind, wake it up early
+        if (mgmt->writerRunning)
+            pthread_cond_signal(&mgmt->writerWake);
+        lockPartition(mgmt, oldPage);
+
+        // Somebody pinned or dirtied the page while it was written, leave it alone
+        if (rc != RC_OK || ATOMIC_READ(FIX_COUNT(mgmt, frame)) != 1 || ATOMIC_READ(DIRTY_BIT(mgmt, frame))) {
+            unlockPartition(mgmt, oldPage);
+            unpinFrame(mgmt, frame, false);
+            return false;
+        }
+    }
+
+    // Optimistic readers of the old page see the version change from here on
+    bumpVersion(mgmt, frameIdx, 1);
+    removeFrame(mgmt, frameIdx);
+    ATOMIC_WRITE(frame->pageNum, NO_PAGE);
+    unlockPartition(mgmt, oldPage);
+    *evicted = oldPage;
+    return true;
+}
+
+// Pin the frame for a write if its page is dirty and unpinned, so it cannot
+// be replaced meanwhile. Returns whether the frame was claimed.
+static bool claimDirtyFrame(BM_PoolMgmt *mgmt, int frameIdx) {
+    PageFrame *frame = &mgmt->frames[frameIdx];
+    PageNumber pageNum = ATOMIC_READ(frame->pageNum);
+
+    if (pageNum == NO_PAGE || ATOMIC_READ(FIX_COUNT(mgmt, frame)) != 0 || ATOMIC_READ(DIRTY_BIT(mgmt, frame)) == 0)
+        return false;
+
+    lockPartition(mgmt, pageNum);
+    bool stillDirty = ATOMIC_READ(frame->pageNum) == pageNum && ATOMIC_READ(FIX_COUNT(mgmt, frame)) == 0 &&
+                      ATOMIC_READ(DIRTY_BIT(mgmt, frame)) == 1;
+    if (stillDirty)
+        ATOMIC_ADD(FIX_COUNT(mgmt, frame), 1);
+    unlockPartition(mgmt, pageNum);
+    return stillDirty;
+}
+
+// Write back the frame's page if it is dirty and unpinned. Returns whether it was written.
+static bool cleanFrame(BM_PoolMgmt *mgmt, int frameIdx) {
+    PageFrame *frame = &mgmt->frames[frameIdx];
+
+    if (!claimDirtyFrame(mgmt, frameIdx))
+        return false;
+
+    // A successful write clears the dirty bit
+    RC rc = writeBackPage(mgmt, frame);
+    unpinFrame(mgmt, frame, false);
+    return rc == RC_OK;
+}
+
+// Put a frame at the cold end of the replacement strategy, first in line to
+// be replaced and without credit for any reference: a CLOCK counter of 0, the
+// LFU count 0 bucket, the ARC free list and no LRU-K history. The LRU list is
+// updated when the frame is unpinned.
+static void parkFrame(BM_PoolMgmt *mgmt, PageFrame *frame) {
+    int frameIdx = frame - mgmt->frames;
+
+    ATOMIC_WRITE(HIT_NUM(mgmt, frame), 0);
+    if (mgmt->freqBuckets)
+        releaseLFU(mgmt, frameIdx);
+    else if (mgmt->adaptive)
+        releaseARC(mgmt, frameIdx);
+    else
+        ATOMIC_WRITE(frame->refNum, 0);
+    if (mgmt->lrukHist != NULL) {
+        lockPolicy(mgmt);
+        memset(&mgmt->lrukHist[frameIdx * mgmt->lrukK], 0, sizeof(int) * mgmt->lrukK);
+        mgmt->lrukLast[frameIdx] = 0;
+        unlockPolicy(mgmt);
+    }
+}
+
+// Hand a claimed frame that ended up unused back to the replacement strategies
+static void releaseFrame(BM_PoolMgmt *mgmt, PageFrame *frame) {
+    parkFrame(mgmt, frame);
+    unpinFrame(mgmt, frame, false);
+}
+
+// Undo a failed read: unmap the page and wake up the pins waiting on it
+static void failLoad(BM_PoolMgmt *mgmt, int frameIdx) {
+    PageFrame *frame = &mgmt->frames[frameIdx];
+    PageNumber pageNum = frame->pageNum;
+
+    lockPartition(mgmt, pageNum);
+    removeFrame(mgmt, frameIdx);
+    ATOMIC_WRITE(frame->pageNum, NO_PAGE);
+    ATOMIC_WRITE(frame->ioError, 1);
+    bumpVersion(mgmt, frameIdx, 2); // The frame never held valid data
+    __atomic_store_n(&frame->ioInProgress, 0, __ATOMIC_RELEASE);
+    unlockPartition(mgmt, pageNum);
+    releaseFrame(mgmt, frame);
+}
+
+
+// Frame scans. The victim searches and forceFlushPool look for the next
+// unpinned, or unpinned and dirty, frame in the per-field arrays. The SIMD
+// kernels test 4 (SSE2) or 8 (AVX2) frames per instruction. Their plain
+// vector loads of counters other threads update atomically are no worse than
+// the relaxed reads they replace: whatever they find is only a candidate,
+// validated under its partition latch afterwards.
+
+static int scanScalar(const int *fixCounts, const int *dirtyBits, int from, int to) {
+    for (int i = from; i < to; i++)
+        if (ATOMIC_READ(fixCounts[i]) == 0 && (dirtyBits == NULL || ATOMIC_READ(dirtyBits[i]) != 0))
+            return i;
+    return to;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse2")))
+static int scanSSE2(const int *fixCounts, const int *dirtyBits, int from, int to) {
+    const __m128i zero = _mm_setzero_si128();
+    int i = from;
+
+    for (; i + 4 <= to; i += 4) {
+        __m128i match = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(fixCounts + i)), zero);
+        if (dirtyBits != NULL)
+            match = _mm_andnot_si128(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(dirtyBits + i)), zero), match);
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(match));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+    return scanScalar(fixCounts, dirtyBits, i, to);
+}
+
+__attribute__((target("avx2")))
+static int scanAVX2(const int *fixCounts, const int *dirtyBits, int from, int to) {
+    const __m256i zero = _mm256_setzero_si256();
+    int i = from;
+
+    for (; i + 8 <= to; i += 8) {
+        __m256i match = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(fixCounts + i)), zero);
+        if (dirtyBits != NULL)
+            match = _mm256_andnot_si256(_mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(dirtyBits + i)), zero),
+                                        match);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(match));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+    return scanScalar(fixCounts, dirtyBits, i, to);
+}
+#endif
+
+// The widest kernel the CPU supports. BM_SCAN_KERNEL=scalar, sse2 or avx2
+// in the environment caps it, to compare them.
+static FrameScan pickFrameScan(void) {
+    const char *cap = getenv("BM_SCAN_KERNEL");
+
+    if (cap != NULL && strcmp(cap, "scalar") == 0)
+        return scanScalar;
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if ((cap == NULL || strcmp(cap, "avx2") == 0) && __builtin_cpu_supports("avx2"))
+        return scanAVX2;
+    return scanSSE2;
+#else
+    return scanScalar;
+#endif
+}
+
+// The first unpinned frame at or after from, wrapping around once; -1 if all are pinned
+static int nextUnpinned(BM_PoolMgmt *mgmt, int from) {
+    int idx = mgmt->scanFrames(mgmt->fixCounts, NULL, from, mgmt->bufferSize);
+
+    if (idx < mgmt->bufferSize)
+        return idx;
+    idx = mgmt->scanFrames(mgmt->fixCounts, NULL, 0, from);
+    return idx < from ? idx : -1;
+}
+
+
+// Replacement strategies. Each one only picks a candidate frame that looks
+// unpinned, or -1 when every frame is pinned. The search reads the frames
+// without any pool-wide latch; claimFrame() then validates the candidate
+// under its partition latch, and the search is repeated if that fails.
+
+extern int FIFO(BM_BufferPool *const bp) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bp->mgmtData;
+
+    // The first unpinned frame in load order, starting at the slot after the
+    // most recent fill, is the one to replace; -1 when all are pinned
+    return nextUnpinned(mgmt, (ATOMIC_READ(mgmt->rearIndex) + 1) % mgmt->bufferSize);
+}
+
+
+// The oldest unpinned frame with the lowest reference count. Buckets are
+// visited from the lowest count up, so only pinned frames are ever skipped.
+extern int LFU(BM_BufferPool *const bp) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bp->mgmtData;
+    int victim = -1;
+
+    lockPolicy(mgmt);
+    for (int b = mgmt->lfuLowest; b != -1 && victim == -1; b = mgmt->lfuBuckets[b].next) {
+        for (int idx = mgmt->lfuBuckets[b].head; idx != -1; idx = mgmt->frames[idx].lfuNext) {
+            if (ATOMIC_READ(mgmt->fixCounts[idx]) == 0) {
+                victim = idx;
+                break;
+            }
+        }
+    }
+    unlockPolicy(mgmt);
+    return victim; // -1 when every frame is pinned
+}
+
+
+// O(1) in the common case: the victim is the tail of the recency list. Frames
+// pinned since they were put on the list are unlinked on the way.
+extern int LRU(BM_BufferPool *const bufferPool) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bufferPool->mgmtData;
+    int lruIndex;
+
+    lockPolicy(mgmt);
+    lruIndex = mgmt->lists[LRU_LIST].tail;
+    while (lruIndex != -1 && ATOMIC_READ(mgmt->fixCounts[lruIndex]) != 0) {
+        int prev = mgmt->frames[lruIndex].listPrev;
+        listRemove(mgmt, lruIndex); // Its unpin puts it back
+        lruIndex = prev;
+    }
+    unlockPolicy(mgmt);
+    return lruIndex; // -1 when every used frame is pinned
+}
+
+
+
+// CLOCK and GCLOCK. The hand only moves here: an unpinned frame whose
+// counter is zero is the victim, any other unpinned frame loses one from its
+// counter and is passed. With CLOCK the counter is a reference bit, so one
+// turn of the hand clears every bit; GCLOCK needs at most clockMax turns.
+// Pinned frames are passed untouched, and a whole turn over nothing but
+// pinned frames ends the search at once.
+extern int CLOCK(BM_BufferPool *const bp) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bp->mgmtData;
+    // One extra turn covers frames that other threads use during the search
+    int maxSteps = (mgmt->clockMax + 2) * mgmt->bufferSize;
+
+    for (int step = 0; step < maxSteps; step++) {
+        // Move the hand on and keep it within the buffer range
+        int hand = __atomic_fetch_add(&mgmt->clockPointer, 1, __ATOMIC_RELAXED) % mgmt->bufferSize;
+
+        // Pass a run of pinned frames in one go
+        if (ATOMIC_READ(mgmt->fixCounts[hand]) != 0) {
+            int next = nextUnpinned(mgmt, hand);
+            if (next == -1)
+                return -1; // Nothing can be evicted
+            int skipped = (next - hand + mgmt->bufferSize) % mgmt->bufferSize;
+            __atomic_fetch_add(&mgmt->clockPointer, skipped, __ATOMIC_RELAXED);
+            hand = next;
+        }
+
+        int count = ATOMIC_READ(mgmt->hitNums[hand]);
+        if (count == 0)
+            return hand;
+        ATOMIC_WRITE(mgmt->hitNums[hand], count - 1); // Second chance
+    }
+    return -1;
+}
+
+static unsigned int historySlot(const BM_PoolMgmt *mgmt, PageNumber pageNum) {
+    return ((unsigned int)pageNum * 2654435769u) & mgmt->lrukHistoryMask;
+}
+
+
+// LRU-K (O'Neil et al.): replace the page whose K-th most recent reference is
+// the oldest. Pages with fewer than K references have an infinite backward
+// distance and go first, least recently used first, so a page touched once by
+// a scan never pushes out a page that is referenced over and over. Frames
+// referenced within the correlated reference period are not eligible; if all
+// unpinned frames are that young the oldest of them is taken anyway.
+extern int LRU_K(BM_BufferPool *const bp) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bp->mgmtData;
+    int k = mgmt->lrukK;
+    int now = ATOMIC_READ(mgmt->hit) + 2; // time of the reference that needs the frame
+    int victim = -1, victimKth = INT_MAX, victimLast = INT_MAX;
+    int young = -1, youngKth = INT_MAX, youngLast = INT_MAX;
+
+    lockPolicy(mgmt);
+    for (int idx = mgmt->scanFrames(mgmt->fixCounts, NULL, 0, mgmt->bufferSize); idx < mgmt->bufferSize;
+         idx = mgmt->scanFrames(mgmt->fixCounts, NULL, idx + 1, mgmt->bufferSize)) {
+        int kth = mgmt->lrukHist[idx * k + k - 1];
+        int last = mgmt->lrukHist[idx * k];
+
+        // Compare by K-th reference first and by the most recent one among equals
+        if (now - mgmt->lrukLast[idx] > mgmt->lrukPeriod) {
+            if (kth < victimKth || (kth == victimKth && last < victimLast)) {
+                victim = idx;
+                victimKth = kth;
+                victimLast = last;
+            }
+        } else if (kth < youngKth || (kth == youngKth && last < youngLast)) {
+            young = idx;
+            youngKth = kth;
+            youngLast = last;
+        }
+    }
+    unlockPolicy(mgmt);
+    return victim != -1 ? victim : young;
+}
+
+// A page is referenced again while buffered. A queued reference older than
+// the frame's last one, from another thread's batch or from before the page
+// was read in again, is dropped.
+static void applyLRUK(BM_PoolMgmt *mgmt, const Reference *ref) {
+    int frameIdx = ref->frame, now = ref->stamp;
+    int *hist = &mgmt->lrukHist[frameIdx * mgmt->lrukK];
+
+    if (mgmt->lrukOwner[frameIdx] != ref->pageNum || now < mgmt->lrukLast[frameIdx])
+        return;
+    if (now - mgmt->lrukLast[frameIdx] > mgmt->lrukPeriod) {
+        // A new, uncorrelated reference. The correlated burst that ended with
+        // the last reference counts as a single reference at its start, so the
+        // older references are shifted by the length of that burst.
+        int burst = mgmt->lrukLast[frameIdx] - hist[0];
+        for (int i = mgmt->lrukK - 1; i > 0; i--)
+            hist[i] = hist[i - 1] != 0 ? hist[i - 1] + burst : 0;
+        hist[0] = now;
+    }
+    mgmt->lrukLast[frameIdx] = now;
+}
+
+// A claimed frame gives up its page: retain the page's reference history
+static void evictLRUK(BM_PoolMgmt *mgmt, int frameIdx) {
+    PageNumber owner = mgmt->lrukOwner[frameIdx];
+
+    lockPolicy(mgmt);
+    if (owner != NO_PAGE) {
+        unsigned int slot = historySlot(mgmt, owner);
+        mgmt->lrukHistoryPages[slot] = owner;
+        memcpy(&mgmt->lrukHistoryTimes[slot * mgmt->lrukK], &mgmt->lrukHist[frameIdx * mgmt->lrukK],
+               sizeof(int) * mgmt->lrukK);
+        mgmt->lrukOwner[frameIdx] = NO_PAGE;
+    }
+    unlockPolicy(mgmt);
+}
+
+// A page was read into a frame: continue its retained history, if any
+static void loadLRUK(BM_PoolMgmt *mgmt, int frameIdx, PageNumber pageNum, int now) {
+    int *hist = &mgmt->lrukHist[frameIdx * mgmt->lrukK];
+    unsigned int slot = historySlot(mgmt, pageNum);
+
+    lockPolicy(mgmt);
+    if (mgmt->lrukHistoryPages[slot] == pageNum) {
+        int *old = &mgmt->lrukHistoryTimes[slot * mgmt->lrukK];
+        for (int i = mgmt->lrukK - 1; i > 0; i--)
+            hist[i] = old[i - 1];
+        mgmt->lrukHistoryPages[slot] = NO_PAGE;
+    } else {
+        memset(hist, 0, sizeof(int) * mgmt->lrukK);
+    }
+    hist[0] = now;
+    mgmt->lrukLast[frameIdx] = now;
+    mgmt->lrukOwner[frameIdx] = pageNum;
+    unlockPolicy(mgmt);
+}
+
+// ARC (Megiddo and Modha): T1 holds pages referenced once recently, T2 pages
+// referenced at least twice. Evicted pages are remembered on the ghost lists
+// B1 and B2. A miss on a page in B1 means T1 was too small and grows its
+// target size p, a miss on a page in B2 shrinks it, so the pool keeps
+// balancing recency against frequency without any tuning.
+
+static unsigned int ghostSlot(const BM_PoolMgmt *mgmt, PageNumber pageNum) {
+    return ((unsigned int)pageNum * 2654435769u) >> mgmt->ghostShift;
+}
+
+// Callers of the ghost helpers hold the policy latch
+static int ghostLookup(const BM_PoolMgmt *mgmt, PageNumber pageNum) {
+    int g = mgmt->ghostBuckets[ghostSlot(mgmt, pageNum)];
+
+    while (g != -1 && mgmt->ghosts[g].pageNum != pageNum)
+        g = mgmt->ghosts[g].hashNext;
+    return g;
+}
+
+static void ghostRemove(BM_PoolMgmt *mgmt, int g) {
+    GhostEntry *entry = &mgmt->ghosts[g];
+    FrameList *list = &mgmt->ghostLists[entry->listId];
+    int *link = &mgmt->ghostBuckets[ghostSlot(mgmt, entry->pageNum)];
+
+    while (*link != g)
+        link = &mgmt->ghosts[*link].hashNext;
+    *link = entry->hashNext;
+
+    if (entry->prev != -1)
+        mgmt->ghosts[entry->prev].next = entry->next;
+    else
+        list->head = entry->next;
+    if (entry->next != -1)
+        mgmt->ghosts[entry->next].prev = entry->prev;
+    else
+        list->tail = entry->prev;
+    list->size--;
+
+    entry->next = mgmt->freeGhost;
+    mgmt->freeGhost = g;
+}
+
+// Forget the least recently evicted page of a ghost list
+static void ghostTrim(BM_PoolMgmt *mgmt, int listId) {
+    if (mgmt->ghostLists[listId].tail != -1)
+        ghostRemove(mgmt, mgmt->ghostLists[listId].tail);
+}
+
+static void ghostAdd(BM_PoolMgmt *mgmt, int listId, PageNumber pageNum) {
+    FrameList *list = &mgmt->ghostLists[listId];
+
+    // loadARC() keeps the directory within its bounds, this is only a safety net
+    if (mgmt->freeGhost == -1)
+        ghostTrim(mgmt, mgmt->ghostLists[ARC_T1].size > list->size ? ARC_T1 : listId);
+    if (mgmt->freeGhost == -1)
+        return;
+
+    int g = mgmt->freeGhost;
+    GhostEntry *entry = &mgmt->ghosts[g];
+    unsigned int slot = ghostSlot(mgmt, pageNum);
+
+    mgmt->freeGhost = entry->next;
+    *entry = (GhostEntry){.pageNum = pageNum, .listId = listId, .prev = -1, .next = list->head,
+                          .hashNext = mgmt->ghostBuckets[slot]};
+    mgmt->ghostBuckets[slot] = g;
+    if (list->head != -1)
+        mgmt->ghosts[list->head].prev = g;
+    else
+        list->tail = g;
+    list->head = g;
+    list->size++;
+}
+
+// The least recently used unpinned frame of a list, -1 if there is none
+static int oldestUnpinned(BM_PoolMgmt *mgmt, int listId) {
+    int idx = mgmt->lists[listId].tail;
+
+    while (idx != -1 && ATOMIC_READ(mgmt->fixCounts[idx]) != 0)
+        idx = mgmt->frames[idx].listPrev;
+    return idx;
+}
+
+// Adapt p to a miss on pageNum
+static void adaptARC(BM_PoolMgmt *mgmt, PageNumber pageNum) {
+    lockPolicy(mgmt);
+    int g = ghostLookup(mgmt, pageNum);
+    if (g != -1) {
+        int b1 = mgmt->ghostLists[ARC_T1].size;
+        int b2 = mgmt->ghostLists[ARC_T2].size;
+
+        if (mgmt->ghosts[g].listId == ARC_T1)
+            mgmt->arcTarget = MIN(mgmt->bufferSize, mgmt->arcTarget + MAX(b2 / b1, 1));
+        else
+            mgmt->arcTarget = MAX(0, mgmt->arcTarget - MAX(b1 / b2, 1));
+    }
+    unlockPolicy(mgmt);
+}
+
+// REPLACE: evict from T1 while it is larger than its target, otherwise from
+// T2. Frames without a page are reused first.
+extern int ARC(BM_BufferPool *const bp, PageNumber pageNum) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bp->mgmtData;
+    int victim;
+
+    lockPolicy(mgmt);
+    victim = oldestUnpinned(mgmt, ARC_FREE);
+    if (victim == -1) {
+        int g = ghostLookup(mgmt, pageNum);
+        int t1 = mgmt->lists[ARC_T1].size;
+        bool inB2 = g != -1 && mgmt->ghosts[g].listId == ARC_T2;
+        int first = t1 > 0 && (t1 > mgmt->arcTarget || (inB2 && t1 == mgmt->arcTarget)) ? ARC_T1 : ARC_T2;
+
+        victim = oldestUnpinned(mgmt, first);
+        if (victim == -1)
+            victim = oldestUnpinned(mgmt, first == ARC_T1 ? ARC_T2 : ARC_T1); // All of that list is pinned
+    }
+    unlockPolicy(mgmt);
+    return victim;
+}
+
+// A hit moves the page to the most recent end of T2
+static void applyARC(BM_PoolMgmt *mgmt, const Reference *ref) {
+    if (mgmt->frames[ref->frame].listId != NO_LIST && ATOMIC_READ(mgmt->frames[ref->frame].pageNum) == ref->pageNum) {
+        listRemove(mgmt, ref->frame);
+        listPush(mgmt, ARC_T2, ref->frame, true);
+    }
+}
+
+// A page read back in after it was evicted recently goes to T2, any other to T1
+static void loadARC(BM_PoolMgmt *mgmt, int frameIdx, PageNumber pageNum) {
+    lockPolicy(mgmt);
+    int g = ghostLookup(mgmt, pageNum);
+    listRemove(mgmt, frameIdx);
+    if (g != -1) {
+        ghostRemove(mgmt, g);
+        listPush(mgmt, ARC_T2, frameIdx, true);
+    } else {
+        // A new page: keep |T1| + |B1| <= c and the whole directory within 2c
+        int c = mgmt->bufferSize;
+        int t1b1 = mgmt->lists[ARC_T1].size + mgmt->ghostLists[ARC_T1].size;
+
+        if (t1b1 >= c)
+            ghostTrim(mgmt, ARC_T1);
+        else if (t1b1 + mgmt->lists[ARC_T2].size + mgmt->ghostLists[ARC_T2].size >= 2 * c)
+            ghostTrim(mgmt, ARC_T2);
+        listPush(mgmt, ARC_T1, frameIdx, true);
+    }
+    unlockPolicy(mgmt);
+}
+
+// A claimed frame gives up its page, which is remembered on B1 or B2
+static void evictARC(BM_PoolMgmt *mgmt, int frameIdx, PageNumber evicted) {
+    lockPolicy(mgmt);
+    int listId = mgmt->frames[frameIdx].listId;
+    listRemove(mgmt, frameIdx);
+    if (evicted != NO_PAGE && (listId == ARC_T1 || listId == ARC_T2))
+        ghostAdd(mgmt, listId, evicted);
+    unlockPolicy(mgmt);
+}
 
-typedef struct Page {
-    SM_PageHandle data;
-    PageNumber pageNum;
-    int dirtyBit;
-    int fixCount;
-    int hitNum;
-    int refNum;
-} PageFrame;
+static int chooseVictim(BM_BufferPool *const bm, PageNumber pageNum) {
+    // Apply the replacement algorithm based on the strategy
+    if (bm->strategy == RS_FIFO)
+        return FIFO(bm);
+    else if (bm->strategy == RS_LRU)
+        return LRU(bm);
+    else if (bm->strategy == RS_CLOCK || bm->strategy == RS_GCLOCK)
+        return CLOCK(bm);
+    else if (bm->strategy == RS_LFU)
+        return LFU(bm);
+    else if (bm->strategy == RS_LRU_K)
+        return LRU_K(bm);
+    else if (bm->strategy == RS_ARC)
+        return ARC(bm, pageNum);
+    else
+        printf("\nAlgorithm Not Implemented\n");
+    return -1;
+}
+
+// Strategy bookkeeping when a buffered page is pinned again
+static void touchFrame(BM_BufferPool *const bm, PageFrame *frame) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    int stamp = ATOMIC_ADD(mgmt->hit, 1);
+
+    if (bm->strategy == RS_CLOCK || bm->strategy == RS_GCLOCK) {
+        // Only write when the counter changes, a hot frame's line stays clean
+        int count = ATOMIC_READ(HIT_NUM(mgmt, frame));
+        if (count < mgmt->clockMax)
+            ATOMIC_WRITE(HIT_NUM(mgmt, frame), count + 1);
+    } else if (bm->strategy == RS_LFU || bm->strategy == RS_LRU_K || bm->strategy == RS_ARC)
+        referenceFrame(mgmt, frame - mgmt->frames, frame->pageNum, stamp + 1);
+}
 
-int bufferSize = 0;
-int rearIndex = 0;
-int writeCount = 0;
-int hit = 0;
-int clockPointer = 0;
-int lfuPtr = 0;
+// Strategy bookkeeping when a page enters the pool as a new page
+static void admitFrame(BM_BufferPool *const bm, PageFrame *frame) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    int stamp = ATOMIC_ADD(mgmt->hit, 1);
+
+    if (bm->strategy == RS_CLOCK || bm->strategy == RS_GCLOCK)
+        ATOMIC_WRITE(HIT_NUM(mgmt, frame), mgmt->clockInitial);
+    else if (bm->strategy == RS_LFU)
+        loadLFU(mgmt, frame - mgmt->frames);
+    else if (bm->strategy == RS_LRU_K)
+        loadLRUK(mgmt, frame - mgmt->frames, frame->pageNum, stamp + 1);
+    else if (bm->strategy == RS_ARC)
+        loadARC(mgmt, frame - mgmt->frames, frame->pageNum);
+}
 
+// Strategy bookkeeping when a page has been read into a frame
+static void loadedFrame(BM_BufferPool *const bm, PageFrame *frame) {
+    ATOMIC_ADD(((BM_PoolMgmt *)bm->mgmtData)->rearIndex, 1);
+    COUNT((BM_PoolMgmt *)bm->mgmtData, reads, 1);
+    admitFrame(bm, frame);
+}
 
-// Function implementations
+// Strategy bookkeeping when a claimed frame's page, if any, has left the pool
+static void evictedFrame(BM_BufferPool *const bm, int frameIdx, PageNumber evicted) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+
+    if (bm->strategy == RS_LRU_K)
+        evictLRUK(mgmt, frameIdx);
+    else if (bm->strategy == RS_LFU)
+        evictLFU(mgmt, frameIdx);
+    else if (bm->strategy == RS_ARC)
+        evictARC(mgmt, frameIdx, evicted);
+    ATOMIC_WRITE(mgmt->frames[frameIdx].ioError, 0);
+    ATOMIC_WRITE(mgmt->frames[frameIdx].prefetched, 0);
+    ATOMIC_WRITE(mgmt->frames[frameIdx].ringOwner, 0);
+}
 
-extern void FIFO(BM_BufferPool *const bp, PageFrame *tgtPg) {
-    PageFrame *frames = (PageFrame *)bp->mgmtData;
-    int isReplaced = 0, currentIndex;
-    currentIndex = rearIndex % bufferSize; // Assuming rearIndex and bufferSize are declared elsewhere
-    int trialCount = 0; // To prevent infinite loops
-
-    while (!isReplaced && trialCount < bufferSize) {
-        int isEligible = (frames[currentIndex].fixCount == 0);
-        int requiresFlush = (frames[currentIndex].dirtyBit == 1) && isEligible;
-
-        // Flush the frame to disk if it's dirty
-        if (requiresFlush) {
-            SM_FileHandle fh;
-            if (openPageFile(bp->pageFile, &fh) == RC_OK &&
-                writeBlock(frames[currentIndex].pageNum, &fh, frames[currentIndex].data) == RC_OK) {
-                writeCount++; // Assume writeCount is declared and used to track writes
-            }
+// Find a frame for pageNum, which is not buffered: unused frames first, then
+// a victim picked by the replacement strategy. The frame comes back pinned.
+static RC obtainFrame(BM_BufferPool *const bm, PageNumber pageNum, bool prefetch, int *frameIdx) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    int next = ATOMIC_READ(mgmt->numUsedFrames);
+    PageNumber evicted = NO_PAGE;
+
+    int victim = -1;
+
+    // ARC learns from misses on recently evicted pages before replacing one
+    if (bm->strategy == RS_ARC)
+        adaptARC(mgmt, pageNum);
+
+    // Frames are filled in slot order until the pool is full. An unused frame
+    // also looks like a free victim to other threads, so it is still claimed
+    // through its pin count.
+    while (victim == -1 && next < mgmt->bufferSize) {
+        if (__atomic_compare_exchange_n(&mgmt->numUsedFrames, &next, next + 1, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            if (claimFrame(mgmt, next, !prefetch, &evicted))
+                victim = next;
+            next = ATOMIC_READ(mgmt->numUsedFrames);
         }
+    }
 
-        // Replace the frame if eligible
-        if (isEligible) {
-            frames[currentIndex].data = tgtPg->data;
-            frames[currentIndex].pageNum = tgtPg->pageNum;
-            frames[currentIndex].dirtyBit = tgtPg->dirtyBit;
-            frames[currentIndex].fixCount = tgtPg->fixCount;
-            isReplaced = 1;
-        }
+    // Buffer is full: candidates can be taken by other threads between the
+    // search and the claim, so retry a bounded number of times
+    for (int attempt = 0; victim == -1 && attempt < 4 * mgmt->bufferSize; attempt++) {
+        int candidate = chooseVictim(bm, pageNum);
+        if (candidate == -1)
+            break;
+        if (claimFrame(mgmt, candidate, !prefetch, &evicted))
+            victim = candidate;
+    }
+    if (victim == -1)
+        return RC_NO_FREE_FRAME;
+
+    evictedFrame(bm, victim, evicted);
+    countEviction(mgmt, evicted, !prefetch);
+    *frameIdx = victim;
+    return RC_OK;
+}
 
-        // Move to the next frame in a circular manner
-        currentIndex = (currentIndex + 1) % bufferSize;
-        trialCount++;
+// Map pageNum to a claimed frame with the read still pending, unless another
+// thread mapped the page meanwhile; then the frame is released again
+static bool publishFrame(BM_PoolMgmt *mgmt, int frameIdx, PageNumber pageNum, bool prefetch) {
+    PageFrame *frame = &mgmt->frames[frameIdx];
+
+    lockPartition(mgmt, pageNum);
+    if (lookupFrame(mgmt, pageNum) != -1) {
+        unlockPartition(mgmt, pageNum);
+        bumpVersion(mgmt, frameIdx, 1);
+        releaseFrame(mgmt, frame);
+        return false;
     }
-    // Loop exits when a frame is replaced or all frames have been tried
+    // An optimistic reader that finds the page here waits for the read
+    ATOMIC_WRITE(frame->ioInProgress, 1);
+    ATOMIC_WRITE(frame->pageNum, pageNum);
+    ATOMIC_WRITE(frame->prefetched, prefetch);
+    bumpVersion(mgmt, frameIdx, 1);
+    insertFrame(mgmt, frameIdx);
+    unlockPartition(mgmt, pageNum);
+    return true;
 }
 
+// Get a free or evicted frame for pageNum, which is not buffered, and map
+// the page to it with the read still pending. The mapping is published
+// before the read, so concurrent pins of the page wait for this read instead
+// of loading the page a second time. On success the frame comes back pinned,
+// or *frameIdx is -1 if another thread brought the page in meanwhile and the
+// caller should look it up again.
+static RC publishRead(BM_BufferPool *const bm, PageNumber pageNum, bool prefetch, int *frameIdx) {
+    RC rc = obtainFrame(bm, pageNum, prefetch, frameIdx);
+
+    if (rc == RC_OK && !publishFrame((BM_PoolMgmt *)bm->mgmtData, *frameIdx, pageNum, prefetch))
+        *frameIdx = -1;
+    return rc;
+}
+
+// The pending read of a published frame succeeded, let the waiting pins in
+static void finishRead(BM_BufferPool *const bm, PageFrame *frame) {
+    loadedFrame(bm, frame);
+    __atomic_store_n(&frame->ioInProgress, 0, __ATOMIC_RELEASE);
+}
 
-extern void LFU(BM_BufferPool *const bp, PageFrame *tgtPg) {
-    PageFrame *frames = (PageFrame *)bp->mgmtData;
-    int curIdx, nextIdx, minFreqIdx, minFreqVal;
-    minFreqIdx = lfuPtr; // Assuming lfuPtr is declared and initialized elsewhere
-    minFreqVal = INT_MAX; // Ensures any initial refCount is lower
-    curIdx = minFreqIdx;
+// Read pageNum, which is not buffered, into a frame; see publishRead()
+static RC readIntoFrame(BM_BufferPool *const bm, PageNumber pageNum, bool prefetch, int *frameIdx) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
 
-    // Attempt to find an initial page with zero fixCount
-    int tries = 0;
-    while (tries < bufferSize) {
-        nextIdx = (curIdx + tries) % bufferSize;
-        if (frames[nextIdx].fixCount == 0) {
-            minFreqIdx = nextIdx;
-            minFreqVal = frames[nextIdx].refNum; // Assuming refCount tracks frequency
-            break;
+    RC rc = publishRead(bm, pageNum, prefetch, frameIdx);
+    if (rc != RC_OK || *frameIdx == -1)
+        return rc;
+
+    rc = loadPage(mgmt, pageNum, mgmt->frames[*frameIdx].data);
+    if (rc != RC_OK) {
+        failLoad(mgmt, *frameIdx);
+        return rc;
+    }
+    finishRead(bm, &mgmt->frames[*frameIdx]);
+    return RC_OK;
+}
+
+
+// Sequential read-ahead
+
+// Fill the published frames of pages first .. first + n - 1, at most
+// MAX_IO_PAGES, with one vectored read. Pages read ahead are handed over to
+// the replacement strategy unpinned, the others stay pinned for the caller.
+// If the read fails every frame is given up.
+static void segmentRead(BM_PoolMgmt *mgmt, const int *frameIdx, int n, bool prefetch, RC rc) {
+    for (int k = 0; k < n; k++) {
+        if (rc != RC_OK) {
+            failLoad(mgmt, frameIdx[k]);
+            continue;
+        }
+        finishRead(mgmt->pool, &mgmt->frames[frameIdx[k]]);
+        if (prefetch) {
+            ATOMIC_ADD(mgmt->prefetchReadCount, 1);
+            unpinFrame(mgmt, &mgmt->frames[frameIdx[k]], true);
         }
-        tries++;
     }
+}
+
+static RC readSegment(BM_BufferPool *const bm, PageNumber first, const int *frameIdx, int n, bool prefetch) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    SM_PageHandle data[MAX_IO_PAGES];
+
+    if (n == 0)
+        return RC_OK;
+    for (int k = 0; k < n; k++)
+        data[k] = mgmt->frames[frameIdx[k]].data;
+
+    SM_FileHandle fh = ioHandle(mgmt);
+    RC rc = readBlocks(first, n, &fh, data);
+    segmentRead(mgmt, frameIdx, n, prefetch, rc);
+    return rc;
+}
+
+// A segment read through the asynchronous engine, finished by segmentDone()
+typedef struct AsyncSegment {
+    BM_PoolMgmt *mgmt;
+    const int *frameIdx;
+    int n;
+    bool prefetch;
+    RC rc;
+    int *pending;             // the caller's count of segments still in flight, NULL if nobody waits
+    int frame;                // frameIdx of a single page segment nobody waits for
+} AsyncSegment;
+
+static void segmentDone(RC rc, void *arg) {
+    AsyncSegment *segment = (AsyncSegment *)arg;
+    BM_PoolMgmt *mgmt = segment->mgmt;
+
+    segmentRead(mgmt, segment->frameIdx, segment->n, segment->prefetch, rc);
+    segment->rc = rc;
+    __atomic_sub_fetch(&mgmt->asyncReads, 1, __ATOMIC_RELEASE);
+    if (segment->pending != NULL)
+        __atomic_sub_fetch(segment->pending, 1, __ATOMIC_RELEASE);
+    else
+        free(segment);
+}
 
-    // Identify the least frequently used page
-    curIdx = (minFreqIdx + 1) % bufferSize;
-    int loopCount = 0;
-    while (loopCount < bufferSize) {
-        if (frames[curIdx].refNum < minFreqVal && frames[curIdx].fixCount == 0) {
-            minFreqIdx = curIdx;
-            minFreqVal = frames[curIdx].refNum;
+// Start reading a segment like readSegment() without waiting for it. If the
+// read cannot be submitted it is finished at once with the error.
+static RC submitSegment(BM_PoolMgmt *mgmt, PageNumber first, AsyncSegment *segment) {
+    SM_PageHandle data[MAX_IO_PAGES];
+
+    for (int k = 0; k < segment->n; k++)
+        data[k] = mgmt->frames[segment->frameIdx[k]].data;
+    ATOMIC_ADD(mgmt->asyncReads, 1);
+    if (segment->pending != NULL)
+        ATOMIC_ADD(*segment->pending, 1);
+    RC rc = readBlocksAsync(first, segment->n, &mgmt->engine, data, segmentDone, segment);
+    if (rc != RC_OK)
+        segmentDone(rc, segment);
+    return rc;
+}
+
+// Read pages first .. first + count - 1 into the pool with as few reads as
+// possible. Buffered pages split the run into segments; the frames come from
+// the normal victim search, and the run ends early when every frame is pinned.
+static void readRun(BM_BufferPool *const bm, PageNumber first, int count) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    int frameIdx[MAX_IO_PAGES];
+    PageNumber start = first;
+    int n = 0;
+
+    for (PageNumber p = first; p < first + count; p++) {
+        lockPartition(mgmt, p);
+        bool buffered = lookupFrame(mgmt, p) != -1;
+        unlockPartition(mgmt, p);
+
+        int i = -1;
+        RC rc = buffered ? RC_OK : publishRead(bm, p, true, &i);
+        if (i == -1) {
+            readSegment(bm, start, frameIdx, n, true);
+            start = p + 1;
+            n = 0;
+            if (rc != RC_OK)
+                return;
+            continue;
+        }
+        frameIdx[n++] = i;
+    }
+    readSegment(bm, start, frameIdx, n, true);
+}
+
+// Watch the pins for ascending runs of page numbers. Once a run is long
+// enough the pages ahead of it are read in windows that double while the run
+// goes on, like the OS read-ahead does. The next window is read when the scan
+// has used up half of the previous one, so it is in the pool before the scan
+// gets there.
+static void readAhead(BM_BufferPool *const bm, PageNumber pageNum) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PageNumber first = 0;
+    int count = 0;
+
+    // Concurrent pins that find another one updating the state skip it
+    if (mgmt->concurrent && pthread_mutex_trylock(&mgmt->readAheadLatch) != 0)
+        return;
+
+    if (pageNum != mgmt->raLast) {
+        if (pageNum == mgmt->raLast + 1) {
+            mgmt->raRun++;
+        } else {
+            mgmt->raRun = 1;
+            mgmt->raWindow = 0;
+            mgmt->raFrontier = pageNum + 1;
         }
-        curIdx = (curIdx + 1) % bufferSize;
-        loopCount++;
+        mgmt->raLast = pageNum;
     }
 
-    // If the chosen page is dirty, write its content to disk
-    if (frames[minFreqIdx].dirtyBit == 1) {
-        SM_FileHandle fh;
-        if (openPageFile(bp->pageFile, &fh) == RC_OK &&
-            writeBlock(frames[minFreqIdx].pageNum, &fh, frames[minFreqIdx].data) == RC_OK) {
-            writeCount++; // Increment write counter if write is successful
+    if (mgmt->raRun >= READ_AHEAD_TRIGGER) {
+        if (mgmt->raFrontier < pageNum)
+            mgmt->raFrontier = pageNum; // The scan overtook the read-ahead
+        if (mgmt->raFrontier - pageNum <= mgmt->raWindow / 2) {
+            mgmt->raWindow = mgmt->raWindow == 0 ? MIN(READ_AHEAD_MIN, mgmt->readAheadMax)
+                                                 : MIN(2 * mgmt->raWindow, mgmt->readAheadMax);
+            first = mgmt->raFrontier;
+            count = MIN(mgmt->raWindow, ATOMIC_READ(mgmt->fileHandle.totalNumPages) - first);
+            if (count > 0)
+                mgmt->raFrontier += count;
         }
     }
 
-    // Replace the page content with the target page's information
-    frames[minFreqIdx].data = tgtPg->data;
-    frames[minFreqIdx].pageNum = tgtPg->pageNum;
-    frames[minFreqIdx].dirtyBit = tgtPg->dirtyBit;
-    frames[minFreqIdx].fixCount = tgtPg->fixCount;
-    lfuPtr = (minFreqIdx + 1) % bufferSize; // Update LFU pointer for next replacement
+    if (mgmt->concurrent)
+        pthread_mutex_unlock(&mgmt->readAheadLatch);
+    if (count > 0)
+        readRun(bm, first, count);
+}
+
+
+// Bulk read rings
+
+// Take the ring's next frame for a new page: the frame that slot got last
+// time round if the ring still owns it and nobody has it pinned, otherwise a
+// frame from the normal victim search, which then joins the ring
+static RC ringFrame(BM_BufferPool *const bm, BM_BulkRing *const ring, int *frameIdx) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    int slot = ring->next;
+    int idx = ring->frames[slot];
+    PageNumber evicted;
+
+    ring->next = (slot + 1) % ring->size;
+    if (idx != -1 && ATOMIC_READ(mgmt->frames[idx].ringOwner) == ring->id && claimFrame(mgmt, idx, true, &evicted)) {
+        evictedFrame(bm, idx, evicted);
+        countEviction(mgmt, evicted, true);
+    } else {
+        // NO_PAGE keeps ARC from learning anything from the ring's misses
+        RC rc = obtainFrame(bm, NO_PAGE, false, &idx);
+        if (rc != RC_OK)
+            return rc;
+        ring->frames[slot] = idx;
+    }
+    ATOMIC_WRITE(mgmt->frames[idx].ringOwner, ring->id);
+    *frameIdx = idx;
+    return RC_OK;
+}
+
+
+// Prefetch threads
+
+// Bring one requested page in and leave it unpinned. Pages that are already
+// buffered or on their way in, pages past the end of the file and requests
+// that find every frame pinned are skipped, a prefetch is only a hint.
+static void prefetchPage(BM_PoolMgmt *mgmt, PageNumber pageNum) {
+    int i;
+
+    if (pageNum >= ATOMIC_READ(mgmt->fileHandle.totalNumPages))
+        return;
+    lockPartition(mgmt, pageNum);
+    i = lookupFrame(mgmt, pageNum);
+    unlockPartition(mgmt, pageNum);
+    if (i != -1 || readIntoFrame(mgmt->pool, pageNum, true, &i) != RC_OK || i == -1)
+        return;
+
+    ATOMIC_ADD(mgmt->prefetchReadCount, 1);
+    // The page is about to be used, so it joins the recency list as the most recent one
+    unpinFrame(mgmt, &mgmt->frames[i], true);
 }
 
+// Take pages off the queue and read them until the pool shuts down. Several
+// threads keep several reads in flight at once.
+static void *prefetchWorker(void *arg) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)arg;
 
-extern void LRU(BM_BufferPool *const bufferPool, PageFrame *targetPage) {
-    PageFrame *pageFrames = (PageFrame *)bufferPool->mgmtData;
-    int idx, lruIndex = -1, lruHitNumber = INT_MAX;
+    pthread_mutex_lock(&mgmt->prefetchLatch);
+    while (true) {
+        while (!mgmt->prefetchStop && mgmt->prefetchQueued == 0)
+            pthread_cond_wait(&mgmt->prefetchWake, &mgmt->prefetchLatch);
+        if (mgmt->prefetchStop)
+            break;
 
-    // Search for the least recently used page based on hitNum, ensuring it's not currently being used (fixCount == 0)
-    for (idx = 0; idx < bufferSize; idx++) {
-        if (pageFrames[idx].fixCount == 0 && pageFrames[idx].hitNum < lruHitNumber) {
-            lruIndex = idx;
-            lruHitNumber = pageFrames[idx].hitNum;
-        }
+        PageNumber pageNum = mgmt->prefetchQueue[mgmt->prefetchHead];
+        mgmt->prefetchHead = (mgmt->prefetchHead + 1) % mgmt->prefetchCapacity;
+        mgmt->prefetchQueued--;
+        mgmt->prefetchActive++;
+        pthread_mutex_unlock(&mgmt->prefetchLatch);
+
+        prefetchPage(mgmt, pageNum);
+
+        pthread_mutex_lock(&mgmt->prefetchLatch);
+        mgmt->prefetchActive--;
+        if (mgmt->prefetchActive == 0 && mgmt->prefetchQueued == 0)
+            pthread_cond_broadcast(&mgmt->prefetchIdle);
     }
+    pthread_mutex_unlock(&mgmt->prefetchLatch);
+    return NULL;
+}
 
-    // Ensure a page eligible for replacement was found
-    if (lruIndex != -1) {
-        // Flush the page to disk if it's marked as dirty
-        if (pageFrames[lruIndex].dirtyBit == 1) {
-            SM_FileHandle fileHandle;
-            if (openPageFile(bufferPool->pageFile, &fileHandle) == RC_OK && 
-                writeBlock(pageFrames[lruIndex].pageNum, &fileHandle, pageFrames[lruIndex].data) == RC_OK) {
-                // Assuming there's a mechanism or variable like writeCount to track the number of writes
-                writeCount++;
-            }
+// Prefetch without threads: every page that is in the file and not buffered
+// gets a frame and an asynchronous read. Like the threads, stop quietly once
+// no frame is free.
+static RC submitPrefetches(BM_PoolMgmt *mgmt, const PageNumber *pageNums, int n) {
+    for (int k = 0; k < n; k++) {
+        PageNumber pageNum = pageNums[k];
+        if (pageNum < 0 || pageNum >= ATOMIC_READ(mgmt->fileHandle.totalNumPages))
+            continue;
+        lockPartition(mgmt, pageNum);
+        bool buffered = lookupFrame(mgmt, pageNum) != -1;
+        unlockPartition(mgmt, pageNum);
+        if (buffered)
+            continue;
+
+        AsyncSegment *segment = malloc(sizeof(AsyncSegment));
+        if (segment == NULL)
+            break;
+        *segment = (AsyncSegment){mgmt, &segment->frame, 1, true, RC_OK, NULL, -1};
+        RC rc = publishRead(mgmt->pool, pageNum, true, &segment->frame);
+        if (segment->frame == -1) {
+            free(segment);
+            if (rc != RC_OK)
+                break;
+            continue;
         }
-
-        // Update the least recently used page frame with the target page's information
-        pageFrames[lruIndex].data = targetPage->data;
-        pageFrames[lruIndex].pageNum = targetPage->pageNum;
-        pageFrames[lruIndex].dirtyBit = targetPage->dirtyBit;
-        pageFrames[lruIndex].fixCount = targetPage->fixCount;
-        // Assuming hitNum should be updated to indicate the page has been accessed recently
-        pageFrames[lruIndex].hitNum = hit; // Increment a global counter to simulate recent access
+        submitSegment(mgmt, pageNum, segment);
     }
+    // The reads start together, with one system call on io_uring
+    submitAsyncIO(&mgmt->engine);
+    return RC_OK;
 }
 
+// Drop the queued requests and wait for the reads in flight, after which the
+// threads hold no pins
+static void drainPrefetch(BM_PoolMgmt *mgmt) {
+    if (mgmt->asyncIO)
+        waitAsyncIO(&mgmt->engine);
+    if (mgmt->prefetchThreads == 0)
+        return;
+    pthread_mutex_lock(&mgmt->prefetchLatch);
+    mgmt->prefetchQueued = 0;
+    while (mgmt->prefetchActive > 0)
+        pthread_cond_wait(&mgmt->prefetchIdle, &mgmt->prefetchLatch);
+    pthread_mutex_unlock(&mgmt->prefetchLatch);
+}
+
+static void stopPrefetchers(BM_PoolMgmt *mgmt) {
+    if (mgmt->prefetchThreads == 0)
+        return;
+    pthread_mutex_lock(&mgmt->prefetchLatch);
+    mgmt->prefetchStop = true;
+    pthread_cond_broadcast(&mgmt->prefetchWake);
+    pthread_mutex_unlock(&mgmt->prefetchLatch);
+    for (int t = 0; t < mgmt->prefetchThreads; t++)
+        pthread_join(mgmt->prefetchers[t], NULL);
+    mgmt->prefetchThreads = 0;
+}
 
 
-extern void CLOCK(BM_BufferPool *const bp, PageFrame *tgtPg) {
-    PageFrame *frames = (PageFrame *)bp->mgmtData;
-    int replacementFound = 0;
+// Background writer
 
-    while (!replacementFound) {
-        // Adjust clockPointer to ensure it always points within the buffer range
-        clockPointer %= bufferSize;
+// Up to max frames in the order the strategy is likely to replace them, as
+// far as that is cheap to tell. The order is a snapshot and only a hint.
+static int evictionCandidates(BM_PoolMgmt *mgmt, int *out, int max) {
+    int n = 0;
 
-        // Check if the current page frame is eligible for replacement
-        if (frames[clockPointer].fixCount == 0) { // Assuming fixCount is a better indicator for eligibility than hitNum
-            if (frames[clockPointer].dirtyBit == 1) {
-                // Flush the page to disk if it's dirty
-                SM_FileHandle fh;
-                if (openPageFile(bp->pageFile, &fh) == RC_OK && 
-                    writeBlock(frames[clockPointer].pageNum, &fh, frames[clockPointer].data) == RC_OK) {
-                    writeCount++; // Increment write counter on successful write
+    if (mgmt->strategy == RS_LRU || mgmt->strategy == RS_ARC) {
+        // From the least recent end of the lists, T1 and T2 taking turns for ARC
+        lockPolicy(mgmt);
+        int next[2] = {mgmt->lists[0].tail, mgmt->strategy == RS_ARC ? mgmt->lists[ARC_T2].tail : -1};
+        while (n < max && (next[0] != -1 || next[1] != -1)) {
+            for (int l = 0; l < 2 && n < max; l++) {
+                if (next[l] != -1) {
+                    out[n++] = next[l];
+                    next[l] = mgmt->frames[next[l]].listPrev;
                 }
             }
+        }
+        unlockPolicy(mgmt);
+    } else if (mgmt->strategy == RS_LFU) {
+        // Oldest frames of the lowest counts first
+        lockPolicy(mgmt);
+        for (int b = mgmt->lfuLowest; b != -1 && n < max; b = mgmt->lfuBuckets[b].next)
+            for (int idx = mgmt->lfuBuckets[b].head; idx != -1 && n < max; idx = mgmt->frames[idx].lfuNext)
+                out[n++] = idx;
+        unlockPolicy(mgmt);
+    } else {
+        // FIFO and CLOCK replace frames in slot order, starting at the next
+        // fill or at the hand; anything else is swept round robin
+        int start;
+        if (mgmt->strategy == RS_FIFO)
+            start = ATOMIC_READ(mgmt->rearIndex) + 1;
+        else if (mgmt->strategy == RS_CLOCK || mgmt->strategy == RS_GCLOCK)
+            start = ATOMIC_READ(mgmt->clockPointer) % mgmt->bufferSize;
+        else
+            start = mgmt->writerCursor;
+        for (; n < max && n < mgmt->bufferSize; n++)
+            out[n] = (start + n) % mgmt->bufferSize;
+        mgmt->writerCursor = (start + n) % mgmt->bufferSize;
+    }
+    return n;
+}
 
-            // Update the page frame with the target page's data
-            frames[clockPointer].data = tgtPg->data;
-            frames[clockPointer].pageNum = tgtPg->pageNum;
-            frames[clockPointer].dirtyBit = tgtPg->dirtyBit;
-            frames[clockPointer].fixCount = tgtPg->fixCount;
-            // Instead of copying targetPage's hitNum, reset or adjust the current frame's hitNum as needed for the CLOCK logic
-            frames[clockPointer].hitNum = 1; // Indicate that this page frame has been 'accessed' or 'used' recently
+// Every writerDelayMs, look at the frames that are next in line for
+// replacement and write back up to writerBatchSize dirty ones among them, so
+// foreground misses find clean victims and cost one read instead of a write
+// and a read. A synchronous victim write wakes the writer early.
+static void *backgroundWriter(void *arg) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)arg;
+    int lookahead = MIN(4 * mgmt->writerBatchSize, mgmt->bufferSize);
+
+    pthread_mutex_lock(&mgmt->writerLatch);
+    while (!mgmt->writerStop) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += (long)mgmt->writerDelayMs * 1000000;
+        until.tv_sec += until.tv_nsec / 1000000000;
+        until.tv_nsec %= 1000000000;
+        pthread_cond_timedwait(&mgmt->writerWake, &mgmt->writerLatch, &until);
+        if (mgmt->writerStop)
+            break;
+        pthread_mutex_unlock(&mgmt->writerLatch);
+
+        int n = evictionCandidates(mgmt, mgmt->writerCandidates, lookahead);
+        int written = 0;
+        for (int i = 0; i < n && written < mgmt->writerBatchSize; i++) {
+            if (cleanFrame(mgmt, mgmt->writerCandidates[i])) {
+                ATOMIC_ADD(mgmt->backgroundWriteCount, 1);
+                written++;
+            }
+        }
 
-            replacementFound = 1; // Mark that a replacement has been made
-        } else {
-            // If the page is not eligible for replacement, give it a second chance by resetting its hitNum
-            frames[clockPointer].hitNum = 0;
+        pthread_mutex_lock(&mgmt->writerLatch);
+    }
+    pthread_mutex_unlock(&mgmt->writerLatch);
+    return NULL;
+}
+
+static void stopBackgroundWriter(BM_PoolMgmt *mgmt) {
+    if (!mgmt->writerRunning)
+        return;
+    pthread_mutex_lock(&mgmt->writerLatch);
+    mgmt->writerStop = true;
+    pthread_cond_signal(&mgmt->writerWake);
+    pthread_mutex_unlock(&mgmt->writerLatch);
+    pthread_join(mgmt->writer, NULL);
+    mgmt->writerRunning = false;
+}
+
+
+// Map the slab that backs all frames. With huge pages the kernel is asked for
+// explicit huge pages first and transparent ones as a fallback; either way the
+// memory is page aligned, and only touched pages take up physical memory.
+static char *mapArena(size_t *size, bool hugePages) {
+    char *arena = MAP_FAILED;
+
+    if (hugePages) {
+        size_t hugeSize = (*size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+#ifdef MAP_HUGETLB
+        arena = mmap(NULL, hugeSize, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+        if (arena == MAP_FAILED) {
+            arena = mmap(NULL, hugeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+            if (arena != MAP_FAILED)
+                madvise(arena, hugeSize, MADV_HUGEPAGE);
+#endif
         }
+        *size = hugeSize;
+    } else {
+        arena = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    return arena == MAP_FAILED ? NULL : arena;
+}
+
+
+// A zeroed array of one int per frame, starting on a cache line
+static int *allocFrameArray(int numFrames) {
+    size_t size = ((size_t)numFrames * sizeof(int) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    int *array = aligned_alloc(CACHE_LINE, size);
+
+    return array != NULL ? memset(array, 0, size) : NULL;
+}
+
+static void freeLRUK(BM_PoolMgmt *mgmt) {
+    free(mgmt->lrukHist);
+    free(mgmt->lrukLast);
+    free(mgmt->lrukOwner);
+    free(mgmt->lrukHistoryPages);
+    free(mgmt->lrukHistoryTimes);
+    mgmt->lrukHist = mgmt->lrukLast = mgmt->lrukHistoryTimes = NULL;
+    mgmt->lrukOwner = mgmt->lrukHistoryPages = NULL;
+}
+
+
+// Allocate the LFU buckets, one per frame is enough plus one that is taken
+// before an emptied bucket is given back
+static RC initLFU(BM_PoolMgmt *mgmt, ReplacementStrategy strategy, const BM_LFUParams *params) {
+    mgmt->freqBuckets = strategy == RS_LFU;
+    mgmt->lfuBuckets = NULL;
+    mgmt->lfuLowest = mgmt->lfuFreeBucket = -1;
+    mgmt->lfuAgingInterval = params != NULL && params->agingInterval > 0 ? params->agingInterval : 0;
+    mgmt->lfuSinceAging = 0;
+    if (!mgmt->freqBuckets)
+        return RC_OK;
 
-        // Move to the next page frame in a circular manner
-        clockPointer = (clockPointer + 1) % bufferSize;
+    mgmt->lfuBuckets = malloc(sizeof(LFUBucket) * (mgmt->bufferSize + 1));
+    if (mgmt->lfuBuckets == NULL)
+        return RC_ERROR;
+    for (int i = 0; i <= mgmt->bufferSize; i++)
+        mgmt->lfuBuckets[i].next = i < mgmt->bufferSize ? i + 1 : -1;
+    mgmt->lfuFreeBucket = 0;
+    return RC_OK;
+}
+
+// Allocate the ARC ghost directory: at most c pages are remembered once the
+// pool is full, 2c bounds it while frames are still unused
+static RC initARC(BM_PoolMgmt *mgmt, ReplacementStrategy strategy) {
+    int entries = 2 * mgmt->bufferSize;
+    int bits = 1;
+
+    mgmt->adaptive = strategy == RS_ARC;
+    mgmt->arcTarget = 0;
+    mgmt->ghosts = NULL;
+    mgmt->ghostBuckets = NULL;
+    mgmt->freeGhost = -1;
+    for (int i = 0; i < 2; i++)
+        mgmt->ghostLists[i] = (FrameList){.head = -1, .tail = -1, .size = 0};
+    if (!mgmt->adaptive)
+        return RC_OK;
+
+    while ((1 << bits) < 2 * entries && bits < 30)
+        bits++;
+    mgmt->ghostShift = 32 - bits;
+    mgmt->ghosts = malloc(sizeof(GhostEntry) * entries);
+    mgmt->ghostBuckets = malloc(sizeof(int) * (1 << bits));
+    if (mgmt->ghosts == NULL || mgmt->ghostBuckets == NULL) {
+        free(mgmt->ghosts);
+        free(mgmt->ghostBuckets);
+        mgmt->ghosts = NULL;
+        mgmt->ghostBuckets = NULL;
+        return RC_ERROR;
+    }
+    for (int i = 0; i < entries; i++)
+        mgmt->ghosts[i].next = i + 1 < entries ? i + 1 : -1;
+    for (int i = 0; i < (1 << bits); i++)
+        mgmt->ghostBuckets[i] = -1;
+    mgmt->freeGhost = 0;
+    return RC_OK;
+}
+
+// Allocate the LRU-K state; other strategies leave all of it NULL
+static RC initLRUK(BM_PoolMgmt *mgmt, ReplacementStrategy strategy, const BM_LRUKParams *params) {
+    int n = mgmt->bufferSize;
+    int historySize = params != NULL && params->historySize > 0 ? params->historySize : n;
+
+    mgmt->lrukK = params != NULL && params->k > 0 ? params->k : DEFAULT_LRUK_K;
+    mgmt->lrukPeriod = params != NULL ? params->correlatedPeriod : 0;
+    mgmt->lrukHist = mgmt->lrukLast = mgmt->lrukHistoryTimes = NULL;
+    mgmt->lrukOwner = mgmt->lrukHistoryPages = NULL;
+    mgmt->lrukHistoryMask = 0;
+    if (strategy != RS_LRU_K)
+        return RC_OK;
+
+    // Round the history table up to a power of two
+    unsigned int slots = 1;
+    while (slots < (unsigned int)historySize && slots < (1u << 30))
+        slots <<= 1;
+    mgmt->lrukHistoryMask = slots - 1;
+
+    mgmt->lrukHist = calloc((size_t)n * mgmt->lrukK, sizeof(int));
+    mgmt->lrukLast = calloc(n, sizeof(int));
+    mgmt->lrukOwner = malloc(sizeof(PageNumber) * n);
+    mgmt->lrukHistoryPages = malloc(sizeof(PageNumber) * slots);
+    mgmt->lrukHistoryTimes = calloc((size_t)slots * mgmt->lrukK, sizeof(int));
+    if (mgmt->lrukHist == NULL || mgmt->lrukLast == NULL || mgmt->lrukOwner == NULL ||
+        mgmt->lrukHistoryPages == NULL || mgmt->lrukHistoryTimes == NULL) {
+        freeLRUK(mgmt);
+        return RC_ERROR;
     }
+    for (int i = 0; i < n; i++)
+        mgmt->lrukOwner[i] = NO_PAGE;
+    for (unsigned int i = 0; i < slots; i++)
+        mgmt->lrukHistoryPages[i] = NO_PAGE;
+    return RC_OK;
 }
 
+// Function implementations
+
 extern RC initBufferPool(BM_BufferPool *const bm, const char *const pageFileName,
                          const int numPages, ReplacementStrategy strategy,
                          void *stratData) {
+    return initBufferPoolWithOptions(bm, pageFileName, numPages, strategy, stratData, NULL);
+}
+
+extern RC initBufferPoolWithOptions(BM_BufferPool *const bm, const char *const pageFileName,
+                                    const int numPages, ReplacementStrategy strategy,
+                                    void *stratData, const BM_PoolOptions *options) {
     bm->pageFile = (char *)pageFileName;
     bm->numPages = numPages;
     bm->strategy = strategy;
 
+    if (numPages <= 0)
+        return RC_ERROR;
+    if (strategy == RS_LRU_K && stratData != NULL && (((BM_LRUKParams *)stratData)->k < 0 ||
+                                                      ((BM_LRUKParams *)stratData)->correlatedPeriod < 0))
+        return RC_ERROR;
+
+    // Zeroed, so the failure path below can free the strategy state of a
+    // pool that never got that far
+    BM_PoolMgmt *mgmt = calloc(1, sizeof(BM_PoolMgmt));
     PageFrame *page = malloc(sizeof(PageFrame) * numPages);
-    if (page == NULL) {
-        // Handle memory allocation failure
-        return RC_OK; // Assuming RC_MEMORY_ALLOCATION_ERROR is defined as an error code
+    int *fixCounts = allocFrameArray(numPages);
+    int *dirtyBits = allocFrameArray(numPages);
+    int *hitNums = allocFrameArray(numPages);
+    int *pageLatches = allocFrameArray(numPages);
+    int *versions = allocFrameArray(numPages);
+    StatShard *stats = aligned_alloc(CACHE_LINE, sizeof(StatShard) * STAT_SHARDS);
+
+    // Size the page table to the next power of two holding at least two buckets per frame
+    int bucketBits = 1;
+    while ((1 << bucketBits) < 2 * numPages && bucketBits < 30)
+        bucketBits++;
+    int *buckets = malloc(sizeof(int) * (1 << bucketBits));
+
+    // Latch partitions, a power of two no larger than the number of buckets
+    int numPartitions = 1;
+    // The background writer and the prefetch threads share the pool with the caller, so they need the latches
+    bool concurrent = options != NULL && (options->concurrent || options->backgroundWriter ||
+                                          options->prefetchThreads > 0);
+    if (concurrent) {
+        int wanted = options->numPartitions > 0 ? options->numPartitions : DEFAULT_PARTITIONS;
+        while (numPartitions < wanted && numPartitions < (1 << bucketBits))
+            numPartitions <<= 1;
     }
+    pthread_mutex_t *latches = concurrent ? malloc(sizeof(pthread_mutex_t) * numPartitions) : NULL;
+
+    // All page buffers are allocated here, pins and evictions reuse them in place
+    size_t arenaSize = (size_t)numPages * PAGE_SIZE;
+    char *arena = mapArena(&arenaSize, options != NULL && options->hugePages);
 
-    bufferSize = numPages;
+    RC rc = RC_ERROR;
+    if (mgmt == NULL || page == NULL || fixCounts == NULL || dirtyBits == NULL || hitNums == NULL ||
+        pageLatches == NULL || versions == NULL || stats == NULL || buckets == NULL || (concurrent && latches == NULL) || arena == NULL)
+        goto fail; // Handle memory allocation failure
+
+    mgmt->bufferSize = numPages;
+    // stratData is only read by the strategy it was meant for
+    if (initLRUK(mgmt, strategy, strategy == RS_LRU_K ? stratData : NULL) != RC_OK ||
+        initLFU(mgmt, strategy, strategy == RS_LFU ? stratData : NULL) != RC_OK ||
+        initARC(mgmt, strategy) != RC_OK)
+        goto fail;
 
     // Initialize PageFrame elements in a single loop
-    for (int i = 0; i < bufferSize; i++) {
-        page[i] = (PageFrame){.data = NULL, .pageNum = -1, .dirtyBit = 0, 
-                              .fixCount = 0, .hitNum = 0, .refNum = 0};
+    for (int i = 0; i < mgmt->bufferSize; i++) {
+        page[i] = (PageFrame){.data = arena + (size_t)i * PAGE_SIZE, .pageNum = -1,
+                              .refNum = 0, .hashNext = -1,
+                              .listId = NO_LIST, .listPrev = -1, .listNext = -1,
+                              .lfuBucket = -1, .lfuPrev = -1, .lfuNext = -1,
+                              .ioInProgress = 0, .ioError = 0, .prefetched = 0, .ringOwner = 0};
+    }
+    for (int i = 0; i < (1 << bucketBits); i++)
+        buckets[i] = -1;
+
+    // Keep the page file open until shutdownBufferPool. With direct I/O the
+    // frames, page aligned in the arena, are read and written without a second
+    // copy in the page cache; where the file system has no direct I/O the pool
+    // falls back to the page cache.
+    if (options != NULL && options->directIO)
+        rc = openPageFileDirect(bm->pageFile, &mgmt->fileHandle);
+    if (rc != RC_OK)
+        rc = openPageFile(bm->pageFile, &mgmt->fileHandle);
+    if (rc != RC_OK)
+        goto fail;
+
+    mgmt->frames = page;
+    mgmt->fixCounts = fixCounts;
+    mgmt->dirtyBits = dirtyBits;
+    mgmt->hitNums = hitNums;
+    mgmt->pageLatches = pageLatches;
+    mgmt->versions = versions;
+    mgmt->scanFrames = pickFrameScan();
+    mgmt->stats = memset(stats, 0, sizeof(StatShard) * STAT_SHARDS);
+    mgmt->arena = arena;
+    mgmt->arenaSize = arenaSize;
+    mgmt->buckets = buckets;
+    mgmt->bucketShift = 32 - bucketBits;
+    mgmt->numUsedFrames = 0;
+
+    mgmt->concurrent = concurrent;
+    mgmt->recencyList = strategy == RS_LRU;
+    for (int i = 0; i < NUM_FRAME_LISTS; i++)
+        mgmt->lists[i] = (FrameList){.head = -1, .tail = -1, .size = 0};
+    mgmt->partitionLatches = latches;
+    mgmt->partitionMask = numPartitions - 1;
+    for (int i = 0; concurrent && i < numPartitions; i++)
+        pthread_mutex_init(&latches[i], NULL);
+    pthread_mutex_init(&mgmt->fileLatch, NULL);
+    pthread_mutex_init(&mgmt->policyLatch, NULL);
+    mgmt->refBatches = NULL;
+    mgmt->refBatchSize = options != NULL && options->referenceBatch > 0 ? MIN(options->referenceBatch, REF_BATCH_MAX / 2)
+                                                                        : DEFAULT_REF_BATCH;
+    mgmt->applyReference = strategy == RS_LRU ? applyLRU : strategy == RS_LFU ? applyLFU
+                         : strategy == RS_LRU_K ? applyLRUK : strategy == RS_ARC ? applyARC : NULL;
+
+    bm->mgmtData = mgmt;
+    mgmt->rearIndex = mgmt->hit = -1;
+    mgmt->writeCount = mgmt->clockPointer = 0;
+    mgmt->syncWriteCount = mgmt->backgroundWriteCount = 0;
+    mgmt->flushThreads = options != NULL && options->flushThreads > 0 ? options->flushThreads : 1;
+    mgmt->strictLatches = options != NULL && options->strictLatches;
+
+    // CLOCK is GCLOCK with a one bit counter
+    BM_GClockParams *gclock = strategy == RS_GCLOCK ? stratData : NULL;
+    mgmt->clockMax = strategy != RS_GCLOCK ? 1 : gclock != NULL && gclock->maxCount > 0 ? gclock->maxCount : DEFAULT_GCLOCK_MAX;
+    mgmt->clockInitial = gclock != NULL && gclock->initialCount > 0 ? MIN(gclock->initialCount, mgmt->clockMax) : 1;
+
+    mgmt->strategy = strategy;
+    mgmt->writerRunning = mgmt->writerStop = false;
+    mgmt->writerCursor = 0;
+    mgmt->writerCandidates = NULL;
+    pthread_mutex_init(&mgmt->writerLatch, NULL);
+    pthread_cond_init(&mgmt->writerWake, NULL);
+
+    // At most a quarter of the pool is read ahead at once
+    int readAheadMax = options != NULL ? MIN(options->readAheadPages, MIN(MAX_IO_PAGES, numPages / 4)) : 0;
+    mgmt->readAheadMax = readAheadMax >= 2 ? readAheadMax : 0;
+    mgmt->raLast = NO_PAGE;
+    mgmt->raRun = mgmt->raWindow = 0;
+    mgmt->raFrontier = 0;
+    pthread_mutex_init(&mgmt->readAheadLatch, NULL);
+    mgmt->lastRingId = 0;
+
+    mgmt->mapping = NULL;
+    mgmt->retiredMappings = 0;
+    mgmt->mapFd = -1;
+    mgmt->accessPattern = options != NULL ? options->accessPattern : BM_ACCESS_NORMAL;
+    pthread_mutex_init(&mgmt->mapLatch, NULL);
+    mgmt->asyncIO = false;
+    mgmt->asyncReads = 0;
+
+    mgmt->pool = bm;
+    mgmt->prefetchThreads = 0;
+    mgmt->prefetchers = NULL;
+    mgmt->prefetchQueue = NULL;
+    mgmt->prefetchCapacity = mgmt->prefetchHead = mgmt->prefetchQueued = mgmt->prefetchActive = 0;
+    mgmt->prefetchStop = false;
+    mgmt->prefetchReadCount = mgmt->prefetchWriteCount = 0;
+    pthread_mutex_init(&mgmt->prefetchLatch, NULL);
+    pthread_cond_init(&mgmt->prefetchWake, NULL);
+    pthread_cond_init(&mgmt->prefetchIdle, NULL);
+
+    if (options != NULL && options->mmapFile) {
+        mgmt->mapFd = open(bm->pageFile, O_RDONLY);
+        if (mgmt->mapFd < 0 || remapFile(mgmt) == NULL) {
+            shutdownBufferPool(bm);
+            return RC_ERROR;
+        }
+    }
+
+    if (options != NULL && options->fileExtentPages > 0)
+        setGrowthExtent(&mgmt->fileHandle, options->fileExtentPages);
+    if (options != NULL && options->ioQueueDepth > 0) {
+        if (openAsyncEngine(&mgmt->fileHandle, options->ioQueueDepth, SM_ASYNC_ANY, &mgmt->engine) != RC_OK) {
+            shutdownBufferPool(bm);
+            return RC_ERROR;
+        }
+        mgmt->asyncIO = true;
     }
 
-    bm->mgmtData = page;
-    writeCount = clockPointer = lfuPtr = 0;
+    // Only the strategies with a policy latch queue their references
+    if (concurrent && mgmt->applyReference != NULL && mgmt->refBatchSize > 1) {
+        mgmt->refBatches = aligned_alloc(CACHE_LINE, sizeof(RefBatch) * STAT_SHARDS);
+        if (mgmt->refBatches == NULL) {
+            shutdownBufferPool(bm);
+            return RC_ERROR;
+        }
+        for (int i = 0; i < STAT_SHARDS; i++) {
+            pthread_mutex_init(&mgmt->refBatches[i].latch, NULL);
+            mgmt->refBatches[i].count = 0;
+        }
+    }
+
+    // Threads start last, the pool is complete and shutdownBufferPool can undo everything
+    if (options != NULL && options->backgroundWriter) {
+        mgmt->writerDelayMs = options->writerDelayMs > 0 ? options->writerDelayMs : DEFAULT_WRITER_DELAY_MS;
+        mgmt->writerBatchSize = options->writerBatchSize > 0 ? options->writerBatchSize : DEFAULT_WRITER_BATCH;
+        mgmt->writerCandidates = malloc(sizeof(int) * MIN(4 * mgmt->writerBatchSize, numPages));
+        if (mgmt->writerCandidates == NULL || pthread_create(&mgmt->writer, NULL, backgroundWriter, mgmt) != 0) {
+            shutdownBufferPool(bm);
+            return RC_ERROR;
+        }
+        mgmt->writerRunning = true;
+    }
+    if (options != NULL && options->prefetchThreads > 0) {
+        mgmt->prefetchCapacity = options->prefetchQueueSize > 0 ? options->prefetchQueueSize : numPages;
+        mgmt->prefetchQueue = malloc(sizeof(PageNumber) * mgmt->prefetchCapacity);
+        mgmt->prefetchers = malloc(sizeof(pthread_t) * options->prefetchThreads);
+        if (mgmt->prefetchQueue == NULL || mgmt->prefetchers == NULL) {
+            shutdownBufferPool(bm);
+            return RC_ERROR;
+        }
+        while (mgmt->prefetchThreads < options->prefetchThreads) {
+            if (pthread_create(&mgmt->prefetchers[mgmt->prefetchThreads], NULL, prefetchWorker, mgmt) != 0) {
+                shutdownBufferPool(bm);
+                return RC_ERROR;
+            }
+            mgmt->prefetchThreads++;
+        }
+    }
     return RC_OK;
+
+fail:
+    // Everything allocated before the page file was opened. Later failures
+    // go through shutdownBufferPool, which owns the pool from then on
+    if (mgmt != NULL) {
+        freeLRUK(mgmt);
+        free(mgmt->lfuBuckets);
+        free(mgmt->ghosts);
+        free(mgmt->ghostBuckets);
+    }
+    free(mgmt);
+    free(page);
+    free(fixCounts);
+    free(dirtyBits);
+    free(hitNums);
+    free(pageLatches);
+    free(versions);
+    free(stats);
+    free(buckets);
+    free(latches);
+    if (arena != NULL)
+        munmap(arena, arenaSize);
+    return rc;
 }
 
 extern RC shutdownBufferPool(BM_BufferPool *const bm) {
-    PageFrame *frameSet = (PageFrame *)bm->mgmtData; // Using frameSet for clarity
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PageFrame *frameSet = mgmt->frames; // Using frameSet for clarity
+
+    // Prefetch reads in flight hold pins, let them finish first
+    drainPrefetch(mgmt);
     forceFlushPool(bm); // Ensure all dirty pages are written back
 
     // Iterating with a while loop to check for pinned pages
     int idx = 0; // Using idx as a loop counter
     while (idx < bm->numPages) { // Using bm->numPages to directly reference the number of pages
-        if (frameSet[idx].fixCount > 0) {
+        if (mgmt->fixCounts[idx] > 0) {
             return RC_PINNED_PAGES_IN_BUFFER; // Return error if any page is still pinned
         }
         idx++; // Increment loop counter
     }
 
+    // Nothing can be dirtied any more, the writer may finish its round and go
+    stopBackgroundWriter(mgmt);
+    stopPrefetchers(mgmt);
+    if (mgmt->asyncIO)
+        closeAsyncEngine(&mgmt->engine);
+    closePageFile(&mgmt->fileHandle);
+    munmap(mgmt->arena, mgmt->arenaSize);
     free(frameSet); // Free the allocated memory for frames
+    free(mgmt->fixCounts);
+    free(mgmt->dirtyBits);
+    free(mgmt->hitNums);
+    free(mgmt->pageLatches);
+    free(mgmt->versions);
+    free(mgmt->stats);
+    free(mgmt->buckets);
+    for (idx = 0; mgmt->concurrent && idx <= (int)mgmt->partitionMask; idx++)
+        pthread_mutex_destroy(&mgmt->partitionLatches[idx]);
+    free(mgmt->partitionLatches);
+    pthread_mutex_destroy(&mgmt->fileLatch);
+    pthread_mutex_destroy(&mgmt->policyLatch);
+    for (int i = 0; mgmt->refBatches != NULL && i < STAT_SHARDS; i++)
+        pthread_mutex_destroy(&mgmt->refBatches[i].latch);
+    free(mgmt->refBatches);
+    pthread_mutex_destroy(&mgmt->writerLatch);
+    pthread_cond_destroy(&mgmt->writerWake);
+    free(mgmt->writerCandidates);
+    pthread_mutex_destroy(&mgmt->prefetchLatch);
+    pthread_cond_destroy(&mgmt->prefetchWake);
+    pthread_cond_destroy(&mgmt->prefetchIdle);
+    pthread_mutex_destroy(&mgmt->readAheadLatch);
+    while (mgmt->mapping != NULL) {
+        MapRegion *older = mgmt->mapping->older;
+        if (!mgmt->mapping->unmapped)
+            munmap(mgmt->mapping->base, (size_t)mgmt->mapping->capacity * PAGE_SIZE);
+        free(mgmt->mapping);
+        mgmt->mapping = older;
+    }
+    if (mgmt->mapFd >= 0)
+        close(mgmt->mapFd);
+    pthread_mutex_destroy(&mgmt->mapLatch);
+    free(mgmt->prefetchQueue);
+    free(mgmt->prefetchers);
+    freeLRUK(mgmt);
+    free(mgmt->lfuBuckets);
+    free(mgmt->ghosts);
+    free(mgmt->ghostBuckets);
+    free(mgmt);
     bm->mgmtData = NULL; // Safely nullify the management data pointer
 
     return RC_OK; // Successfully shutdown the buffer pool
 }
 
 
-extern RC forceFlushPool(BM_BufferPool *const bm) {
-    PageFrame *pageFrames = (PageFrame *)bm->mgmtData; // Direct reference to the frames
-    int currentPageIndex = 0; // Index for the current page frame being examined
-
-    // Iterating through the buffer pool's frames
-    while (currentPageIndex < bm->numPages) { // Using bm->numPages for direct reference
-        PageFrame *currentFrame = &pageFrames[currentPageIndex]; // Pointer to the current frame for readability
-        
-        // Check if the frame is dirty and not pinned
-        if (currentFrame->fixCount == 0 && currentFrame->dirtyBit == 1) {
-            SM_FileHandle fh;
-            // Attempt to open the page file and write the block if dirty
-            if (openPageFile(bm->pageFile, &fh) == RC_OK &&
-                writeBlock(currentFrame->pageNum, &fh, currentFrame->data) == RC_OK) {
-                currentFrame->dirtyBit = 0; // Successfully written, clear the dirty bit
-                writeCount++; // Assuming writeCount tracks the number of write operations
-            }
-            // Optionally handle errors or log them here
-        }
+typedef struct FlushWorker {
+    BM_PoolMgmt *mgmt;
+    const PageSlot *pages;
+    int n;
+    RC rc;
+    bool started;             // written by its own thread, not by the caller
+    pthread_t thread;
+} FlushWorker;
 
-        currentPageIndex++; // Move to the next frame
-    }
+static void *flushWorker(void *arg) {
+    FlushWorker *worker = arg;
+
+    worker->rc = writeRuns(worker->mgmt, worker->pages, worker->n);
+    return NULL;
+}
 
-    return RC_OK; // Indicate successful flush
+// Write the sorted, claimed frames, split into flushThreads equal slices of
+// at least 1 MB each that are written in parallel
+static RC flushRuns(BM_PoolMgmt *mgmt, const PageSlot *pages, int n) {
+    int threads = MIN(mgmt->flushThreads, (n + MAX_IO_PAGES - 1) / MAX_IO_PAGES);
+    FlushWorker *workers = threads > 1 ? malloc(sizeof(FlushWorker) * threads) : NULL;
+    RC rc = RC_OK;
+
+    if (workers == NULL)
+        return writeRuns(mgmt, pages, n);
+
+    for (int t = 0; t < threads; t++) {
+        int first = (int)((long)n * t / threads);
+        workers[t].mgmt = mgmt;
+        workers[t].pages = pages + first;
+        workers[t].n = (int)((long)n * (t + 1) / threads) - first;
+        workers[t].rc = RC_OK;
+        workers[t].started = t > 0 && pthread_create(&workers[t].thread, NULL, flushWorker, &workers[t]) == 0;
+    }
+    // The calling thread writes the first slice itself, and any slice it could not hand off
+    for (int t = 0; t < threads; t++)
+        if (!workers[t].started)
+            workers[t].rc = writeRuns(mgmt, workers[t].pages, workers[t].n);
+    for (int t = 0; t < threads; t++) {
+        if (workers[t].started)
+            pthread_join(workers[t].thread, NULL);
+        if (rc == RC_OK)
+            rc = workers[t].rc;
+    }
+    free(workers);
+    return rc;
 }
 
+// Write back every dirty frame that is not pinned. The frames are claimed
+// first and then written in page order, adjacent pages with a single
+// vectored write, instead of one write per frame in slot order.
+extern RC forceFlushPool(BM_BufferPool *const bm) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PageSlot *dirty = malloc(sizeof(PageSlot) * mgmt->bufferSize);
+    long long start = nowNs();
+    int n = 0;
+
+    // Without memory for the list fall back to writing frame by frame
+    if (dirty == NULL) {
+        for (int currentPageIndex = 0; currentPageIndex < bm->numPages; currentPageIndex++)
+            cleanFrame(mgmt, currentPageIndex);
+        recordLatency(mgmt, FLUSH_LATENCY, start);
+        return RC_OK;
+    }
+
+    for (int i = mgmt->scanFrames(mgmt->fixCounts, mgmt->dirtyBits, 0, mgmt->bufferSize); i < mgmt->bufferSize;
+         i = mgmt->scanFrames(mgmt->fixCounts, mgmt->dirtyBits, i + 1, mgmt->bufferSize)) {
+        if (!claimDirtyFrame(mgmt, i))
+            continue;
+        dirty[n].pageNum = mgmt->frames[i].pageNum;
+        dirty[n++].slot = i;
+    }
+    qsort(dirty, n, sizeof(PageSlot), comparePageSlots);
 
+    RC rc = flushRuns(mgmt, dirty, n);
+    for (int k = 0; k < n; k++)
+        unpinFrame(mgmt, &mgmt->frames[dirty[k].slot], false);
 
+    free(dirty);
+    recordLatency(mgmt, FLUSH_LATENCY, start);
+    return rc;
+}
 
-extern RC markDirty(BM_BufferPool *const bm, BM_PageHandle *const page) {
-    PageFrame *pageFrames = (PageFrame *)bm->mgmtData; // Direct reference to the frames
-    int currentFrameIndex = 0; // Index for the current frame being examined
 
-    // Iterating through the buffer pool's frames to find the matching page
-    while (currentFrameIndex < bm->numPages) { // Using bm->numPages to directly reference the number of pages
-        if (pageFrames[currentFrameIndex].pageNum == page->pageNum) {
-            pageFrames[currentFrameIndex].dirtyBit = 1; // Mark the matching page as dirty
 
-            return RC_OK; // Successfully marked the page as dirty
-        }
 
-        currentFrameIndex++; // Move to the next frame if not a match
+// A page pinned with pinPageShared cannot be marked dirty, and neither can a
+// page somebody else holds latched: the page may only change under its
+// exclusive latch. Pages pinned without a latch can be marked while nobody
+// latches them, as before, unless the pool was set up with strictLatches.
+// Marking such a page moves the frame's version on, so optimistic reads that
+// overlap the change fail.
+extern RC markDirty(BM_BufferPool *const bm, BM_PageHandle *const page) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+
+    // Pages pinned straight from the mapped file are read-only
+    if (mgmt->mapping != NULL && mappedRegion(mgmt, page->data) != NULL)
+        return RC_ERROR;
+
+    lockPartition(mgmt, page->pageNum);
+    int frameIdx = lookupFrame(mgmt, page->pageNum); // Page table lookup instead of a scan
+    // Return an error if no matching page was found
+    RC rc = frameIdx == -1 ? RC_ERROR : RC_OK;
+    bool exclusive = rc == RC_OK && page->latch == BM_LATCH_EXCLUSIVE && holdsLatch(mgmt, page, frameIdx);
+    if (rc == RC_OK && !exclusive && (mgmt->strictLatches || ATOMIC_READ(mgmt->pageLatches[frameIdx]) != 0))
+        rc = RC_PAGE_NOT_EXCLUSIVE;
+    if (rc == RC_OK) {
+        ATOMIC_WRITE(mgmt->dirtyBits[frameIdx], 1); // Mark the matching page as dirty
+        // The exclusive latch already made the version odd; a change without
+        // it is seen by moving the version on by a whole step
+        if (!exclusive)
+            bumpVersion(mgmt, frameIdx, 2);
     }
+    unlockPartition(mgmt, page->pageNum);
 
-    return RC_ERROR; // Return an error if no matching page was found
+    return rc;
 }
 
 
 
 extern RC unpinPage(BM_BufferPool *const bufferMgr, BM_PageHandle *const page) {
-    PageFrame *frames = (PageFrame *)bufferMgr->mgmtData;
-    int pageIndex = 0; // Initialize outside the while loop
-
-    // Use a while loop to search for the matching page
-    while (pageIndex < bufferSize) {
-        // Using an implicit check to determine if the page number matches
-        int isMatch = (frames[pageIndex].pageNum == page->pageNum);
-        
-        // Decrease fixCount if isMatch is true, won't change anything if false
-        frames[pageIndex].fixCount -= isMatch;
-
-        // Exit the loop if a match was found
-        if (isMatch) {
-            return RC_OK;
-        }
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bufferMgr->mgmtData;
+
+    // A page pinned straight from the mapped file holds no frame, only its
+    // mapping
+    MapRegion *region = mgmt->mapping != NULL ? mappedRegion(mgmt, page->data) : NULL;
+    if (region != NULL) {
+        releaseMapping(mgmt, region);
+        page->data = NULL;
+        return RC_OK;
+    }
 
-        pageIndex++; // Increment at the end of the while loop
+    lockPartition(mgmt, page->pageNum);
+    int pageIndex = lookupFrame(mgmt, page->pageNum);
+
+    // Decrease fixCount of the matching frame, nothing to do if the page is not buffered
+    bool unpinned = pageIndex != -1 && ATOMIC_READ(mgmt->fixCounts[pageIndex]) > 0;
+    // Give up the page latch while the pin still holds the frame
+    if (unpinned && holdsLatch(mgmt, page, pageIndex)) {
+        if (page->latch == BM_LATCH_EXCLUSIVE)
+            bumpVersion(mgmt, pageIndex, 1); // Optimistic reads may go on
+        unlatch(&mgmt->pageLatches[pageIndex], page->latch);
+        forgetLatch(&mgmt->pageLatches[pageIndex]);
     }
+    page->latch = BM_LATCH_NONE;
+    if (unpinned)
+        __atomic_sub_fetch(&mgmt->fixCounts[pageIndex], 1, __ATOMIC_RELEASE);
+    unlockPartition(mgmt, page->pageNum);
+
+    // The page was just used, make it the most recent one
+    if (unpinned && mgmt->recencyList)
+        referenceFrame(mgmt, pageIndex, page->pageNum, 0);
+
     return RC_OK; // Assuming every unpin operation is considered successful
 }
 
 
 extern RC forcePage(BM_BufferPool *const bufferMgr, BM_PageHandle *const page) {
-    PageFrame *frames = (PageFrame *)bufferMgr->mgmtData;
-    int pageIndex = 0; // Initialize outside the while loop
-    SM_FileHandle fileHandle;
-
-    // Open the page file outside the loop to avoid repeated opening
-    RC openResult = openPageFile(bufferMgr->pageFile, &fileHandle);
-
-    // Proceed only if the file was successfully opened
-    if (openResult == RC_OK) {
-        while (pageIndex < bufferSize) {
-            int isMatch = (frames[pageIndex].pageNum == page->pageNum);
-            
-            // Perform write operation only if there's a match
-            if (isMatch) {
-                writeBlock(frames[pageIndex].pageNum, &fileHandle, frames[pageIndex].data);
-                frames[pageIndex].dirtyBit = 0;
-                writeCount++;
-                break; // Exit after processing the matched page
-            }
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bufferMgr->mgmtData;
+    long long start = nowNs();
+
+    // Pin the page for the write so it cannot be replaced meanwhile
+    lockPartition(mgmt, page->pageNum);
+    int pageIndex = lookupFrame(mgmt, page->pageNum);
+    if (pageIndex != -1)
+        ATOMIC_ADD(mgmt->fixCounts[pageIndex], 1);
+    unlockPartition(mgmt, page->pageNum);
+
+    // Perform write operation only if the page is buffered
+    RC rc = RC_OK;
+    if (pageIndex != -1) {
+        rc = waitForLoad(mgmt, &mgmt->frames[pageIndex]);
+        if (rc == RC_OK)
+            rc = writeBackPage(mgmt, &mgmt->frames[pageIndex]);
+        unpinFrame(mgmt, &mgmt->frames[pageIndex], false);
+    }
 
-            pageIndex++; // Increment at the end of the while loop
-        }
+    // With the file mapped, a forced page also goes from the page cache to the disk
+    if (rc == RC_OK && mgmt->mapping != NULL)
+        rc = syncMappedPage(mgmt, page->pageNum);
+    recordLatency(mgmt, FLUSH_LATENCY, start);
+    return rc;
+}
+
+// Pin pageNum if it is buffered; reference tells whether the pin counts as a
+// reference for the replacement strategy. Returns false on a miss, and also
+// when a pending read of the page failed, so the caller reads it again.
+static bool pinBuffered(BM_BufferPool *const bm, PageNumber pageNum, BM_PageHandle *const page, bool reference) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PageFrame *bufferPool = mgmt->frames;
+
+    // A hit is a single page table lookup regardless of the pool size
+    lockPartition(mgmt, pageNum);
+    int i = lookupFrame(mgmt, pageNum);
+    if (i == -1) {
+        unlockPartition(mgmt, pageNum);
+        return false;
     }
-    return RC_OK;
+    ATOMIC_ADD(mgmt->fixCounts[i], 1);
+    unlockPartition(mgmt, pageNum);
+
+    // The page may still be on its way in from disk
+    if (ATOMIC_READ(bufferPool[i].ioInProgress))
+        COUNT(mgmt, pinWaits, 1);
+    if (waitForLoad(mgmt, &bufferPool[i]) != RC_OK) {
+        unpinFrame(mgmt, &bufferPool[i], false);
+        return false;
+    }
+    // A page a bulk ring read enters the pool now, as a new page.
+    // Reading a prefetched page in already counted as its first reference.
+    if (!reference) {
+        // Leave the frame where the strategy has it
+    } else if (ATOMIC_READ(bufferPool[i].ringOwner) != 0 &&
+             __atomic_exchange_n(&bufferPool[i].ringOwner, 0, __ATOMIC_RELAXED) != 0) {
+        admitFrame(bm, &bufferPool[i]);
+    } else if (ATOMIC_READ(bufferPool[i].prefetched) == 0 ||
+               __atomic_exchange_n(&bufferPool[i].prefetched, 0, __ATOMIC_RELAXED) == 0) {
+        touchFrame(bm, &bufferPool[i]);
+    }
+
+    COUNT(mgmt, hits, 1);
+    page->pageNum = pageNum;
+    page->data = bufferPool[i].data;
+    page->latch = BM_LATCH_NONE;
+    return true;
 }
 
 extern RC pinPage(BM_BufferPool *const bm, BM_PageHandle *const page,
                   const PageNumber pageNum) {
-    PageFrame *bufferPool = (PageFrame *)bm->mgmtData;
-    bool isBufFull = true;
-
-    // Check if bufferPool[0] needs to be initialized
-    while (bufferPool[0].pageNum == -1) {
-        SM_FileHandle fileHandle;
-        openPageFile(bm->pageFile, &fileHandle);
-        bufferPool[0].data = (SM_PageHandle) malloc(PAGE_SIZE);
-        ensureCapacity(pageNum, &fileHandle);
-        readBlock(pageNum, &fileHandle, bufferPool[0].data);
-        bufferPool[0].pageNum = pageNum;
-        bufferPool[0].fixCount++;
-        rearIndex = hit = 0;
-        bufferPool[0].hitNum = hit;
-        bufferPool[0].refNum = 0;
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PageFrame *bufferPool = mgmt->frames;
+
+    if (pageNum < 0)
+        return RC_READ_NON_EXISTING_PAGE;
+    // Hits are timed on a sample only, the clock would cost as much as the hit
+    long long start = statPins++ % HIT_SAMPLE_RATE == 0 ? nowNs() : 0;
+    if (mgmt->readAheadMax > 0)
+        readAhead(bm, pageNum);
+    // Finish the prefetches that completed meanwhile so their frames are usable
+    if (ATOMIC_READ(mgmt->asyncReads) > 0)
+        pollAsyncIO(&mgmt->engine, 0);
+
+    while (true) {
+        int i;
+        if (pinBuffered(bm, pageNum, page, true)) {
+            if (start != 0)
+                recordLatency(mgmt, PIN_HIT_LATENCY, start);
+            return RC_OK;
+        }
+
+        // Miss: find a frame without holding any latch and read the page
+        start = start != 0 ? start : nowNs();
+        RC rc = readIntoFrame(bm, pageNum, false, &i);
+        if (rc != RC_OK)
+            return rc;
+        if (i == -1)
+            continue; // Another thread brought the page in meanwhile, use its frame instead
+
+        COUNT(mgmt, misses, 1);
+        recordLatency(mgmt, PIN_MISS_LATENCY, start);
         page->pageNum = pageNum;
-        page->data = bufferPool[0].data;
+        page->data = bufferPool[i].data;
+        page->latch = BM_LATCH_NONE;
+        return RC_OK;
+    }
+}
 
-        // Exit the function once the operation is completed
+// Pin pageNum for reading only. In a pool with mmapFile set a page that is
+// not buffered is not read into a frame: the handle points straight into the
+// mapped page file, without a copy and without taking a frame from the pool.
+// Such a page must not be written to and cannot be marked dirty, and it shows
+// the file as last written, not changes still waiting in a dirty frame that
+// is replaced later. A buffered page is pinned in its frame like with
+// pinPage, since the frame may be newer than the file. Without mmapFile this
+// is pinPage. Unpin with unpinPage, which clears page->data of a mapped page:
+// the mapping may go away once its last page is unpinned.
+extern RC pinPageReadOnly(BM_BufferPool *const bm, BM_PageHandle *const page,
+                          const PageNumber pageNum) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+
+    if (mgmt->mapping == NULL)
+        return pinPage(bm, page, pageNum);
+    if (pageNum < 0)
+        return RC_READ_NON_EXISTING_PAGE;
+    if (pinBuffered(bm, pageNum, page, true))
         return RC_OK;
+
+    // Read-only pins never grow the file, but the file may have grown since it
+    // was mapped. The pin holds a reference to the mapping until unpinPage.
+    MapRegion *region = holdMapping(mgmt);
+    if (pageNum >= ATOMIC_READ(region->numPages)) {
+        releaseMapping(mgmt, region);
+        if (pageNum >= ATOMIC_READ(mgmt->fileHandle.totalNumPages))
+            return RC_READ_NON_EXISTING_PAGE;
+        remapFile(mgmt);
+        region = holdMapping(mgmt);
+        if (pageNum >= ATOMIC_READ(region->numPages)) {
+            releaseMapping(mgmt, region);
+            return RC_ERROR;
+        }
+    }
+    page->pageNum = pageNum;
+    page->data = region->base + (size_t)pageNum * PAGE_SIZE;
+    page->latch = BM_LATCH_NONE;
+    return RC_OK;
+}
+
+// Pin pageNum like pinPage and take its page latch in shared mode. Any number
+// of threads can hold the shared latch of a page at once, for example of an
+// index root; a thread that wants the exclusive latch waits until they have
+// all unpinned the page, and new shared pins wait behind it. The page must
+// not be changed and markDirty fails with RC_PAGE_NOT_EXCLUSIVE. unpinPage
+// releases the latch. A thread that holds the page's exclusive latch gets
+// RC_LATCH_HELD, one that holds the shared latch takes it once more.
+extern RC pinPageShared(BM_BufferPool *const bm, BM_PageHandle *const page,
+                        const PageNumber pageNum) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    RC rc = pinPage(bm, page, pageNum);
+
+    if (rc != RC_OK)
+        return rc;
+    int *word = &mgmt->pageLatches[handleFrame(mgmt, page)];
+    BM_LatchMode held = heldMode(word);
+    if (held == BM_LATCH_EXCLUSIVE) {
+        unpinPage(bm, page); // The latch would never come
+        return RC_LATCH_HELD;
     }
+    // A waiting writer waits for this thread's shared latch anyway, so the
+    // thread goes ahead of it instead of waiting for it
+    if (held == BM_LATCH_SHARED)
+        __atomic_add_fetch(word, 1, __ATOMIC_ACQUIRE);
+    else
+        latchShared(word);
+    rememberLatch(word, BM_LATCH_SHARED);
+    page->latch = BM_LATCH_SHARED;
+    return RC_OK;
+}
 
-    // Iterate through bufferPool to find an available slot or match pageNum
-    int i = 0;
-    while (i < bufferSize && isBufFull) {
-        if (bufferPool[i].pageNum != -1) {
-            if (bufferPool[i].pageNum == pageNum) {
-                bufferPool[i].fixCount++;
-                isBufFull = false;
-                hit++;
-
-                if (bm->strategy == RS_LRU)
-                    bufferPool[i].hitNum = hit;
-                else if (bm->strategy == RS_CLOCK)
-                    bufferPool[i].hitNum = 1;
-                else if (bm->strategy == RS_LFU)
-                    bufferPool[i].refNum++;
-
-                page->pageNum = pageNum;
-                page->data = bufferPool[i].data;
-                clockPointer++;
-                break;
-            }
-        } else {
-            SM_FileHandle fileHandle;
-            openPageFile(bm->pageFile, &fileHandle);
-            bufferPool[i].data = (SM_PageHandle) malloc(PAGE_SIZE);
-            readBlock(pageNum, &fileHandle, bufferPool[i].data);
-            bufferPool[i].pageNum = pageNum;
-            bufferPool[i].fixCount = 1;
-            bufferPool[i].refNum = 0;
-            rearIndex++;
-            hit++;
-
-            if (bm->strategy == RS_LRU)
-                bufferPool[i].hitNum = hit;
-            else if (bm->strategy == RS_CLOCK)
-                bufferPool[i].hitNum = 1;
-
-            page->pageNum = pageNum;
-            page->data = bufferPool[i].data;
-            isBufFull = false;
-            break;
+// Pin pageNum like pinPage and take its page latch in exclusive mode, waiting
+// until no other thread holds it. Only then can the page be changed and
+// marked dirty. unpinPage releases the latch. Pins without a latch (pinPage)
+// are not kept out; callers that change pages use the latched pins. A thread
+// that already latched the page, in either mode, gets RC_LATCH_HELD.
+extern RC pinPageExclusive(BM_BufferPool *const bm, BM_PageHandle *const page,
+                           const PageNumber pageNum) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    RC rc = pinPage(bm, page, pageNum);
+
+    if (rc != RC_OK)
+        return rc;
+    int *word = &mgmt->pageLatches[handleFrame(mgmt, page)];
+    if (heldMode(word) != BM_LATCH_NONE) {
+        unpinPage(bm, page); // The latch would never come
+        return RC_LATCH_HELD;
+    }
+    latchExclusive(word);
+    rememberLatch(word, BM_LATCH_EXCLUSIVE);
+    bumpVersion(mgmt, handleFrame(mgmt, page), 1); // Optimistic reads wait or fail from here on
+    page->latch = BM_LATCH_EXCLUSIVE;
+    return RC_OK;
+}
+
+// Find pageNum's frame without any latch. The page table may change during
+// the walk, so the walk is bounded and the caller checks what it finds.
+static int peekFrame(const BM_PoolMgmt *mgmt, PageNumber pageNum) {
+    int idx = __atomic_load_n(&mgmt->buckets[hashPage(mgmt, pageNum)], __ATOMIC_ACQUIRE);
+
+    for (int steps = 0; idx != -1 && steps < mgmt->bufferSize; steps++) {
+        if (ATOMIC_READ(mgmt->frames[idx].pageNum) == pageNum)
+            return idx;
+        idx = __atomic_load_n(&mgmt->frames[idx].hashNext, __ATOMIC_ACQUIRE);
+    }
+    return -1;
+}
+
+// Start an optimistic read of pageNum: read->data points at the page in its
+// frame, which is neither pinned nor latched, so the read writes nothing that
+// other threads read and readers of the same page never touch each other's
+// cache lines. The page may be replaced or changed at any time meanwhile.
+// Copy out what you need, without following pointers into the page, then call
+// validateOptimisticRead; on RC_READ_CONFLICT throw the copy away and start
+// again. A page that is not buffered is read in with pinPage first, and the
+// read waits while a writer holds the page's exclusive latch. Changes made
+// under a plain pinPage are only detected once the page is marked dirty, so
+// writers that race with optimistic readers use pinPageExclusive.
+extern RC startOptimisticRead(BM_BufferPool *const bm, BM_OptimisticRead *const read,
+                              const PageNumber pageNum) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    BM_PageHandle page;
+
+    if (pageNum < 0)
+        return RC_READ_NON_EXISTING_PAGE;
+
+    while (true) {
+        int i = peekFrame(mgmt, pageNum);
+        if (i == -1) {
+            RC rc = pinPage(bm, &page, pageNum);
+            if (rc != RC_OK)
+                return rc;
+            unpinPage(bm, &page);
+            continue;
+        }
+
+        // The version first: if it still holds at validation, so does everything read after it
+        int version = __atomic_load_n(&mgmt->versions[i], __ATOMIC_ACQUIRE);
+        if ((version & 1) == 0 && ATOMIC_READ(mgmt->frames[i].pageNum) == pageNum &&
+            __atomic_load_n(&mgmt->frames[i].ioInProgress, __ATOMIC_ACQUIRE) == 0) {
+            read->pageNum = pageNum;
+            read->data = mgmt->frames[i].data;
+            read->version = version;
+            return RC_OK;
         }
-        i++;
+        sched_yield(); // The page is being read, replaced or changed
     }
+}
 
-    // If buffer is full, apply replacement algorithm
-    if (isBufFull) {
-        PageFrame *newPage = (PageFrame *) malloc(sizeof(PageFrame));
-        SM_FileHandle fileHandle;
-        openPageFile(bm->pageFile, &fileHandle);
-        newPage->data = (SM_PageHandle) malloc(PAGE_SIZE);
-        readBlock(pageNum, &fileHandle, newPage->data);
-        newPage->pageNum = pageNum;
-        newPage->dirtyBit = 0;
-        newPage->fixCount = 1;
-        newPage->refNum = 0;
-        rearIndex++;
-        hit++;
+// RC_OK if the page did not change since startOptimisticRead, so everything
+// read from read->data meanwhile is a consistent copy of the page
+extern RC validateOptimisticRead(BM_BufferPool *const bm, const BM_OptimisticRead *const read) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    int frameIdx = (int)((read->data - mgmt->arena) / PAGE_SIZE);
 
-        if (bm->strategy == RS_LRU)
-            newPage->hitNum = hit;
-        else if (bm->strategy == RS_CLOCK)
-            newPage->hitNum = 1;
+    // The reads of the page must not move past the version check
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return ATOMIC_READ(mgmt->versions[frameIdx]) == read->version ? RC_OK : RC_READ_CONFLICT;
+}
 
-        page->pageNum = pageNum;
-        page->data = newPage->data;
-
-        // Apply the replacement algorithm based on the strategy
-        if (bm->strategy == RS_FIFO)
-            FIFO(bm, newPage);
-        else if (bm->strategy == RS_LRU)
-            LRU(bm, newPage);
-        else if (bm->strategy == RS_CLOCK)
-            CLOCK(bm, newPage);
-        else if (bm->strategy == RS_LFU)
-            LFU(bm, newPage);
-        else if (bm->strategy == RS_LRU_K)
-            printf("\n LRU-k algorithm not implemented");
-        else
-            printf("\nAlgorithm Not Implemented\n");
+// Change the madvise hint for the mapped page file: sequential for scans,
+// random for point lookups. Does nothing without mmapFile.
+extern RC setAccessPattern(BM_BufferPool *const bm, BM_AccessPattern pattern) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+
+    if (mgmt->concurrent)
+        pthread_mutex_lock(&mgmt->mapLatch);
+    mgmt->accessPattern = pattern;
+    MapRegion *region = mgmt->mapping;
+    int rc = region != NULL ? madvise(region->base, (size_t)region->capacity * PAGE_SIZE, adviceFor(pattern)) : 0;
+    if (mgmt->concurrent)
+        pthread_mutex_unlock(&mgmt->mapLatch);
+    return rc == 0 ? RC_OK : RC_ERROR;
+}
 
-        // Exit the function once the operation is completed
+// Queue pages for the prefetch threads, so that later pins of them are hits
+// or wait for a read that is already in flight. Returns at once; pages that
+// are buffered already are skipped, and a full queue drops its oldest
+// requests, which a scan has most likely passed already. Without prefetch
+// threads but with asynchronous I/O the reads are submitted right away and
+// finish in later pool calls; otherwise this does nothing.
+extern RC prefetchPages(BM_BufferPool *const bm, const PageNumber *pageNums, int n) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    int queued = 0;
+
+    if (n < 0 || (n > 0 && pageNums == NULL))
+        return RC_ERROR;
+    if (mgmt->prefetchThreads == 0 && mgmt->asyncIO)
+        return submitPrefetches(mgmt, pageNums, n);
+    if (mgmt->prefetchThreads == 0)
         return RC_OK;
+
+    pthread_mutex_lock(&mgmt->prefetchLatch);
+    for (int k = 0; k < n; k++) {
+        if (pageNums[k] < 0)
+            continue;
+        lockPartition(mgmt, pageNums[k]);
+        bool buffered = lookupFrame(mgmt, pageNums[k]) != -1;
+        unlockPartition(mgmt, pageNums[k]);
+        if (buffered)
+            continue;
+
+        if (mgmt->prefetchQueued == mgmt->prefetchCapacity) {
+            mgmt->prefetchHead = (mgmt->prefetchHead + 1) % mgmt->prefetchCapacity;
+            mgmt->prefetchQueued--;
+        }
+        int tail = (mgmt->prefetchHead + mgmt->prefetchQueued) % mgmt->prefetchCapacity;
+        mgmt->prefetchQueue[tail] = pageNums[k];
+        mgmt->prefetchQueued++;
+        queued++;
     }
+    if (queued > 0)
+        pthread_cond_broadcast(&mgmt->prefetchWake);
+    pthread_mutex_unlock(&mgmt->prefetchLatch);
+    return RC_OK;
+}
 
-    // Return RC_OK if the operation is completed
+// Set up a ring of up to size frames (16 by default, at most an eighth of
+// the pool) for pinPageBulk
+extern RC initBulkRing(BM_BufferPool *const bm, BM_BulkRing *const ring, int size) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+
+    ring->size = MIN(size > 0 ? size : DEFAULT_RING_SIZE, MAX(mgmt->bufferSize / 8, 1));
+    ring->frames = malloc(sizeof(int) * ring->size);
+    if (ring->frames == NULL)
+        return RC_ERROR;
+    for (int k = 0; k < ring->size; k++)
+        ring->frames[k] = -1;
+    ring->next = 0;
+    ring->id = ATOMIC_ADD(mgmt->lastRingId, 1);
     return RC_OK;
 }
 
-extern PageNumber *getFrameContents(BM_BufferPool *const bm) {
-    PageNumber *frameContents = malloc(sizeof(PageNumber) * bufferSize);
-    PageFrame *pageFrame = (PageFrame *)bm->mgmtData;
-    
-    for (int i = 0; i < bufferSize; i++) {
-        frameContents[i] = pageFrame[i].pageNum != -1 ? pageFrame[i].pageNum : NO_PAGE;
-    }
-    
-    return frameContents;
+// The ring's frames stay where they are, at the cold end of the replacement
+// strategy, and are the first ones the pool replaces
+extern RC freeBulkRing(BM_BufferPool *const bm, BM_BulkRing *const ring) {
+    (void)bm; // The ring owns its slot list, the pool has nothing to undo
+    free(ring->frames);
+    ring->frames = NULL;
+    ring->size = 0;
+    return RC_OK;
 }
 
+// Pin a page for a scan or bulk load. A buffered page is pinned like with
+// pinPage but gets no credit from the replacement strategy. A page that has
+// to be read goes into the next frame of the ring, replacing the page the
+// ring read into it one round earlier, and is parked at the cold end of the
+// replacement strategy instead of being ranked with the pool's other pages.
+// A large scan therefore only ever cycles through the ring's frames and
+// leaves the rest of the pool alone. If another caller pins a page from the
+// ring with pinPage, the page joins the pool as a normal page and the ring
+// takes a different frame for that slot next time. Unpin with unpinPage.
+extern RC pinPageBulk(BM_BufferPool *const bm, BM_PageHandle *const page,
+                      const PageNumber pageNum, BM_BulkRing *const ring) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PageFrame *bufferPool = mgmt->frames;
+
+    if (ring == NULL || ring->frames == NULL)
+        return pinPage(bm, page, pageNum);
+    if (pageNum < 0)
+        return RC_READ_NON_EXISTING_PAGE;
+
+    while (true) {
+        int i;
+        if (pinBuffered(bm, pageNum, page, false))
+            return RC_OK;
 
-extern bool *getDirtyFlags(BM_BufferPool *const bm) {
-    bool *dirtyFlags = malloc(sizeof(bool) * bufferSize);
-    PageFrame *pageFrame = (PageFrame *)bm->mgmtData;
-    
-    // Using a while loop for consistency with previous adjustments
-    int index = 0;
-    while (index < bufferSize) {
-        dirtyFlags[index] = pageFrame[index].dirtyBit ? true : false;
-        index++;
+        RC rc = ringFrame(bm, ring, &i);
+        if (rc != RC_OK)
+            return rc;
+        if (!publishFrame(mgmt, i, pageNum, false))
+            continue; // Somebody else read the page meanwhile, the frame stays in the ring
+
+        rc = loadPage(mgmt, pageNum, bufferPool[i].data);
+        if (rc != RC_OK) {
+            ring->frames[(ring->next + ring->size - 1) % ring->size] = -1;
+            ATOMIC_WRITE(bufferPool[i].ringOwner, 0);
+            failLoad(mgmt, i);
+            return rc;
+        }
+        ATOMIC_ADD(mgmt->rearIndex, 1);
+        COUNT(mgmt, reads, 1);
+        COUNT(mgmt, misses, 1);
+        parkFrame(mgmt, &bufferPool[i]);
+        __atomic_store_n(&bufferPool[i].ioInProgress, 0, __ATOMIC_RELEASE);
+
+        page->pageNum = pageNum;
+        page->data = bufferPool[i].data;
+        page->latch = BM_LATCH_NONE;
+        return RC_OK;
     }
-    
-    return dirtyFlags;
 }
 
+// Pin n pages at once, pages[k] gets page pageNums[k]. Buffered pages are
+// pinned first. The misses are then sorted by page number, get their frames
+// from the replacement strategy one right after the other, and every run of
+// adjacent pages is read with one vectored read instead of one read per page.
+// Either all pages end up pinned or none are and the error is returned, so a
+// batch with more distinct new pages than there are free frames fails as a
+// whole. A page may appear more than once and is then pinned once per
+// appearance. Unpin each handle with unpinPage.
+extern RC pinPages(BM_BufferPool *const bm, BM_PageHandle *const pages,
+                   const PageNumber *pageNums, int n) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PageFrame *bufferPool = mgmt->frames;
+    RC rc = RC_OK;
+    int misses = 0, claimed = 0, start = -1, k;
+
+    if (n < 0 || (n > 0 && (pages == NULL || pageNums == NULL)))
+        return RC_ERROR;
+    for (k = 0; k < n; k++)
+        if (pageNums[k] < 0)
+            return RC_READ_NON_EXISTING_PAGE;
+
+    PageSlot *requests = malloc(sizeof(PageSlot) * (n + 1));
+    int *frameIdx = malloc(sizeof(int) * (n + 1));
+    bool *pinned = calloc(n + 1, sizeof(bool));
+    AsyncSegment *segments = malloc(sizeof(AsyncSegment) * (n + 1));
+    int numSegments = 0, pending = 0;
+    if (requests == NULL || frameIdx == NULL || pinned == NULL || segments == NULL) {
+        free(requests);
+        free(frameIdx);
+        free(pinned);
+        free(segments);
+        return RC_ERROR;
+    }
 
-extern int *getFixCounts(BM_BufferPool *const bm) {
-    int *fixCounts = malloc(sizeof(int) * bufferSize);
-    PageFrame *pageFrame = (PageFrame *)bm->mgmtData;
+    // Hits first, they need neither a frame nor I/O
+    for (k = 0; k < n; k++) {
+        if (pinBuffered(bm, pageNums[k], &pages[k], true)) {
+            pinned[k] = true;
+            continue;
+        }
+        requests[misses].pageNum = pageNums[k];
+        requests[misses++].slot = k;
+    }
+    qsort(requests, misses, sizeof(PageSlot), comparePageSlots);
+
+    // Grow the file once for the whole batch instead of page by page
+    if (misses > 0)
+        rc = growFile(mgmt, requests[misses - 1].pageNum + 1);
+
+    // Take a frame for every distinct missing page before any of them is read.
+    // A page someone else mapped meanwhile gets frameIdx -1 and is pinned below.
+    for (k = 0; rc == RC_OK && k < misses; k++, claimed++) {
+        frameIdx[k] = -1;
+        if (k > 0 && requests[k].pageNum == requests[k - 1].pageNum)
+            continue;
+        rc = publishRead(bm, requests[k].pageNum, false, &frameIdx[k]);
+    }
+
+    // One read per run of adjacent pages; once a read failed the remaining
+    // frames are given up unread. With asynchronous I/O all runs are submitted
+    // before the first one is waited for.
+    for (k = 0; k <= claimed; k++) {
+        bool extends = start != -1 && k < claimed && frameIdx[k] != -1 &&
+                       requests[k].pageNum == requests[k - 1].pageNum + 1 &&
+                       k - start < MAX_IO_PAGES;
+        if (start != -1 && !extends) {
+            AsyncSegment *segment = &segments[numSegments++];
+            *segment = (AsyncSegment){mgmt, &frameIdx[start], k - start, false, rc, &pending, -1};
+            if (rc != RC_OK)
+                segmentRead(mgmt, segment->frameIdx, segment->n, false, rc);
+            else if (mgmt->asyncIO)
+                rc = submitSegment(mgmt, requests[start].pageNum, segment);
+            else
+                rc = segment->rc = readSegment(bm, requests[start].pageNum, segment->frameIdx, segment->n, false);
+            start = -1;
+        }
+        if (start == -1 && k < claimed && frameIdx[k] != -1)
+            start = k;
+    }
+    if (mgmt->asyncIO)
+        waitForPending(mgmt, &pending);
+    for (int s = 0; s < numSegments; s++) {
+        if (segments[s].rc != RC_OK) {
+            rc = rc == RC_OK ? segments[s].rc : rc;
+            continue;
+        }
+        for (int j = segments[s].frameIdx - frameIdx; j < segments[s].frameIdx - frameIdx + segments[s].n; j++) {
+            int slot = requests[j].slot;
+            pages[slot].pageNum = requests[j].pageNum;
+            pages[slot].data = bufferPool[frameIdx[j]].data;
+            pages[slot].latch = BM_LATCH_NONE;
+            pinned[slot] = true;
+        }
+        COUNT(mgmt, misses, segments[s].n);
+    }
+
+    // Repeated pages and pages another thread read first are hits by now
+    for (k = 0; rc == RC_OK && k < misses; k++) {
+        int slot = requests[k].slot;
+        if (pinned[slot])
+            continue;
+        rc = pinPage(bm, &pages[slot], requests[k].pageNum);
+        pinned[slot] = rc == RC_OK;
+    }
+
+    // All or nothing
+    if (rc != RC_OK)
+        for (k = 0; k < n; k++)
+            if (pinned[k])
+                unpinPage(bm, &pages[k]);
+
+    free(requests);
+    free(frameIdx);
+    free(pinned);
+    free(segments);
+    return rc;
+}
 
-    for (int index = 0; index < bufferSize; index++) {
-        // Assuming the fixCount check against -1 is not needed based on the assumption of non-negative fixCounts
-        fixCounts[index] = pageFrame[index].fixCount;
+// Copy the state of frames snapshot->firstFrame onwards into the caller's
+// arrays, at most snapshot->numFrames of them, in one pass over the frames
+// and without allocating. Arrays left NULL are skipped. On return numFrames
+// is the number of frames copied. Frames other threads change meanwhile may
+// be seen before or after the change, each field on its own.
+extern RC getPoolSnapshot(BM_BufferPool *const bm, BM_PoolSnapshot *snapshot) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    PageFrame *pageFrame = mgmt->frames;
+
+    if (snapshot == NULL || snapshot->firstFrame < 0 || snapshot->numFrames < 0)
+        return RC_ERROR;
+
+    int first = MIN(snapshot->firstFrame, mgmt->bufferSize);
+    int n = MIN(snapshot->numFrames, mgmt->bufferSize - first);
+    for (int k = 0; k < n; k++) {
+        PageFrame *frame = &pageFrame[first + k];
+        if (snapshot->pageNums != NULL)
+            snapshot->pageNums[k] = ATOMIC_READ(frame->pageNum);
+        if (snapshot->dirty != NULL)
+            snapshot->dirty[k] = ATOMIC_READ(DIRTY_BIT(mgmt, frame)) ? true : false;
+        if (snapshot->fixCounts != NULL)
+            snapshot->fixCounts[k] = ATOMIC_READ(FIX_COUNT(mgmt, frame));
     }
+    snapshot->numFrames = n;
+    return RC_OK;
+}
+
+// The getters below return a new array per call, which the caller frees.
+// Prefer getPoolSnapshot for anything polled regularly.
+
+extern PageNumber *getFrameContents(BM_BufferPool *const bm) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    BM_PoolSnapshot snapshot = {.numFrames = mgmt->bufferSize};
+
+    snapshot.pageNums = malloc(sizeof(PageNumber) * mgmt->bufferSize);
+    if (snapshot.pageNums != NULL)
+        getPoolSnapshot(bm, &snapshot);
+    return snapshot.pageNums;
+}
+
+
+extern bool *getDirtyFlags(BM_BufferPool *const bm) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    BM_PoolSnapshot snapshot = {.numFrames = mgmt->bufferSize};
+
+    snapshot.dirty = malloc(sizeof(bool) * mgmt->bufferSize);
+    if (snapshot.dirty != NULL)
+        getPoolSnapshot(bm, &snapshot);
+    return snapshot.dirty;
+}
+
+
+extern int *getFixCounts(BM_BufferPool *const bm) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+    BM_PoolSnapshot snapshot = {.numFrames = mgmt->bufferSize};
 
-    return fixCounts;
+    snapshot.fixCounts = malloc(sizeof(int) * mgmt->bufferSize);
+    if (snapshot.fixCounts != NULL)
+        getPoolSnapshot(bm, &snapshot);
+    return snapshot.fixCounts;
 }
 
 
+// Pages read from the page file, counted per read rather than per frame fill
 extern int getNumReadIO(BM_BufferPool *const bm) {
-    return (rearIndex + 1);
+    BM_PoolStats stats;
+
+    getPoolStats(bm, &stats);
+    return (int)stats.reads;
 }
 
 extern int getNumWriteIO(BM_BufferPool *const bm) {
-    return writeCount;
+    return ATOMIC_READ(((BM_PoolMgmt *)bm->mgmtData)->writeCount);
+}
+
+// Dirty victims written inside pinPage, the writes the background writer is meant to avoid
+extern int getNumSyncWriteIO(BM_BufferPool *const bm) {
+    return ATOMIC_READ(((BM_PoolMgmt *)bm->mgmtData)->syncWriteCount);
+}
+
+extern int getNumBackgroundWriteIO(BM_BufferPool *const bm) {
+    return ATOMIC_READ(((BM_PoolMgmt *)bm->mgmtData)->backgroundWriteCount);
+}
+
+// Pages read before anybody pinned them, by the prefetch threads or by the
+// sequential read-ahead; also included in getNumReadIO
+extern int getNumPrefetchIO(BM_BufferPool *const bm) {
+    return ATOMIC_READ(((BM_PoolMgmt *)bm->mgmtData)->prefetchReadCount);
+}
+
+// Fill stats with the pool's counters and histograms so far. The shards are
+// added up without stopping anybody, so a snapshot taken while other threads
+// pin pages may be off by the operations in flight.
+extern RC getPoolStats(BM_BufferPool *const bm, BM_PoolStats *stats) {
+    BM_PoolMgmt *mgmt = (BM_PoolMgmt *)bm->mgmtData;
+
+    if (stats == NULL)
+        return RC_ERROR;
+    memset(stats, 0, sizeof(BM_PoolStats));
+    BM_LatencyHistogram *latency[NUM_LATENCIES] = {&stats->pinHit, &stats->pinMiss, &stats->flush};
+    for (int s = 0; s < STAT_SHARDS; s++) {
+        StatShard *shard = &mgmt->stats[s];
+        stats->hits += ATOMIC_READ(shard->hits);
+        stats->misses += ATOMIC_READ(shard->misses);
+        stats->pinWaits += ATOMIC_READ(shard->pinWaits);
+        stats->reads += ATOMIC_READ(shard->reads);
+        stats->evictions += ATOMIC_READ(shard->evictions);
+        stats->syncEvictions += ATOMIC_READ(shard->syncEvictions);
+        for (int h = 0; h < NUM_LATENCIES; h++) {
+            latency[h]->count += ATOMIC_READ(shard->latency[h].count);
+            latency[h]->totalNs += ATOMIC_READ(shard->latency[h].totalNs);
+            for (int b = 0; b < BM_LATENCY_BUCKETS; b++)
+                latency[h]->buckets[b] += ATOMIC_READ(shard->latency[h].buckets[b]);
+        }
+    }
+    stats->pins = stats->hits + stats->misses;
+    stats->writes = ATOMIC_READ(mgmt->writeCount);
+    stats->dirtyEvictions = ATOMIC_READ(mgmt->syncWriteCount);
+    stats->backgroundWrites = ATOMIC_READ(mgmt->backgroundWriteCount);
+    stats->prefetchReads = ATOMIC_READ(mgmt->prefetchReadCount);
+    stats->prefetchWrites = ATOMIC_READ(mgmt->prefetchWriteCount);
+    return RC_OK;
 }
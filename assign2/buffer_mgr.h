@@ -13,7 +13,9 @@ typedef enum ReplacementStrategy {
   RS_LRU = 1,
   RS_CLOCK = 2,
   RS_LFU = 3,
-  RS_LRU_K = 4
+  RS_LRU_K = 4,
+  RS_ARC = 5,
+  RS_GCLOCK = 6
 } ReplacementStrategy;
 
 // Data Types and Structures
@@ -28,22 +30,95 @@ typedef struct BM_BufferPool {
                   // manager needs for a buffer pool
 } BM_BufferPool;
 
+// The page latch a handle holds, see pinPageShared and pinPageExclusive
+typedef enum BM_LatchMode {
+  BM_LATCH_NONE = 0,
+  BM_LATCH_SHARED = 1,
+  BM_LATCH_EXCLUSIVE = 2
+} BM_LatchMode;
+
 typedef struct BM_PageHandle {
   PageNumber pageNum;
   char *data;
+  BM_LatchMode latch; // set by the pin functions, released by unpinPage
 } BM_PageHandle;
 
+// An optimistic read of a page, see startOptimisticRead
+typedef struct BM_OptimisticRead {
+  PageNumber pageNum;
+  char *data;   // the page in its frame, only trustworthy once validated
+  int version;  // the frame's version when the read started
+} BM_OptimisticRead;
+
+// madvise hints for a pool with mmapFile set
+typedef enum BM_AccessPattern {
+  BM_ACCESS_NORMAL = 0,
+  BM_ACCESS_SEQUENTIAL = 1,
+  BM_ACCESS_RANDOM = 2
+} BM_AccessPattern;
+
+// Optional settings for initBufferPoolWithOptions, zero means default
+typedef struct BM_PoolOptions {
+  bool concurrent;    // pool may be used by several threads at once
+  int numPartitions;  // page table latch partitions in concurrent mode
+  bool hugePages;     // back the frame arena with huge pages when available
+  bool backgroundWriter; // clean dirty frames ahead of eviction in a thread, implies concurrent
+  int writerDelayMs;  // pause between background writer rounds (default 10)
+  int writerBatchSize; // pages written per round at most (default 16)
+  int prefetchThreads; // threads reading the pages passed to prefetchPages, 0 disables it, implies concurrent
+  int prefetchQueueSize; // pages waiting for a prefetch thread at most (default numPages)
+  int readAheadPages; // largest window read ahead of a sequential scan, 0 disables read-ahead
+  int flushThreads;   // threads sharing the writes of forceFlushPool (default 1)
+  bool mmapFile;      // map the page file for zero-copy pinPageReadOnly
+  BM_AccessPattern accessPattern; // madvise hint for the mapping
+  bool directIO;      // bypass the page cache with O_DIRECT where the file system allows it
+  int ioQueueDepth;   // asynchronous reads and writes in flight at most, 0 keeps all I/O synchronous
+  int fileExtentPages; // disk space the pool reserves at a time when it grows the file, 0 grows it page by page
+  bool strictLatches;  // markDirty only accepts pages pinned with pinPageExclusive
+  int referenceBatch;  // hits a thread queues for LRU, LFU, LRU-K and ARC in concurrent mode (default 32), 1 applies each at once
+} BM_PoolOptions;
+
+// stratData for RS_LRU_K, NULL or zero fields mean default
+typedef struct BM_LRUKParams {
+  int k;                 // references remembered per page (default 2)
+  int correlatedPeriod;  // pins within this many references of a page's last one count as one
+  int historySize;       // evicted pages whose history is retained (default numPages)
+} BM_LRUKParams;
+
+// stratData for RS_LFU, NULL means no aging
+typedef struct BM_LFUParams {
+  int agingInterval;     // halve every frame's reference count after this many references, 0 never
+} BM_LFUParams;
+
+// stratData for RS_GCLOCK, NULL or zero fields mean default
+typedef struct BM_GClockParams {
+  int maxCount;          // cap of a frame's reference counter (default 4)
+  int initialCount;      // counter of a freshly read page (default 1)
+} BM_GClockParams;
+
+// A private ring of frames for scans and bulk loads, see pinPageBulk.
+// Used by one thread at a time.
+typedef struct BM_BulkRing {
+  int id;          // tags the frames holding pages the ring read
+  int size;        // frames in the ring
+  int next;        // slot whose frame is reused next
+  int *frames;     // frame of each slot, -1 while the slot has none
+} BM_BulkRing;
+
 // convenience macros
 #define MAKE_POOL()					\
   ((BM_BufferPool *) malloc (sizeof(BM_BufferPool)))
 
 #define MAKE_PAGE_HANDLE()				\
-  ((BM_PageHandle *) malloc (sizeof(BM_PageHandle)))
+  ((BM_PageHandle *) calloc (1, sizeof(BM_PageHandle)))
 
 // Buffer Manager Interface Pool Handling
 RC initBufferPool(BM_BufferPool *const bm, const char *const pageFileName, 
 		  const int numPages, ReplacementStrategy strategy, 
 		  void *stratData);
+RC initBufferPoolWithOptions(BM_BufferPool *const bm, const char *const pageFileName,
+		  const int numPages, ReplacementStrategy strategy,
+		  void *stratData, const BM_PoolOptions *options);
 RC shutdownBufferPool(BM_BufferPool *const bm);
 RC forceFlushPool(BM_BufferPool *const bm);
 
@@ -53,12 +128,75 @@ RC unpinPage (BM_BufferPool *const bm, BM_PageHandle *const page);
 RC forcePage (BM_BufferPool *const bm, BM_PageHandle *const page);
 RC pinPage (BM_BufferPool *const bm, BM_PageHandle *const page, 
 	    const PageNumber pageNum);
+RC prefetchPages (BM_BufferPool *const bm, const PageNumber *pageNums, int n);
+RC pinPages (BM_BufferPool *const bm, BM_PageHandle *const pages,
+	     const PageNumber *pageNums, int n);
+RC pinPageReadOnly (BM_BufferPool *const bm, BM_PageHandle *const page,
+		    const PageNumber pageNum);
+RC pinPageShared (BM_BufferPool *const bm, BM_PageHandle *const page,
+		  const PageNumber pageNum);
+RC pinPageExclusive (BM_BufferPool *const bm, BM_PageHandle *const page,
+		     const PageNumber pageNum);
+RC startOptimisticRead (BM_BufferPool *const bm, BM_OptimisticRead *const read,
+			const PageNumber pageNum);
+RC validateOptimisticRead (BM_BufferPool *const bm, const BM_OptimisticRead *const read);
+RC setAccessPattern (BM_BufferPool *const bm, BM_AccessPattern pattern);
+
+// Latencies in log2 buckets: bucket b counts the operations that took
+// 2^b to 2^(b+1) - 1 ns, the last bucket also everything slower
+#define BM_LATENCY_BUCKETS 32
+
+typedef struct BM_LatencyHistogram {
+  long long count;
+  long long totalNs;
+  long long buckets[BM_LATENCY_BUCKETS];
+} BM_LatencyHistogram;
+
+// A snapshot of a pool's counters since initBufferPool, see getPoolStats
+typedef struct BM_PoolStats {
+  long long pins;             // hits + misses
+  long long hits;             // pins of a buffered page
+  long long misses;           // pins that read their page
+  long long pinWaits;         // hits that waited for the page's read in flight
+  long long reads;            // pages read from the file, prefetches included
+  long long prefetchReads;    // pages read ahead of any pin
+  long long writes;           // pages written to the file
+  long long backgroundWrites; // pages cleaned by the background writer
+  long long evictions;        // pages replaced to make room
+  long long syncEvictions;    // evictions a pin waited for, not a prefetch
+  long long dirtyEvictions;   // evictions by pins that wrote their page back first
+  long long prefetchWrites;   // dirty pages written back to make room for a prefetch
+  BM_LatencyHistogram pinHit;  // pinPage hits, a sample of one in 16
+  BM_LatencyHistogram pinMiss; // pinPage misses
+  BM_LatencyHistogram flush;   // forceFlushPool and forcePage calls
+} BM_PoolStats;
+
+// Frame state copied by getPoolSnapshot into arrays the caller owns, entry k
+// for frame firstFrame + k. Arrays left NULL are not filled.
+typedef struct BM_PoolSnapshot {
+  int firstFrame;
+  int numFrames;          // entries each array holds; frames copied on return
+  PageNumber *pageNums;   // NO_PAGE for an empty frame
+  bool *dirty;
+  int *fixCounts;
+} BM_PoolSnapshot;
+
+// Bulk reads through a ring of frames
+RC initBulkRing (BM_BufferPool *const bm, BM_BulkRing *const ring, int size);
+RC freeBulkRing (BM_BufferPool *const bm, BM_BulkRing *const ring);
+RC pinPageBulk (BM_BufferPool *const bm, BM_PageHandle *const page,
+		const PageNumber pageNum, BM_BulkRing *const ring);
 
 // Statistics Interface
+RC getPoolSnapshot (BM_BufferPool *const bm, BM_PoolSnapshot *snapshot);
 PageNumber *getFrameContents (BM_BufferPool *const bm);
 bool *getDirtyFlags (BM_BufferPool *const bm);
 int *getFixCounts (BM_BufferPool *const bm);
 int getNumReadIO (BM_BufferPool *const bm);
 int getNumWriteIO (BM_BufferPool *const bm);
+int getNumSyncWriteIO (BM_BufferPool *const bm);
+int getNumBackgroundWriteIO (BM_BufferPool *const bm);
+int getNumPrefetchIO (BM_BufferPool *const bm);
+RC getPoolStats (BM_BufferPool *const bm, BM_PoolStats *stats);
 
 #endif
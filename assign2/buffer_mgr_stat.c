@@ -6,51 +6,64 @@
 
 // local functions
 static void printStrat (BM_BufferPool *const bm);
+static void printLatency (const char *name, const BM_LatencyHistogram *h);
+
+// frames copied per getPoolSnapshot call by the print functions
+#define SNAPSHOT_CHUNK 256
 
 // external functions
 void 
 printPoolContent (BM_BufferPool *const bm)
 {
-  PageNumber *frameContent;
-  bool *dirty;
-  int *fixCount;
+  PageNumber frameContent[SNAPSHOT_CHUNK];
+  bool dirty[SNAPSHOT_CHUNK];
+  int fixCount[SNAPSHOT_CHUNK];
+  BM_PoolSnapshot snapshot = { 0, 0, frameContent, dirty, fixCount };
   int i;
 
-  frameContent = getFrameContents(bm);
-  dirty = getDirtyFlags(bm);
-  fixCount = getFixCounts(bm);
-
   printf("{");
   printStrat(bm);
   printf(" %i}: ", bm->numPages); 
   
-  for (i = 0; i < bm->numPages; i++)
-      printf("%s[%i%s%i]", ((i == 0) ? "" : ",") , frameContent[i], (dirty[i] ? "x": " "), fixCount[i]);
+  for (snapshot.firstFrame = 0; snapshot.firstFrame < bm->numPages; snapshot.firstFrame += SNAPSHOT_CHUNK)
+    {
+      snapshot.numFrames = SNAPSHOT_CHUNK;
+      if (getPoolSnapshot(bm, &snapshot) != RC_OK)
+        break;
+      for (i = 0; i < snapshot.numFrames; i++)
+        printf("%s[%i%s%i]", ((snapshot.firstFrame + i == 0) ? "" : ",") , frameContent[i], (dirty[i] ? "x": " "), fixCount[i]);
+    }
   printf("\n");
 }
 
 char *
 sprintPoolContent (BM_BufferPool *const bm)
 {
-  PageNumber *frameContent;
-  bool *dirty;
-  int *fixCount;
+  PageNumber frameContent[SNAPSHOT_CHUNK];
+  bool dirty[SNAPSHOT_CHUNK];
+  int fixCount[SNAPSHOT_CHUNK];
+  BM_PoolSnapshot snapshot = { 0, 0, frameContent, dirty, fixCount };
   int i;
   char *message;
   int pos = 0;
 
   message = (char *) malloc(256 + (22 * bm->numPages));
-  frameContent = getFrameContents(bm);
-  dirty = getDirtyFlags(bm);
-  fixCount = getFixCounts(bm);
+  if (message == NULL)
+    return NULL;
+  message[0] = '\0';
 
-  for (i = 0; i < bm->numPages; i++)
-    pos += sprintf(message + pos, "%s[%i%s%i]", ((i == 0) ? "" : ",") , frameContent[i], (dirty[i] ? "x": " "), fixCount[i]);
+  for (snapshot.firstFrame = 0; snapshot.firstFrame < bm->numPages; snapshot.firstFrame += SNAPSHOT_CHUNK)
+    {
+      snapshot.numFrames = SNAPSHOT_CHUNK;
+      if (getPoolSnapshot(bm, &snapshot) != RC_OK)
+        break;
+      for (i = 0; i < snapshot.numFrames; i++)
+        pos += sprintf(message + pos, "%s[%i%s%i]", ((snapshot.firstFrame + i == 0) ? "" : ",") , frameContent[i], (dirty[i] ? "x": " "), fixCount[i]);
+    }
   
   return message;
 }
 
-
 void
 printPageContent (BM_PageHandle *const page)
 {
@@ -78,6 +91,51 @@ sprintPageContent (BM_PageHandle *const page)
   return message;
 }
 
+// upper bound in ns of the bucket holding the given fraction (0.5 for the
+// median, 0.99 for the 99th percentile) of the operations, 0 without any
+long long
+latencyPercentile (const BM_LatencyHistogram *h, double fraction)
+{
+  long long seen = 0;
+  int b;
+
+  if (h->count == 0)
+    return 0;
+  for (b = 0; b < BM_LATENCY_BUCKETS - 1; b++)
+    {
+      seen += h->buckets[b];
+      if (seen >= fraction * h->count)
+        break;
+    }
+  return (2LL << b) - 1;
+}
+
+void
+printPoolStats (BM_BufferPool *const bm)
+{
+  BM_PoolStats stats;
+
+  if (getPoolStats(bm, &stats) != RC_OK)
+    return;
+
+  printf("pins %lld: hits %lld (%.2f%%), misses %lld, waits %lld\n", stats.pins, stats.hits,
+         stats.pins > 0 ? 100.0 * stats.hits / stats.pins : 0.0, stats.misses, stats.pinWaits);
+  printf("reads %lld (prefetched %lld), writes %lld (background %lld)\n", stats.reads,
+         stats.prefetchReads, stats.writes, stats.backgroundWrites);
+  printf("evictions %lld: by pins %lld, dirty %lld, dirty for prefetches %lld\n", stats.evictions,
+         stats.syncEvictions, stats.dirtyEvictions, stats.prefetchWrites);
+  printLatency("pin hit", &stats.pinHit);
+  printLatency("pin miss", &stats.pinMiss);
+  printLatency("flush", &stats.flush);
+}
+
+void
+printLatency (const char *name, const BM_LatencyHistogram *h)
+{
+  printf("%-8s %10lld ops, mean %lld ns, p50 < %lld ns, p99 < %lld ns\n", name, h->count,
+         h->count > 0 ? h->totalNs / h->count : 0, latencyPercentile(h, 0.5), latencyPercentile(h, 0.99));
+}
+
 void
 printStrat (BM_BufferPool *const bm)
 {
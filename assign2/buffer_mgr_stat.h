@@ -9,4 +9,8 @@ void printPageContent (BM_PageHandle *const page);
 char *sprintPoolContent (BM_BufferPool *const bm);
 char *sprintPageContent (BM_PageHandle *const page);
 
+// statistics
+void printPoolStats (BM_BufferPool *const bm);
+long long latencyPercentile (const BM_LatencyHistogram *h, double fraction);
+
 #endif
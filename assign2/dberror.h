@@ -16,6 +16,10 @@ typedef int RC;
 #define RC_READ_NON_EXISTING_PAGE 4
 #define RC_ERROR 400 // Added a new definiton for ERROR
 #define RC_PINNED_PAGES_IN_BUFFER 500 // Added a new definition for Buffer Manager
+#define RC_NO_FREE_FRAME 501 // Added for Buffer Manager: every frame is pinned
+#define RC_PAGE_NOT_EXCLUSIVE 502 // Added for Buffer Manager: markDirty without the page's exclusive latch
+#define RC_READ_CONFLICT 503 // Added for Buffer Manager: the page changed during an optimistic read, retry it
+#define RC_LATCH_HELD 504 // Added for Buffer Manager: the thread already holds the page's latch
 
 #define RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE 200
 #define RC_RM_EXPR_RESULT_IS_NOT_BOOLEAN 201
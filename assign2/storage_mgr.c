@@ -1,14 +1,163 @@
+#define _GNU_SOURCE // O_DIRECT
 #include<stdio.h>
 #include<stdlib.h>
 #include<sys/stat.h>
 #include<sys/types.h>
 #include<unistd.h>
 #include<string.h>
+#include<stdbool.h>
 #include<math.h>
+#include<fcntl.h>
+#include<errno.h>
+#include<sys/uio.h>
+#include<stdint.h>
+#include<sys/mman.h>
+#include<pthread.h>
+#include<sched.h>
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include<linux/io_uring.h>
+#include<sys/syscall.h>
+#define HAVE_IO_URING
+#endif
 #include "storage_mgr.h"
 
 FILE *pageFile;
 
+// What an open SM_FileHandle keeps in mgmtInfo: the descriptor stays open
+// from openPageFile until closePageFile so block I/O never reopens the file.
+typedef struct SM_FileMgmt {
+    int fd;
+    bool direct; // opened with O_DIRECT, see openPageFileDirect
+    int extentPages;   // growth reserves disk space this many pages at a time, see setGrowthExtent
+    int reservedPages; // pages with disk space reserved, the file's size may be smaller
+} SM_FileMgmt;
+
+// Direct I/O moves data straight between the device and the caller's
+// buffer, so the buffer has to start on a block boundary.
+#define DIRECT_IO_ALIGN 4096
+
+static bool misaligned(SM_FileMgmt *fileMgmt, const void *buffer) {
+    return fileMgmt->direct && (uintptr_t)buffer % DIRECT_IO_ALIGN != 0;
+}
+
+static RC readPage(SM_FileHandle *fHandle, int pageNum, SM_PageHandle memPage);
+static RC writePage(SM_FileHandle *fHandle, int pageNum, SM_PageHandle memPage);
+
+// Read or write one page for a buffer direct I/O can't use, through an aligned copy.
+static RC bouncePage(SM_FileHandle *fHandle, int pageNum, SM_PageHandle memPage, bool write) {
+    void *aligned;
+    if (posix_memalign(&aligned, DIRECT_IO_ALIGN, PAGE_SIZE) != 0)
+        return write ? RC_WRITE_FAILED : RC_ERROR;
+
+    if (write)
+        memcpy(aligned, memPage, PAGE_SIZE);
+    RC rc = write ? writePage(fHandle, pageNum, aligned) : readPage(fHandle, pageNum, aligned);
+    if (!write && rc == RC_OK)
+        memcpy(memPage, aligned, PAGE_SIZE);
+    free(aligned);
+    return rc;
+}
+
+// Read one whole page with a positional read, the file offset is never touched.
+static RC readPage(SM_FileHandle *fHandle, int pageNum, SM_PageHandle memPage) {
+    SM_FileMgmt *fileMgmt = (SM_FileMgmt *)fHandle->mgmtInfo;
+    if (fileMgmt == NULL)
+        return RC_FILE_HANDLE_NOT_INIT;
+    if (misaligned(fileMgmt, memPage))
+        return bouncePage(fHandle, pageNum, memPage, false);
+
+    off_t offset = (off_t)pageNum * PAGE_SIZE;
+    size_t done = 0;
+    while (done < PAGE_SIZE) {
+        ssize_t n = pread(fileMgmt->fd, memPage + done, PAGE_SIZE - done, offset + done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n == 0)
+            return RC_READ_NON_EXISTING_PAGE; // Hit the end of the file before a full page.
+        if (n < 0)
+            return RC_ERROR;
+        done += n;
+    }
+    return RC_OK;
+}
+
+// Read or write numPages consecutive pages from or to separate buffers with
+// vectored positional I/O, one system call for the whole run where the kernel allows.
+#define MAX_IOV 64
+
+static RC transferPages(SM_FileHandle *fHandle, int pageNum, int numPages, SM_PageHandle *memPages, bool write) {
+    SM_FileMgmt *fileMgmt = (SM_FileMgmt *)fHandle->mgmtInfo;
+    if (fileMgmt == NULL)
+        return RC_FILE_HANDLE_NOT_INIT;
+
+    // With direct I/O a single misaligned buffer sends the whole run page by page
+    for (int i = 0; fileMgmt->direct && i < numPages; i++) {
+        if (!misaligned(fileMgmt, memPages[i]))
+            continue;
+        for (int k = 0; k < numPages; k++) {
+            RC rc = write ? writePage(fHandle, pageNum + k, memPages[k]) : readPage(fHandle, pageNum + k, memPages[k]);
+            if (rc != RC_OK)
+                return rc;
+        }
+        return RC_OK;
+    }
+
+    struct iovec iov[MAX_IOV];
+    int first = 0;
+    while (first < numPages) {
+        // Describe up to MAX_IOV pages, continuing after a partial transfer
+        int count = numPages - first < MAX_IOV ? numPages - first : MAX_IOV;
+        for (int i = 0; i < count; i++)
+            iov[i] = (struct iovec){.iov_base = memPages[first + i], .iov_len = PAGE_SIZE};
+
+        off_t offset = (off_t)(pageNum + first) * PAGE_SIZE;
+        int next = 0;
+        while (next < count) {
+            ssize_t n = write ? pwritev(fileMgmt->fd, iov + next, count - next, offset)
+                              : preadv(fileMgmt->fd, iov + next, count - next, offset);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (write && n <= 0)
+                return RC_WRITE_FAILED;
+            if (n == 0)
+                return RC_READ_NON_EXISTING_PAGE; // Hit the end of the file before the last page.
+            if (n < 0)
+                return RC_ERROR;
+            offset += n;
+            // Skip the buffers that were done and trim the one done halfway
+            while (next < count && (size_t)n >= iov[next].iov_len)
+                n -= iov[next++].iov_len;
+            if (next < count) {
+                iov[next].iov_base = (char *)iov[next].iov_base + n;
+                iov[next].iov_len -= n;
+            }
+        }
+        first += count;
+    }
+    return RC_OK;
+}
+
+// Write one whole page with a positional write.
+static RC writePage(SM_FileHandle *fHandle, int pageNum, SM_PageHandle memPage) {
+    SM_FileMgmt *fileMgmt = (SM_FileMgmt *)fHandle->mgmtInfo;
+    if (fileMgmt == NULL)
+        return RC_FILE_HANDLE_NOT_INIT;
+    if (misaligned(fileMgmt, memPage))
+        return bouncePage(fHandle, pageNum, memPage, true);
+
+    off_t offset = (off_t)pageNum * PAGE_SIZE;
+    size_t done = 0;
+    while (done < PAGE_SIZE) {
+        ssize_t n = pwrite(fileMgmt->fd, memPage + done, PAGE_SIZE - done, offset + done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return RC_WRITE_FAILED;
+        done += n;
+    }
+    return RC_OK;
+}
+
 extern void initStorageManager (void) {
 	// Initialising file pointer i.e. storage manager.
 	pageFile = NULL;
@@ -48,38 +197,86 @@ extern RC createPageFile(char *path) {
 }
 
 
-extern RC openPageFile(char *fileName, SM_FileHandle *fHandle) {
-    // Try to open the file so we can read from it.
-    FILE *fileStream = fopen(fileName, "r");
+static RC openFile(char *fileName, SM_FileHandle *fHandle, int flags) {
+    // Open the file once for reading and writing; fall back to read-only for files we can't write.
+    int fd = open(fileName, O_RDWR | flags);
+    if (fd < 0 && errno != EINVAL)
+        fd = open(fileName, O_RDONLY | flags);
+
+    // A file system without direct I/O refuses O_DIRECT with EINVAL.
+    if (fd < 0 && errno == EINVAL)
+        return RC_ERROR;
 
     // If we can't open the file, let the user know it wasn't found.
-    if (fileStream == NULL) {
+    if (fd < 0) {
         printError(RC_FILE_NOT_FOUND);
         return RC_FILE_NOT_FOUND;
-    } else {
-        // Set the file's name and start at the beginning of the file in our tracking info.
-        fHandle->fileName = fileName;
-        fHandle->curPagePos = 0;
+    }
 
-        // Go to the file's end to figure out how big it is.
-        fseek(fileStream, 0, SEEK_END);
-        long fileSize = ftell(fileStream); // Find out the file's size.
-        fseek(fileStream, 0, SEEK_SET); // Go back to the start of the file.
+    // Find out the file's size without moving any file position around.
+    struct stat fileInfo;
+    SM_FileMgmt *fileMgmt = (SM_FileMgmt *)malloc(sizeof(SM_FileMgmt));
+    if (fileMgmt == NULL || fstat(fd, &fileInfo) != 0) {
+        free(fileMgmt);
+        close(fd);
+        return RC_ERROR;
+    }
 
-        // Work out how many pages the file has and update our tracking info.
-        fHandle->totalNumPages = fileSize / PAGE_SIZE;
+    // Keep the descriptor in the handle until closePageFile, every block I/O reuses it.
+    fileMgmt->fd = fd;
+    fileMgmt->direct = (flags & O_DIRECT) != 0;
+    fileMgmt->extentPages = 0;
+    fileMgmt->reservedPages = fileInfo.st_size / PAGE_SIZE;
+    fHandle->mgmtInfo = fileMgmt;
 
-        // All done with the file for now, so close it.
-        fclose(fileStream);
-        return RC_OK;
-    }
+    // Set the file's name and start at the beginning of the file in our tracking info.
+    fHandle->fileName = fileName;
+    fHandle->curPagePos = 0;
+
+    // Work out how many pages the file has and update our tracking info.
+    fHandle->totalNumPages = fileInfo.st_size / PAGE_SIZE;
+    return RC_OK;
 }
 
+extern RC openPageFile(char *fileName, SM_FileHandle *fHandle) {
+    return openFile(fileName, fHandle, 0);
+}
+
+// Like openPageFile, but block I/O bypasses the kernel's page cache. Buffers
+// should be aligned to 4 KB; others still work, through an aligned copy.
+// Returns RC_ERROR if the file system does not support direct I/O.
+extern RC openPageFileDirect(char *fileName, SM_FileHandle *fHandle) {
+    return openFile(fileName, fHandle, O_DIRECT);
+}
+
+
+// Give back the disk space reserved past the end of the file. The end is
+// taken from the file itself, another handle may have grown it meanwhile.
+static void releaseReserve(SM_FileMgmt *fileMgmt) {
+    struct stat fileInfo;
+    off_t reserved = (off_t)fileMgmt->reservedPages * PAGE_SIZE;
+    // Truncating to the current size frees the blocks past the end on every
+    // file system; punching a hole there is a no-op on ext4
+    if (fstat(fileMgmt->fd, &fileInfo) == 0 && fileInfo.st_size < reserved)
+        (void)ftruncate(fileMgmt->fd, fileInfo.st_size);
+}
 
 extern RC closePageFile(SM_FileHandle *fHandle) {
     // Make sure we actually have a file to work with.
     if (fHandle != NULL) {
-        // Clean up our record of the file since we're not closing a file, just forgetting it.
+        SM_FileMgmt *fileMgmt = (SM_FileMgmt *)fHandle->mgmtInfo;
+
+        // Release the descriptor that openPageFile kept open for us, and the
+        // disk space reserved past the last page.
+        if (fileMgmt != NULL) {
+            if (fileMgmt->reservedPages > fHandle->totalNumPages)
+                releaseReserve(fileMgmt);
+            close(fileMgmt->fd);
+            free(fileMgmt);
+        }
+
+        // Clean up our record of the file.
+        fHandle->mgmtInfo = NULL;
         fHandle->fileName = NULL;
         fHandle->totalNumPages = 0;
         fHandle->curPagePos = -1; // Use -1 to show it's not pointing at any page.
@@ -115,31 +312,32 @@ extern RC readBlock(int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage)
         return RC_READ_NON_EXISTING_PAGE;
     }
 
-    // Try to open the file so we can read from it.
-    FILE *pageFile = fopen(fHandle->fileName, "r");
-    if (pageFile == NULL) {
-        return RC_FILE_NOT_FOUND;
+    // Get the page's data into our memory space with one positional read.
+    RC rc = readPage(fHandle, pageNum, memPage);
+    if (rc != RC_OK) {
+        return rc;
     }
 
-    // Go to the start of the page we're interested in.
-    if (fseek(pageFile, pageNum * PAGE_SIZE, SEEK_SET) != 0) {
-        fclose(pageFile); // Close the file if moving didn't work.
-        return RC_READ_NON_EXISTING_PAGE;
-    }
+    // Remember where we are in the file.
+    fHandle->curPagePos = (pageNum + 1) * PAGE_SIZE;
 
-    // Get the page's data into our memory space.
-    size_t readBytes = fread(memPage, sizeof(char), PAGE_SIZE, pageFile);
-    if (readBytes < PAGE_SIZE) {
-        fclose(pageFile); // Close the file if we didn't get the whole page.
-        return RC_ERROR; // Think about using a special error code for getting only part of the page.
-    }
+    return RC_OK;
+}
 
-    // Remember where we are in the file.
-    fHandle->curPagePos = ftell(pageFile);
+extern RC readBlocks(int pageNum, int numPages, SM_FileHandle *fHandle, SM_PageHandle *memPages) {
+    if (fHandle == NULL || memPages == NULL || numPages < 0)
+        return RC_ERROR;
 
-    // Done with the file, so close it.
-    fclose(pageFile);
+    // Every page of the run has to exist.
+    if (pageNum < 0 || pageNum + numPages > fHandle->totalNumPages)
+        return RC_READ_NON_EXISTING_PAGE;
 
+    RC rc = transferPages(fHandle, pageNum, numPages, memPages, false);
+    if (rc != RC_OK)
+        return rc;
+
+    // Like readBlock, the position ends up behind the last page read.
+    fHandle->curPagePos = (pageNum + numPages) * PAGE_SIZE;
     return RC_OK;
 }
 
@@ -161,32 +359,21 @@ extern RC readFirstBlock(SM_FileHandle *fHandle, SM_PageHandle memPage) {
     if (fHandle == NULL || memPage == NULL) {
         return RC_ERROR; // Tell them something's wrong with what they gave us.
     }
-    
-    // Try to open the file to read from it.
-    FILE *pageFile = fopen(fHandle->fileName, "r");
-    if (pageFile == NULL) {
-        return RC_FILE_NOT_FOUND; // Say we couldn't find the file.
+
+    // An empty file has no first page.
+    if (fHandle->totalNumPages <= 0) {
+        return RC_READ_NON_EXISTING_PAGE;
     }
 
     // Try to get the very first page of the file.
-    size_t bytesRead = fread(memPage, sizeof(char), PAGE_SIZE, pageFile);
-    if (bytesRead < PAGE_SIZE) {
-        // If we didn't get a full page, figure out if it's the end of the file or another error.
-        if (feof(pageFile)) {
-            fclose(pageFile); // Close the file since we're done trying.
-            return RC_READ_NON_EXISTING_PAGE; // Maybe use a better error for "there's no data."
-        } else {
-            fclose(pageFile); // Make sure to close the file either way.
-            return RC_ERROR; // General error for when reading didn't work out.
-        }
+    RC rc = readPage(fHandle, 0, memPage);
+    if (rc != RC_OK) {
+        return rc;
     }
 
     // Remember we just looked at the first page.
     fHandle->curPagePos = 0; // Starting spot, so it's 0.
 
-    // All done with the file, so close it.
-    fclose(pageFile);
-
     return RC_OK; // Everything went fine.
 }
 
@@ -204,36 +391,17 @@ extern RC readPreviousBlock(SM_FileHandle *fHandle, SM_PageHandle memPage) {
     if (currentPageNumber <= 1) {
         printf("\n First block or before: Previous block not present.\n");
         return RC_READ_NON_EXISTING_PAGE; // Say there's no previous page to read.
-    } else {
-        // Find where the page before the current one starts.
-        int startPosition = (PAGE_SIZE * (currentPageNumber - 2));
-
-        // Try to open the file to read from it.
-        FILE *pageFile = fopen(fHandle->fileName, "r");
-        if (pageFile == NULL) {
-            return RC_FILE_NOT_FOUND; // Can't find the file.
-        }
-
-        // Go to the beginning of the page before the current one.
-        if (fseek(pageFile, startPosition, SEEK_SET) != 0) {
-            fclose(pageFile); // Make sure to close the file if this doesn't work.
-            return RC_READ_NON_EXISTING_PAGE; // Say we couldn't get to the previous page.
-        }
-
-        // Try to get the content of the previous page.
-        if (fread(memPage, sizeof(char), PAGE_SIZE, pageFile) < PAGE_SIZE) {
-            // If we didn't get a full page, something went wrong.
-            fclose(pageFile); // Close the file anyway.
-            return RC_ERROR; // General error for reading problems.
-        }
-
-        // Note that we've moved back one page.
-        fHandle->curPagePos = startPosition + PAGE_SIZE; // We're now at the end of the page we just read.
+    }
 
-        // Done with the file, so close it.
-        fclose(pageFile);
-        return RC_OK; // Everything worked out.
+    // Try to get the content of the page before the current one.
+    RC rc = readPage(fHandle, currentPageNumber - 2, memPage);
+    if (rc != RC_OK) {
+        return rc;
     }
+
+    // Note that we've moved back one page.
+    fHandle->curPagePos = (currentPageNumber - 1) * PAGE_SIZE; // We're now at the end of the page we just read.
+    return RC_OK; // Everything worked out.
 }
 
 
@@ -246,37 +414,14 @@ extern RC readCurrentBlock(SM_FileHandle *fHandle, SM_PageHandle memPage) {
     // Figure out which page we're currently looking at.
     int currentPageNumber = fHandle->curPagePos / PAGE_SIZE;
 
-    // Find out where this page starts in the file.
-    int startPosition = PAGE_SIZE * currentPageNumber;
-    
-    // Try to open the file so we can read from it.
-    FILE *pageFile = fopen(fHandle->fileName, "r");
-    if (pageFile == NULL) {
-        return RC_FILE_NOT_FOUND; // Say we couldn't find the file.
-    }
-
-    // Go to where the page we want to read starts.
-    if (fseek(pageFile, startPosition, SEEK_SET) != 0) {
-        fclose(pageFile); // Close the file if we couldn't get there.
-        return RC_READ_NON_EXISTING_PAGE;
-    }
-
     // Now read that page into the memory space we were given.
-    size_t readBytes = fread(memPage, sizeof(char), PAGE_SIZE, pageFile);
-    if (readBytes < PAGE_SIZE) {
-        // If we didn't get the whole page, something went wrong.
-        fclose(pageFile); // Close the file anyway.
-        if (feof(pageFile)) {
-            return RC_READ_NON_EXISTING_PAGE; // End of the file means there's no more to read.
-        }
-        return RC_ERROR; // Something else went wrong if it's not the end of the file.
+    RC rc = readPage(fHandle, currentPageNumber, memPage);
+    if (rc != RC_OK) {
+        return rc;
     }
 
     // After reading, remember we're now at the end of this page.
-    fHandle->curPagePos = startPosition + PAGE_SIZE;
-
-    // All done, so close the file.
-    fclose(pageFile);
+    fHandle->curPagePos = (currentPageNumber + 1) * PAGE_SIZE;
 
     return RC_OK; // Everything went just fine.
 }
@@ -295,41 +440,18 @@ extern RC readNextBlock(SM_FileHandle *fHandle, SM_PageHandle memPage) {
     if (currentPageNumber >= fHandle->totalNumPages - 1) {
         printf("\n Last block: There's no next block to read.\n");
         return RC_READ_NON_EXISTING_PAGE; 
-    } else {
-        // Find the spot where the next page starts.
-        int startPosition = PAGE_SIZE * (currentPageNumber + 1); // This is where the next page begins.
-
-        // Try opening the file to read from it.
-        FILE *pageFile = fopen(fHandle->fileName, "r");
-        if (pageFile == NULL) {
-            return RC_FILE_NOT_FOUND; // Tell them we couldn't find the file.
-        }
-
-        // Go to the beginning of the next page.
-        if (fseek(pageFile, startPosition, SEEK_SET) != 0) {
-            fclose(pageFile); // Make sure to close the file if moving there didn't work.
-            return RC_READ_NON_EXISTING_PAGE;
-        }
-
-        // Read the page into the provided memory space.
-        size_t readBytes = fread(memPage, sizeof(char), PAGE_SIZE, pageFile);
-        if (readBytes < PAGE_SIZE) {
-            // If we got less than a whole page, something's up.
-            fclose(pageFile); // Always close the file, even if there was a problem.
-            if (feof(pageFile)) {
-                return RC_READ_NON_EXISTING_PAGE; // We've hit the end of the file, so there's nothing more to read.
-            }
-            return RC_ERROR; // If it's not the end of the file, it's some other read error.
-        }
+    }
 
-        // Remember where we are now, which is at the beginning of the next page we just read.
-        fHandle->curPagePos = startPosition;
+    // Read the next page into the provided memory space.
+    RC rc = readPage(fHandle, currentPageNumber + 1, memPage);
+    if (rc != RC_OK) {
+        return rc;
+    }
 
-        // We're done here, so close the file.
-        fclose(pageFile);
+    // Remember where we are now, which is at the beginning of the next page we just read.
+    fHandle->curPagePos = (currentPageNumber + 1) * PAGE_SIZE;
 
-        return RC_OK; // Everything worked out fine.
-    }
+    return RC_OK; // Everything worked out fine.
 }
 
 
@@ -344,34 +466,14 @@ extern RC readLastBlock(SM_FileHandle *fHandle, SM_PageHandle memPage) {
         return RC_READ_NON_EXISTING_PAGE; // If there are no pages, there's nothing to read.
     }
 
-    // Find where the last page starts.
-    int startPosition = (fHandle->totalNumPages - 1) * PAGE_SIZE;
-
-    // Try to open the file to read from it.
-    FILE *pageFile = fopen(fHandle->fileName, "r");
-    if (pageFile == NULL) {
-        return RC_FILE_NOT_FOUND; // If the file doesn't open, it might not exist.
-    }
-
-    // Move to the beginning of the last page.
-    if (fseek(pageFile, startPosition, SEEK_SET) != 0) {
-        fclose(pageFile); // If we can't move there, close the file and report an error.
-        return RC_READ_NON_EXISTING_PAGE;
-    }
-
     // Now, read the last page into the provided memory space.
-    size_t readBytes = fread(memPage, sizeof(char), PAGE_SIZE, pageFile);
-    if (readBytes < PAGE_SIZE && !feof(pageFile)) {
-        // If we didn't get a full page and it's not because we're at the end, it's an error.
-        fclose(pageFile); // Close the file before leaving.
-        return RC_ERROR; // Tell them something went wrong during reading.
+    RC rc = readPage(fHandle, fHandle->totalNumPages - 1, memPage);
+    if (rc != RC_OK) {
+        return rc;
     }
 
     // Remember where we just read from, marking the start of the last page.
-    fHandle->curPagePos = startPosition;
-
-    // We're done with the file, so close it.
-    fclose(pageFile);
+    fHandle->curPagePos = (fHandle->totalNumPages - 1) * PAGE_SIZE;
 
     return RC_OK; // Everything went as expected.
 }
@@ -381,139 +483,680 @@ extern RC writeBlock (int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage
     // Check if the page number is valid (not too big or small).
     if (pageNum > fHandle->totalNumPages || pageNum < 0)
         return RC_WRITE_FAILED;
-    
-    // Try to open the file so we can read and write to it.
-    FILE *fileHandle = fopen(fHandle->fileName, "r+");
-    
-    // If the file didn't open, let the user know.
-    if(fileHandle == NULL)
-        return RC_FILE_NOT_FOUND;
 
-    int offset = pageNum * PAGE_SIZE; // Figure out where to start writing in the file.
+    // Write the whole page in one go, right where it belongs.
+    RC rc = writePage(fHandle, pageNum, memPage);
+    if (rc != RC_OK)
+        return rc;
 
-    // Prepare to count how much we write.
-    int bytesWritten = 0;
+    // Writing right behind the last page grows the file by that page.
+    if (pageNum == fHandle->totalNumPages)
+        fHandle->totalNumPages++;
 
-    if(pageNum == 0) { 
-        // Move to the right spot in the file.
-        fseek(fileHandle, offset, SEEK_SET);	
-        while (bytesWritten < PAGE_SIZE) {
-            if(feof(fileHandle))
-                appendEmptyBlock(fHandle); // If we hit the end of the file, add a new empty page.
-            
-            fputc(memPage[bytesWritten], fileHandle); // Write one character at a time to the file.
-            bytesWritten++;
-        }
+    // Keep track of where we are in the file after writing.
+    fHandle->curPagePos = (pageNum + 1) * PAGE_SIZE;
+    return RC_OK;
+}
 
-        // Keep track of where we are in the file after writing.
-        fHandle->curPagePos = ftell(fileHandle); 
 
-        // Done writing, so close the file to make sure all changes are saved.
-        fclose(fileHandle);	
-    } else {	
-        // Before we finish, remember the file position where we wrote.
-        fHandle->curPagePos = offset;
-        writeCurrentBlock(fHandle, memPage);
-        fclose(fileHandle); // Now we close the file.
-    }
+extern RC writeBlocks(int pageNum, int numPages, SM_FileHandle *fHandle, SM_PageHandle *memPages) {
+    if (fHandle == NULL || memPages == NULL || numPages < 0)
+        return RC_ERROR;
+
+    // Like writeBlock, the run may start right behind the last page but not further.
+    if (pageNum > fHandle->totalNumPages || pageNum < 0)
+        return RC_WRITE_FAILED;
+
+    RC rc = transferPages(fHandle, pageNum, numPages, memPages, true);
+    if (rc != RC_OK)
+        return rc;
+
+    // Pages written past the old end belong to the file now.
+    if (pageNum + numPages > fHandle->totalNumPages)
+        fHandle->totalNumPages = pageNum + numPages;
+
+    fHandle->curPagePos = (pageNum + numPages) * PAGE_SIZE;
     return RC_OK;
 }
 
 
 extern RC writeCurrentBlock(SM_FileHandle *fHandle, SM_PageHandle memPage) {
-    // Try to open the file so we can change it.
-    FILE *fileHandle = fopen(fHandle->fileName, "r+");
+    // The current position tells us which page to write.
+    return writeBlock(fHandle->curPagePos / PAGE_SIZE, fHandle, memPage);
+}
 
-    // If the file didn't open, tell the user.
-    if(fileHandle == NULL)
-        return RC_FILE_NOT_FOUND;
-    
-    // Make sure there's enough room in the file before we start writing.
-    appendEmptyBlock(fHandle);
-
-    // Move to the right place in the file where we want to start writing.
-    fseek(fileHandle, fHandle->curPagePos, SEEK_SET);
-    
-    // Figure out how much of memPage we're going to write to make sure we don't write too much.
-    size_t contentLength = strlen(memPage);
-    // Don't write more than the max page size.
-    contentLength = (contentLength > PAGE_SIZE) ? PAGE_SIZE : contentLength;
-
-    // Now write the actual data from memPage to the file.
-    fwrite(memPage, sizeof(char), contentLength, fileHandle);
-    
-    // Remember where we ended up in the file after writing.
-    fHandle->curPagePos = ftell(fileHandle);
-
-    // All done writing, so close the file to save everything properly.
-    fclose(fileHandle);
 
-    return RC_OK;
+// Reserve disk space for the bytes from offset to offset + length. With
+// keepSize the file's size stays as it is and the space waits past its end.
+static bool reserveSpace(int fd, off_t offset, off_t length, bool keepSize) {
+#ifdef __linux__
+    int rc;
+    do
+        rc = fallocate(fd, keepSize ? FALLOC_FL_KEEP_SIZE : 0, offset, length);
+    while (rc != 0 && errno == EINTR);
+    return rc == 0;
+#else
+    return false;
+#endif
 }
 
+// Grow the file by numPages empty pages at once. The new pages read as zeros
+// and are never written: fallocate reserves their disk space in one call, and
+// where the file system can't do that, ftruncate extends the file sparsely.
+// With a growth extent set, the space is reserved a whole extent at a time,
+// so a file growing page by page only changes its size on most appends.
+extern RC appendEmptyBlocks (int numPages, SM_FileHandle *fHandle) {
+    if (fHandle == NULL || fHandle->mgmtInfo == NULL)
+        return RC_FILE_HANDLE_NOT_INIT;
+    if (numPages < 0)
+        return RC_WRITE_FAILED;
+    if (numPages == 0)
+        return RC_OK;
 
-extern RC appendEmptyBlock (SM_FileHandle *fHandle) {
-    // Make a new empty page.
-    SM_PageHandle emptyPage = (SM_PageHandle)calloc(PAGE_SIZE, sizeof(char));
-    
-    // If making the page didn't work, stop and say there was a problem.
-    if (!emptyPage) {
-        return RC_WRITE_FAILED; // This means we couldn't write because of some error.
-    }
-
-    // Try to open the file so we can add to the end of it.
-    FILE *file = fopen(fHandle->fileName, "a");
-    
-    // If we can't open the file, clean up and say the file wasn't found.
-    if(file == NULL) {
-        free(emptyPage); // Clean up the empty page we made earlier.
-        return RC_FILE_NOT_FOUND;
+    SM_FileMgmt *fileMgmt = (SM_FileMgmt *)fHandle->mgmtInfo;
+    int oldPages = fHandle->totalNumPages;
+    int newPages = oldPages + numPages;
+    off_t oldSize = (off_t)oldPages * PAGE_SIZE;
+    off_t newSize = (off_t)newPages * PAGE_SIZE;
+
+    bool grown = false;
+    if (fileMgmt->extentPages > 0) {
+        // Round the reservation up to whole extents and keep the size for ftruncate below
+        if (newPages > fileMgmt->reservedPages) {
+            int extents = (newPages + fileMgmt->extentPages - 1) / fileMgmt->extentPages;
+            int reserve = extents * fileMgmt->extentPages;
+            off_t from = (off_t)(fileMgmt->reservedPages > oldPages ? fileMgmt->reservedPages : oldPages) * PAGE_SIZE;
+            if (reserveSpace(fileMgmt->fd, from, (off_t)reserve * PAGE_SIZE - from, true))
+                fileMgmt->reservedPages = reserve;
+        }
+    } else {
+        grown = reserveSpace(fileMgmt->fd, oldSize, newSize - oldSize, false);
     }
-    
-    // Add the new empty page to the end of the file.
-    size_t written = fwrite(emptyPage, sizeof(char), PAGE_SIZE, file);
-    // If we didn't add the whole page, there was a problem.
-    if(written < PAGE_SIZE) {
-        fclose(file); // Close the file to keep things neat.
-        free(emptyPage); // Clean up the empty page.
-        return RC_WRITE_FAILED; // Say that we couldn't write properly.
-    }
-    
-    // We're done with the file, so close it.
-    fclose(file);
-
-    // We don't need the empty page in memory anymore, so get rid of it.
-    free(emptyPage);
-    
-    // We added a page, so we need to remember that by increasing the total page count.
-    fHandle->totalNumPages++;
+    if (!grown && ftruncate(fileMgmt->fd, newSize) != 0)
+        return RC_WRITE_FAILED;
+
+    if (fileMgmt->reservedPages < newPages)
+        fileMgmt->reservedPages = newPages;
+    // Asynchronous writes check the size from other threads
+    __atomic_store_n(&fHandle->totalNumPages, newPages, __ATOMIC_RELEASE);
     return RC_OK;
 }
 
 
+extern RC appendEmptyBlock (SM_FileHandle *fHandle) {
+    // One empty page right behind the last one.
+    return appendEmptyBlocks(1, fHandle);
+}
+
+
 extern RC ensureCapacity (int requiredPages, SM_FileHandle *handle) {
-    // Try to open the file so we can read and write to it, without removing anything that's already there.
-    FILE *fileAccess = fopen(handle->fileName, "r+b");
-
-    // If we can't open the file that way, try another way that lets us add to it and make sure it's there.
-    if (fileAccess == NULL) {
-        fileAccess = fopen(handle->fileName, "a+");
-        if (fileAccess == NULL) {
-            return RC_FILE_NOT_FOUND; // If we still can't open the file, say it wasn't found.
+    // Make sure the file was opened before we try to grow it.
+    if (handle == NULL || handle->mgmtInfo == NULL)
+        return RC_FILE_HANDLE_NOT_INIT;
+
+    // Add all the missing pages in one go.
+    if (requiredPages > handle->totalNumPages)
+        return appendEmptyBlocks(requiredPages - handle->totalNumPages, handle);
+
+    return RC_OK; // Say everything went okay.
+}
+
+
+// Let the file grow in extents of extentPages pages: every growth reserves
+// disk space up to the next multiple of extentPages, so frequent small
+// appends reuse space reserved by an earlier one. 0 grows the file by exactly
+// what is asked for. The unused part is given back by closePageFile.
+extern RC setGrowthExtent (SM_FileHandle *fHandle, int extentPages) {
+    if (fHandle == NULL || fHandle->mgmtInfo == NULL)
+        return RC_FILE_HANDLE_NOT_INIT;
+    if (extentPages < 0)
+        return RC_ERROR;
+
+    ((SM_FileMgmt *)fHandle->mgmtInfo)->extentPages = extentPages;
+    return RC_OK;
+}
+
+
+/************************************************************
+ *                 asynchronous block I/O                   *
+ ************************************************************/
+
+// io_uring takes at most this many buffers per vectored request.
+#define MAX_ASYNC_PAGES 1024
+// The thread pool never runs more threads than this, whatever the queue depth.
+#define MAX_ASYNC_THREADS 32
+
+// One I/O of an engine. A slot is either free, queued for a pool thread,
+// submitted, or completed and waiting for its callback; next links the list
+// it is on.
+typedef struct AsyncRequest {
+    bool write;
+    int pageNum;
+    int numPages;
+    struct iovec *iov;        // the request's own copy, single for one page
+    struct iovec single;
+    long moved;               // bytes moved so far; io_uring resubmits short transfers for the rest
+    int iovFirst;             // first buffer not done yet
+    SM_IOCallback done;
+    void *arg;
+    RC rc;
+    int next;
+} AsyncRequest;
+
+typedef struct AsyncMgmt {
+    SM_FileHandle *source;    // the caller's handle, whose page count grows with the file
+    SM_FileHandle file;       // a private copy for the pool threads' I/O
+    AsyncRequest *requests;   // queueDepth slots
+    pthread_mutex_t latch;    // the slot lists and the counters
+    int freeHead;
+    int inUse;                // slots taken until their callback has run
+    int outstanding;          // submitted and not completed yet
+
+    // io_uring rings, ringFd is -1 for the thread pool
+    int ringFd;
+    pthread_mutex_t reapLatch; // one thread empties the completion queue at a time
+    int sqPending;            // entries queued since the last io_uring_enter, under latch
+    void *sqRing, *cqRing;
+    size_t sqRingSize, cqRingSize, sqesSize;
+    unsigned *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+#ifdef HAVE_IO_URING
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+#endif
+
+    // thread pool
+    pthread_t *workers;
+    int numWorkers;
+    int queuedHead, queuedTail;
+    int completedHead;        // finished, waiting for a poll; on io_uring the requests the kernel refused
+    bool stop;
+    pthread_cond_t work;
+    pthread_cond_t completed;
+} AsyncMgmt;
+
+// Result of an I/O that moved bytes of its numPages pages.
+static RC asyncResult(AsyncRequest *request, long bytes) {
+    if (bytes == (long)request->numPages * PAGE_SIZE)
+        return RC_OK;
+    if (request->write)
+        return RC_WRITE_FAILED;
+    return bytes < 0 ? RC_ERROR : RC_READ_NON_EXISTING_PAGE; // A short read ran into the end of the file.
+}
+
+#ifdef HAVE_IO_URING
+static int ringEnter(int ringFd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    int ret;
+    do {
+        ret = syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+static void unmapRing(AsyncMgmt *mgmt) {
+    if (mgmt->cqRing != NULL && mgmt->cqRing != mgmt->sqRing)
+        munmap(mgmt->cqRing, mgmt->cqRingSize);
+    if (mgmt->sqRing != NULL)
+        munmap(mgmt->sqRing, mgmt->sqRingSize);
+    if (mgmt->sqes != NULL)
+        munmap(mgmt->sqes, mgmt->sqesSize);
+    close(mgmt->ringFd);
+    mgmt->ringFd = -1;
+}
+
+// Set up an io_uring with room for queueDepth requests; false if the kernel
+// has none or does not let us use it.
+static bool setupRing(AsyncMgmt *mgmt, int queueDepth) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    mgmt->ringFd = syscall(__NR_io_uring_setup, queueDepth, &params);
+    if (mgmt->ringFd < 0) {
+        mgmt->ringFd = -1;
+        return false;
+    }
+    mgmt->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    mgmt->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    mgmt->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single)
+        mgmt->sqRingSize = mgmt->cqRingSize = mgmt->sqRingSize > mgmt->cqRingSize ? mgmt->sqRingSize : mgmt->cqRingSize;
+
+    mgmt->sqRing = mmap(NULL, mgmt->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        mgmt->ringFd, IORING_OFF_SQ_RING);
+    mgmt->cqRing = single ? mgmt->sqRing : mmap(NULL, mgmt->cqRingSize, PROT_READ | PROT_WRITE,
+                                                MAP_SHARED | MAP_POPULATE, mgmt->ringFd, IORING_OFF_CQ_RING);
+    mgmt->sqes = mmap(NULL, mgmt->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      mgmt->ringFd, IORING_OFF_SQES);
+    if (mgmt->sqRing == MAP_FAILED)
+        mgmt->sqRing = NULL;
+    if (mgmt->cqRing == MAP_FAILED)
+        mgmt->cqRing = NULL;
+    if (mgmt->sqes == MAP_FAILED)
+        mgmt->sqes = NULL;
+    if (mgmt->sqRing == NULL || mgmt->cqRing == NULL || mgmt->sqes == NULL) {
+        unmapRing(mgmt);
+        return false;
+    }
+
+    char *sq = mgmt->sqRing, *cq = mgmt->cqRing;
+    mgmt->sqTail = (unsigned *)(sq + params.sq_off.tail);
+    mgmt->sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    mgmt->sqArray = (unsigned *)(sq + params.sq_off.array);
+    mgmt->cqHead = (unsigned *)(cq + params.cq_off.head);
+    mgmt->cqTail = (unsigned *)(cq + params.cq_off.tail);
+    mgmt->cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    mgmt->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return true;
+}
+
+// Put a request, or the rest of one after a short transfer, on the
+// submission queue; the caller holds the latch. The kernel only takes the
+// entry at the next flushRing, so a burst of submits costs one system call.
+static void queueOnRing(AsyncMgmt *mgmt, int slot) {
+    AsyncRequest *request = &mgmt->requests[slot];
+    unsigned tail = *mgmt->sqTail;
+    unsigned index = tail & *mgmt->sqMask;
+    struct io_uring_sqe *sqe = &mgmt->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = request->write ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe->fd = ((SM_FileMgmt *)mgmt->file.mgmtInfo)->fd;
+    sqe->off = (unsigned long long)request->pageNum * PAGE_SIZE + request->moved;
+    sqe->addr = (unsigned long long)(uintptr_t)(request->iov + request->iovFirst);
+    sqe->len = request->numPages - request->iovFirst;
+    sqe->user_data = slot;
+    mgmt->sqArray[index] = index;
+    __atomic_store_n(mgmt->sqTail, tail + 1, __ATOMIC_RELEASE);
+    mgmt->sqPending++;
+}
+
+// Hand every queued entry to the kernel with one io_uring_enter, the caller
+// holds the latch. Entries the kernel is short of resources for stay queued
+// for the next flush; after any other error they are taken back and their
+// requests complete with RC_ERROR.
+static void flushRing(AsyncMgmt *mgmt) {
+    if (mgmt->sqPending == 0)
+        return;
+    int submitted = ringEnter(mgmt->ringFd, mgmt->sqPending, 0, 0);
+    if (submitted > 0)
+        mgmt->sqPending -= submitted;
+    if (mgmt->sqPending == 0 || (submitted < 0 && (errno == EAGAIN || errno == EBUSY)))
+        return;
+
+    // The kernel took entries from the head, the rest are the newest ones
+    unsigned tail = *mgmt->sqTail - mgmt->sqPending;
+    for (unsigned i = tail; i != *mgmt->sqTail; i++) {
+        int slot = (int)mgmt->sqes[mgmt->sqArray[i & *mgmt->sqMask]].user_data;
+        mgmt->requests[slot].rc = RC_ERROR;
+        mgmt->requests[slot].next = mgmt->completedHead;
+        mgmt->completedHead = slot;
+        __atomic_sub_fetch(&mgmt->outstanding, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(mgmt->sqTail, tail, __ATOMIC_RELEASE);
+    mgmt->sqPending = 0;
+}
+
+// Count res bytes moved for a request. False if the transfer came up short,
+// then the buffers are trimmed to what is left and the rest has to be
+// submitted again at the offset where it stopped.
+static bool transferDone(AsyncRequest *request, int res) {
+    if (res > 0 && request->moved + res < (long)request->numPages * PAGE_SIZE) {
+        request->moved += res;
+        // Skip the buffers that were done and trim the one done halfway
+        while ((size_t)res >= request->iov[request->iovFirst].iov_len)
+            res -= request->iov[request->iovFirst++].iov_len;
+        request->iov[request->iovFirst].iov_base = (char *)request->iov[request->iovFirst].iov_base + res;
+        request->iov[request->iovFirst].iov_len -= res;
+        return false;
+    }
+    request->rc = asyncResult(request, res < 0 ? res : request->moved + res);
+    return true;
+}
+
+// Take the finished requests off the completion queue, waiting for one if
+// block is set and some request is still with the kernel. Queued entries are
+// flushed first, and short transfers go back on the queue until they are done.
+static int reapRing(AsyncMgmt *mgmt, bool block) {
+    int first = -1;
+    int requeued;
+
+    pthread_mutex_lock(&mgmt->reapLatch);
+    do {
+        pthread_mutex_lock(&mgmt->latch);
+        flushRing(mgmt);
+        // Requests the kernel refused complete here
+        while (mgmt->completedHead != -1) {
+            int slot = mgmt->completedHead;
+            mgmt->completedHead = mgmt->requests[slot].next;
+            mgmt->requests[slot].next = first;
+            first = slot;
         }
+        bool inKernel = __atomic_load_n(&mgmt->outstanding, __ATOMIC_RELAXED) > mgmt->sqPending;
+        pthread_mutex_unlock(&mgmt->latch);
+
+        unsigned head = *mgmt->cqHead;
+        unsigned tail = __atomic_load_n(mgmt->cqTail, __ATOMIC_ACQUIRE);
+        if (head == tail && block && first == -1 && inKernel) {
+            ringEnter(mgmt->ringFd, 0, 1, IORING_ENTER_GETEVENTS);
+            tail = __atomic_load_n(mgmt->cqTail, __ATOMIC_ACQUIRE);
+        }
+        requeued = 0;
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &mgmt->cqes[head & *mgmt->cqMask];
+            int slot = (int)cqe->user_data;
+            AsyncRequest *request = &mgmt->requests[slot];
+            if (!transferDone(request, cqe->res)) {
+                pthread_mutex_lock(&mgmt->latch);
+                queueOnRing(mgmt, slot);
+                pthread_mutex_unlock(&mgmt->latch);
+                requeued++;
+                continue;
+            }
+            request->next = first;
+            first = slot;
+            __atomic_sub_fetch(&mgmt->outstanding, 1, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(mgmt->cqHead, head, __ATOMIC_RELEASE);
+    } while (requeued > 0); // Flush the resubmitted rest, and wait for it if nothing else finished
+    pthread_mutex_unlock(&mgmt->reapLatch);
+    return first;
+}
+#endif
+
+// Pool threads run the queued requests with the synchronous vectored I/O.
+static void *asyncWorker(void *arg) {
+    AsyncMgmt *mgmt = (AsyncMgmt *)arg;
+    SM_PageHandle pages[MAX_IOV];
+
+    pthread_mutex_lock(&mgmt->latch);
+    while (true) {
+        while (!mgmt->stop && mgmt->queuedHead == -1)
+            pthread_cond_wait(&mgmt->work, &mgmt->latch);
+        if (mgmt->queuedHead == -1)
+            break;
+
+        int slot = mgmt->queuedHead;
+        AsyncRequest *request = &mgmt->requests[slot];
+        mgmt->queuedHead = request->next;
+        if (mgmt->queuedHead == -1)
+            mgmt->queuedTail = -1;
+        pthread_mutex_unlock(&mgmt->latch);
+
+        RC rc = RC_OK;
+        for (int first = 0; rc == RC_OK && first < request->numPages; first += MAX_IOV) {
+            int count = request->numPages - first < MAX_IOV ? request->numPages - first : MAX_IOV;
+            for (int i = 0; i < count; i++)
+                pages[i] = request->iov[first + i].iov_base;
+            rc = transferPages(&mgmt->file, request->pageNum + first, count, pages, request->write);
+        }
+
+        pthread_mutex_lock(&mgmt->latch);
+        request->rc = rc;
+        request->next = mgmt->completedHead;
+        mgmt->completedHead = slot;
+        mgmt->outstanding--;
+        pthread_cond_broadcast(&mgmt->completed);
     }
+    pthread_mutex_unlock(&mgmt->latch);
+    return NULL;
+}
+
+static void freeAsyncMgmt(AsyncMgmt *mgmt) {
+    if (mgmt->workers != NULL) {
+        pthread_mutex_lock(&mgmt->latch);
+        mgmt->stop = true;
+        pthread_cond_broadcast(&mgmt->work);
+        pthread_mutex_unlock(&mgmt->latch);
+        for (int i = 0; i < mgmt->numWorkers; i++)
+            pthread_join(mgmt->workers[i], NULL);
+    }
+#ifdef HAVE_IO_URING
+    if (mgmt->ringFd >= 0)
+        unmapRing(mgmt);
+#endif
+    pthread_mutex_destroy(&mgmt->latch);
+    pthread_mutex_destroy(&mgmt->reapLatch);
+    pthread_cond_destroy(&mgmt->work);
+    pthread_cond_destroy(&mgmt->completed);
+    free(mgmt->workers);
+    free(mgmt->requests);
+    free(mgmt);
+}
 
-    // Keep adding empty pages to the file until it's as big as we need it to be.
-    while (requiredPages > handle->totalNumPages) {
-        RC appendStatus = appendEmptyBlock(handle); // Try to add an empty page.
-        if (appendStatus != RC_OK) {
-            fclose(fileAccess); // If there's a problem, close the file before stopping.
-            return appendStatus; // Say what the problem was.
+// Start an engine that keeps up to queueDepth reads and writes of the open
+// page file in flight. It runs on io_uring where the kernel allows it, or on
+// a pool of threads doing synchronous I/O (backend SM_ASYNC_THREAD_POOL
+// always picks the threads). The engine uses the handle's descriptor, so it
+// is closed before the file. Any thread may use it.
+extern RC openAsyncEngine(SM_FileHandle *fHandle, int queueDepth, int backend, SM_AsyncEngine *engine) {
+    if (fHandle == NULL || fHandle->mgmtInfo == NULL)
+        return RC_FILE_HANDLE_NOT_INIT;
+    if (engine == NULL || queueDepth <= 0)
+        return RC_ERROR;
+
+    AsyncMgmt *mgmt = (AsyncMgmt *)calloc(1, sizeof(AsyncMgmt));
+    AsyncRequest *requests = (AsyncRequest *)malloc(sizeof(AsyncRequest) * queueDepth);
+    if (mgmt == NULL || requests == NULL) {
+        free(mgmt);
+        free(requests);
+        return RC_ERROR;
+    }
+    mgmt->source = fHandle;
+    mgmt->file = *fHandle;
+    mgmt->requests = requests;
+    for (int i = 0; i < queueDepth; i++)
+        requests[i].next = i + 1 < queueDepth ? i + 1 : -1;
+    mgmt->freeHead = 0;
+    mgmt->queuedHead = mgmt->queuedTail = mgmt->completedHead = -1;
+    mgmt->ringFd = -1;
+    pthread_mutex_init(&mgmt->latch, NULL);
+    pthread_mutex_init(&mgmt->reapLatch, NULL);
+    pthread_cond_init(&mgmt->work, NULL);
+    pthread_cond_init(&mgmt->completed, NULL);
+
+    bool kernelQueue = false;
+#ifdef HAVE_IO_URING
+    kernelQueue = backend != SM_ASYNC_THREAD_POOL && setupRing(mgmt, queueDepth);
+#endif
+    if (!kernelQueue) {
+        int threads = queueDepth < MAX_ASYNC_THREADS ? queueDepth : MAX_ASYNC_THREADS;
+        mgmt->workers = (pthread_t *)malloc(sizeof(pthread_t) * threads);
+        while (mgmt->workers != NULL && mgmt->numWorkers < threads &&
+               pthread_create(&mgmt->workers[mgmt->numWorkers], NULL, asyncWorker, mgmt) == 0)
+            mgmt->numWorkers++;
+        if (mgmt->numWorkers == 0) {
+            freeAsyncMgmt(mgmt);
+            return RC_ERROR;
         }
     }
 
-    // Once the file is big enough, close it.
-    fclose(fileAccess);
-    return RC_OK; // Say everything went okay.
+    engine->queueDepth = queueDepth;
+    engine->kernelQueue = kernelQueue;
+    engine->mgmtInfo = mgmt;
+    return RC_OK;
+}
+
+// Wait for every I/O in flight, run its callback and stop the engine.
+extern RC closeAsyncEngine(SM_AsyncEngine *engine) {
+    if (engine == NULL || engine->mgmtInfo == NULL)
+        return RC_ERROR;
+
+    RC rc = waitAsyncIO(engine);
+    freeAsyncMgmt((AsyncMgmt *)engine->mgmtInfo);
+    engine->mgmtInfo = NULL;
+    return rc;
+}
+
+static RC submitAsync(SM_AsyncEngine *engine, bool write, int pageNum, int numPages, SM_PageHandle *memPages,
+                      SM_IOCallback done, void *arg) {
+    if (engine == NULL || engine->mgmtInfo == NULL)
+        return RC_ERROR;
+    AsyncMgmt *mgmt = (AsyncMgmt *)engine->mgmtInfo;
+    SM_FileMgmt *fileMgmt = (SM_FileMgmt *)mgmt->file.mgmtInfo;
+    if (memPages == NULL || numPages <= 0 || numPages > MAX_ASYNC_PAGES)
+        return RC_ERROR;
+
+    // Asynchronous writes never grow the file, runs finishing out of order would leave holes.
+    if (pageNum < 0 || pageNum + numPages > __atomic_load_n(&mgmt->source->totalNumPages, __ATOMIC_RELAXED))
+        return write ? RC_WRITE_FAILED : RC_READ_NON_EXISTING_PAGE;
+    // With direct I/O there is no aligned copy to fall back to here.
+    for (int i = 0; i < numPages; i++)
+        if (memPages[i] == NULL || misaligned(fileMgmt, memPages[i]))
+            return RC_ERROR;
+
+    struct iovec *iov = NULL;
+    if (numPages > 1 && (iov = (struct iovec *)malloc(sizeof(struct iovec) * numPages)) == NULL)
+        return RC_ERROR;
+
+    // Take a free slot; with the queue full, finished requests make room first
+    pthread_mutex_lock(&mgmt->latch);
+    while (mgmt->freeHead == -1) {
+        pthread_mutex_unlock(&mgmt->latch);
+        if (pollAsyncIO(engine, 1) == 0)
+            sched_yield();
+        pthread_mutex_lock(&mgmt->latch);
+    }
+    int slot = mgmt->freeHead;
+    AsyncRequest *request = &mgmt->requests[slot];
+    mgmt->freeHead = request->next;
+    mgmt->inUse++;
+
+    request->write = write;
+    request->pageNum = pageNum;
+    request->numPages = numPages;
+    request->iov = numPages > 1 ? iov : &request->single;
+    for (int i = 0; i < numPages; i++)
+        request->iov[i] = (struct iovec){.iov_base = memPages[i], .iov_len = PAGE_SIZE};
+    request->done = done;
+    request->arg = arg;
+    request->rc = RC_OK;
+    request->moved = 0;
+    request->iovFirst = 0;
+    request->next = -1;
+
+    // On io_uring the request waits in the submission queue for the next
+    // submitAsyncIO or poll, which hands the whole batch over at once
+#ifdef HAVE_IO_URING
+    if (mgmt->ringFd >= 0) {
+        queueOnRing(mgmt, slot);
+        __atomic_add_fetch(&mgmt->outstanding, 1, __ATOMIC_RELAXED);
+    }
+#endif
+    if (mgmt->ringFd < 0) {
+        if (mgmt->queuedTail == -1)
+            mgmt->queuedHead = slot;
+        else
+            mgmt->requests[mgmt->queuedTail].next = slot;
+        mgmt->queuedTail = slot;
+        mgmt->outstanding++;
+        pthread_cond_signal(&mgmt->work);
+    }
+    pthread_mutex_unlock(&mgmt->latch);
+    return RC_OK;
+}
+
+// Start reading page pageNum into memPage and return at once. done(rc, arg)
+// is called by pollAsyncIO once the read finished; memPage must stay valid
+// until then.
+extern RC readBlockAsync(int pageNum, SM_AsyncEngine *engine, SM_PageHandle memPage,
+                         SM_IOCallback done, void *arg) {
+    return submitAsync(engine, false, pageNum, 1, &memPage, done, arg);
+}
+
+// Start writing memPage to page pageNum, which must be inside the file.
+extern RC writeBlockAsync(int pageNum, SM_AsyncEngine *engine, SM_PageHandle memPage,
+                          SM_IOCallback done, void *arg) {
+    return submitAsync(engine, true, pageNum, 1, &memPage, done, arg);
+}
+
+// Start reading numPages consecutive pages, up to 1024, with one vectored
+// request; done is called once for the whole run.
+extern RC readBlocksAsync(int pageNum, int numPages, SM_AsyncEngine *engine, SM_PageHandle *memPages,
+                          SM_IOCallback done, void *arg) {
+    return submitAsync(engine, false, pageNum, numPages, memPages, done, arg);
+}
+
+extern RC writeBlocksAsync(int pageNum, int numPages, SM_AsyncEngine *engine, SM_PageHandle *memPages,
+                           SM_IOCallback done, void *arg) {
+    return submitAsync(engine, true, pageNum, numPages, memPages, done, arg);
 }
 
+// Start the I/Os submitted since the last call, with one io_uring_enter for
+// all of them. pollAsyncIO and waitAsyncIO do the same before they look for
+// completions; the thread pool starts every request as it is submitted.
+extern RC submitAsyncIO(SM_AsyncEngine *engine) {
+    if (engine == NULL || engine->mgmtInfo == NULL)
+        return RC_ERROR;
+#ifdef HAVE_IO_URING
+    AsyncMgmt *mgmt = (AsyncMgmt *)engine->mgmtInfo;
+    if (mgmt->ringFd >= 0) {
+        pthread_mutex_lock(&mgmt->latch);
+        flushRing(mgmt);
+        pthread_mutex_unlock(&mgmt->latch);
+    }
+#endif
+    return RC_OK;
+}
+
+// Take the finished requests off the engine, waiting for one if block is set
+// and some request is still running.
+static int collectCompletions(AsyncMgmt *mgmt, bool block) {
+#ifdef HAVE_IO_URING
+    if (mgmt->ringFd >= 0)
+        return reapRing(mgmt, block);
+#endif
+    pthread_mutex_lock(&mgmt->latch);
+    while (block && mgmt->completedHead == -1 && mgmt->outstanding > 0)
+        pthread_cond_wait(&mgmt->completed, &mgmt->latch);
+    int first = mgmt->completedHead;
+    mgmt->completedHead = -1;
+    pthread_mutex_unlock(&mgmt->latch);
+    return first;
+}
+
+// Run the callbacks of finished I/Os in the calling thread, waiting until at
+// least minCompletions have run or nothing is in flight any more. Returns the
+// number of callbacks run; 0 with minCompletions 0 never waits. Callbacks may
+// submit new I/O.
+extern int pollAsyncIO(SM_AsyncEngine *engine, int minCompletions) {
+    if (engine == NULL || engine->mgmtInfo == NULL)
+        return 0;
+    AsyncMgmt *mgmt = (AsyncMgmt *)engine->mgmtInfo;
+    int completed = 0;
+
+    do {
+        int slot = collectCompletions(mgmt, completed < minCompletions);
+        if (slot == -1)
+            break;
+        while (slot != -1) {
+            AsyncRequest *request = &mgmt->requests[slot];
+            int next = request->next;
+            if (request->done != NULL)
+                request->done(request->rc, request->arg);
+            if (request->iov != &request->single)
+                free(request->iov);
+
+            pthread_mutex_lock(&mgmt->latch);
+            request->next = mgmt->freeHead;
+            mgmt->freeHead = slot;
+            mgmt->inUse--;
+            pthread_mutex_unlock(&mgmt->latch);
+            completed++;
+            slot = next;
+        }
+    } while (completed < minCompletions);
+    return completed;
+}
+
+// Wait until every I/O submitted so far finished and its callback ran.
+extern RC waitAsyncIO(SM_AsyncEngine *engine) {
+    if (engine == NULL || engine->mgmtInfo == NULL)
+        return RC_ERROR;
+    AsyncMgmt *mgmt = (AsyncMgmt *)engine->mgmtInfo;
+
+    while (__atomic_load_n(&mgmt->inUse, __ATOMIC_RELAXED) > 0)
+        if (pollAsyncIO(engine, 1) == 0)
+            sched_yield(); // Another thread is running the last callbacks
+    return RC_OK;
+}
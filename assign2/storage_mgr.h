@@ -15,6 +15,20 @@ typedef struct SM_FileHandle {
 
 typedef char* SM_PageHandle;
 
+// Called when an asynchronous I/O finished, with its result and the arg it
+// was submitted with, see pollAsyncIO
+typedef void (*SM_IOCallback) (RC rc, void *arg);
+
+// An asynchronous I/O engine on an open page file, see openAsyncEngine
+typedef struct SM_AsyncEngine {
+  int queueDepth;   // I/Os in flight at most
+  int kernelQueue;  // 1 when backed by io_uring, 0 for the thread pool
+  void *mgmtInfo;
+} SM_AsyncEngine;
+
+#define SM_ASYNC_ANY 0          // io_uring where the kernel has it, the thread pool otherwise
+#define SM_ASYNC_THREAD_POOL 1  // always the thread pool
+
 /************************************************************
  *                    interface                             *
  ************************************************************/
@@ -22,11 +36,13 @@ typedef char* SM_PageHandle;
 extern void initStorageManager (void);
 extern RC createPageFile (char *fileName);
 extern RC openPageFile (char *fileName, SM_FileHandle *fHandle);
+extern RC openPageFileDirect (char *fileName, SM_FileHandle *fHandle);
 extern RC closePageFile (SM_FileHandle *fHandle);
 extern RC destroyPageFile (char *fileName);
 
 /* reading blocks from disc */
 extern RC readBlock (int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage);
+extern RC readBlocks (int pageNum, int numPages, SM_FileHandle *fHandle, SM_PageHandle *memPages);
 extern int getBlockPos (SM_FileHandle *fHandle);
 extern RC readFirstBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
 extern RC readPreviousBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
@@ -36,8 +52,26 @@ extern RC readLastBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
 
 /* writing blocks to a page file */
 extern RC writeBlock (int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage);
+extern RC writeBlocks (int pageNum, int numPages, SM_FileHandle *fHandle, SM_PageHandle *memPages);
 extern RC writeCurrentBlock (SM_FileHandle *fHandle, SM_PageHandle memPage);
 extern RC appendEmptyBlock (SM_FileHandle *fHandle);
+extern RC appendEmptyBlocks (int numPages, SM_FileHandle *fHandle);
 extern RC ensureCapacity (int numberOfPages, SM_FileHandle *fHandle);
+extern RC setGrowthExtent (SM_FileHandle *fHandle, int extentPages);
+
+/* asynchronous block I/O */
+extern RC openAsyncEngine (SM_FileHandle *fHandle, int queueDepth, int backend, SM_AsyncEngine *engine);
+extern RC closeAsyncEngine (SM_AsyncEngine *engine);
+extern RC readBlockAsync (int pageNum, SM_AsyncEngine *engine, SM_PageHandle memPage,
+			  SM_IOCallback done, void *arg);
+extern RC writeBlockAsync (int pageNum, SM_AsyncEngine *engine, SM_PageHandle memPage,
+			   SM_IOCallback done, void *arg);
+extern RC readBlocksAsync (int pageNum, int numPages, SM_AsyncEngine *engine, SM_PageHandle *memPages,
+			   SM_IOCallback done, void *arg);
+extern RC writeBlocksAsync (int pageNum, int numPages, SM_AsyncEngine *engine, SM_PageHandle *memPages,
+			    SM_IOCallback done, void *arg);
+extern RC submitAsyncIO (SM_AsyncEngine *engine);
+extern int pollAsyncIO (SM_AsyncEngine *engine, int minCompletions);
+extern RC waitAsyncIO (SM_AsyncEngine *engine);
 
 #endif
@@ -37,6 +37,16 @@ static void testReadPage (void);
 
 static void testClock (void);
 static void testLFU (void);
+static void testLRU_K (void);
+static void testLFUAging (void);
+static void testARC (void);
+static void testGClock (void);
+static void testReadAhead (void);
+static void testBulkRing (void);
+static void testPinPages (void);
+static void testMappedReadOnly (void);
+static void testPoolStats (void);
+static void testPoolSnapshot (void);
 
 // main method
 int 
@@ -49,6 +59,16 @@ main (void)
   testReadPage();
   testClock();
   testLFU();
+  testLRU_K();
+  testLFUAging();
+  testARC();
+  testGClock();
+  testReadAhead();
+  testBulkRing();
+  testPinPages();
+  testMappedReadOnly();
+  testPoolStats();
+  testPoolSnapshot();
   return 0;
 }
 
@@ -163,10 +183,10 @@ testClock(void)
     "[4 0],[2 0],[0 0],[8 0]",
     "[4 0],[2 0],[5 0],[8 0]",
     "[4 0],[2 0],[5 0],[0 0]",
-    "[9 0],[2 0],[5 0],[0 0]",
-    "[9 0],[8 0],[5 0],[0 0]",
-    "[9 0],[8 0],[3x0],[0 0]",
-    "[9 0],[8 0],[3x0],[2 0]"
+    // hits do not move the hand, so page 4 gets its second chance
+    "[4 0],[9 0],[5 0],[0 0]",
+    "[8 0],[9 0],[5 0],[0 0]",
+    "[8 0],[9 0],[3x0],[0 0]"
     };
     const int orderRequests[]= {3,2,0,8,4,2,5,0,9,8,3,2};
         
@@ -252,3 +272,631 @@ testLFU(void)
     free(h);
     TEST_DONE();
 }
+
+void
+testLRU_K(void)
+{
+    // expected results
+    const char *poolContents[]= {
+
+   "[0 0],[-1 0],[-1 0]",
+   "[0 0],[-1 0],[-1 0]",
+   "[0 0],[1 0],[-1 0]",
+   "[0 0],[1 0],[-1 0]",
+   // the scan over pages 2 to 5 only ever replaces its own pages
+   "[0 0],[1 0],[2 0]",
+   "[0 0],[1 0],[3 0]",
+   "[0 0],[1 0],[4 0]",
+   "[0 0],[1 0],[5 0]",
+   // page 3 keeps its history from before its eviction, so its second
+   // reference is more recent than page 0's and page 0 goes next
+   "[0 0],[1 0],[3 0]",
+   "[6 0],[1 0],[3 0]"
+    };
+    const int orderRequests[]= {0,0,1,1,2,3,4,5,3,6};
+    BM_LRUKParams params = { .k = 2, .correlatedPeriod = 0, .historySize = 8 };
+
+    int i;
+    int snapshot = 0;
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    testName = "Testing LRU-K page replacement";
+
+    CHECK(createPageFile("testbuffer.bin"));
+    createDummyPages(bm, 100);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_LRU_K, &params));
+
+    for (i=0;i<10;i++)
+    {
+        pinPage(bm,h,orderRequests[i]);
+        unpinPage(bm,h);
+        ASSERT_EQUALS_POOL(poolContents[snapshot++], bm, "check pool content using pages");
+    }
+
+    forceFlushPool(bm);
+    ASSERT_EQUALS_INT(0, getNumWriteIO(bm), "check number of write I/Os");
+    ASSERT_EQUALS_INT(8, getNumReadIO(bm), "check number of read I/Os");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// page 0 is used four times, then page 1 twice. Without aging page 0 keeps
+// the higher count and page 1 is replaced; when the counts are halved after
+// every four references, page 0 is down to a count of two, the same as page
+// 1, and goes first as the one that has had that count for longer
+void
+testLFUAging(void)
+{
+    const int orderRequests[]= {0,0,0,0,1,1,2};
+    BM_LFUParams aging = { .agingInterval = 4 };
+
+    int i;
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    testName = "Testing LFU aging";
+
+    CHECK(createPageFile("testbuffer.bin"));
+    createDummyPages(bm, 100);
+
+    CHECK(initBufferPool(bm, "testbuffer.bin", 2, RS_LFU, NULL));
+    for (i=0;i<7;i++)
+    {
+        pinPage(bm,h,orderRequests[i]);
+        unpinPage(bm,h);
+    }
+    ASSERT_EQUALS_POOL("[0 0],[2 0]", bm, "without aging the old favourite stays");
+    CHECK(shutdownBufferPool(bm));
+
+    CHECK(initBufferPool(bm, "testbuffer.bin", 2, RS_LFU, &aging));
+    for (i=0;i<7;i++)
+    {
+        pinPage(bm,h,orderRequests[i]);
+        unpinPage(bm,h);
+    }
+    ASSERT_EQUALS_POOL("[2 0],[1 0]", bm, "with aging the old favourite is replaced");
+    CHECK(shutdownBufferPool(bm));
+
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+void
+testARC(void)
+{
+    // expected results
+    const char *poolContents[]= {
+
+   "[1 0],[-1 0],[-1 0]",
+   "[1 0],[2 0],[-1 0]",
+   "[1 0],[2 0],[3 0]",
+   // page 1 moves to T2, the pages seen once are replaced first
+   "[1 0],[2 0],[3 0]",
+   "[1 0],[4 0],[3 0]",
+   // page 2 was evicted from T1 a moment ago: T1 grows its target and 2 goes to T2
+   "[1 0],[4 0],[2 0]",
+   "[5 0],[4 0],[2 0]",
+   // page 1 was evicted from T2: T1 shrinks its target again
+   "[5 0],[1 0],[2 0]",
+   // the scan only ever replaces pages seen once
+   "[6 0],[1 0],[2 0]",
+   "[7 0],[1 0],[2 0]",
+   "[8 0],[1 0],[2 0]"
+    };
+    const int orderRequests[]= {1,2,3,1,4,2,5,1,6,7,8};
+
+    int i;
+    int snapshot = 0;
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    testName = "Testing ARC page replacement";
+
+    CHECK(createPageFile("testbuffer.bin"));
+    createDummyPages(bm, 100);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_ARC, NULL));
+
+    for (i=0;i<11;i++)
+    {
+        pinPage(bm,h,orderRequests[i]);
+        unpinPage(bm,h);
+        ASSERT_EQUALS_POOL(poolContents[snapshot++], bm, "check pool content using pages");
+    }
+
+    forceFlushPool(bm);
+    ASSERT_EQUALS_INT(0, getNumWriteIO(bm), "check number of write I/Os");
+    ASSERT_EQUALS_INT(10, getNumReadIO(bm), "check number of read I/Os");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+void
+testGClock(void)
+{
+    // expected results
+    const char *poolContents[]= {
+
+   "[1 0],[-1 0],[-1 0]",
+   "[1 0],[2 0],[-1 0]",
+   "[1 0],[2 0],[3 0]",
+   "[1 0],[2 0],[3 0]",
+   "[1 0],[2 0],[3 0]",
+   "[1 0],[2 0],[3 0]",
+   // page 1's counter went up to 3, it outlives the next two replacements
+   "[1 0],[4 0],[3 0]",
+   "[1 0],[4 0],[5 0]",
+   "[6 0],[4 0],[5 0]"
+    };
+    const int orderRequests[]= {1,2,3,1,1,1,4,5,6};
+    BM_GClockParams params = { .maxCount = 3, .initialCount = 1 };
+
+    int i;
+    int snapshot = 0;
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    testName = "Testing GCLOCK page replacement";
+
+    CHECK(createPageFile("testbuffer.bin"));
+    createDummyPages(bm, 100);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_GCLOCK, &params));
+
+    for (i=0;i<9;i++)
+    {
+        pinPage(bm,h,orderRequests[i]);
+        unpinPage(bm,h);
+        ASSERT_EQUALS_POOL(poolContents[snapshot++], bm, "check pool content using pages");
+    }
+    ASSERT_EQUALS_INT(6, getNumReadIO(bm), "check number of read I/Os");
+    CHECK(shutdownBufferPool(bm));
+
+    // with every frame pinned the search gives up instead of spinning
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_CLOCK, NULL));
+    for (i=0;i<3;i++)
+      CHECK(pinPage(bm,h,i));
+    ASSERT_EQUALS_INT(RC_NO_FREE_FRAME, pinPage(bm,h,3), "no frame can be replaced");
+    for (i=0;i<3;i++)
+      {
+        h->pageNum = i;
+        CHECK(unpinPage(bm,h));
+      }
+    CHECK(shutdownBufferPool(bm));
+
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// Test sequential read-ahead: the second pin of an ascending run reads a
+// window ahead, and the next window follows once half of it is used
+void
+testReadAhead(void)
+{
+    // read I/Os after each pin of pages 0 to 7, windows of 4 pages
+    const int readsAfterPin[] = {1,5,5,9,9,9,9,13};
+    BM_PoolOptions options = { .readAheadPages = 4 };
+    char expected[32];
+
+    int i;
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    testName = "Testing sequential read-ahead";
+
+    CHECK(createPageFile("testbuffer.bin"));
+    createDummyPages(bm, 100);
+    CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", 16, RS_LRU, NULL, &options));
+
+    for (i=0;i<8;i++)
+    {
+        CHECK(pinPage(bm,h,i));
+        sprintf(expected, "%s-%i", "Page", i);
+        ASSERT_EQUALS_STRING(expected, h->data, "read-ahead page content");
+        CHECK(unpinPage(bm,h));
+        ASSERT_EQUALS_INT(readsAfterPin[i], getNumReadIO(bm), "check number of read I/Os");
+    }
+    ASSERT_EQUALS_INT(12, getNumPrefetchIO(bm), "pages 1 to 12 were read ahead");
+
+    // a jump ends the run, random pins read single pages
+    CHECK(pinPage(bm,h,50));
+    CHECK(unpinPage(bm,h));
+    CHECK(pinPage(bm,h,30));
+    CHECK(unpinPage(bm,h));
+    ASSERT_EQUALS_INT(15, getNumReadIO(bm), "no read-ahead outside a run");
+
+    // the window never reads past the end of the file
+    for (i=97;i<100;i++)
+    {
+        CHECK(pinPage(bm,h,i));
+        CHECK(unpinPage(bm,h));
+    }
+    ASSERT_EQUALS_INT(18, getNumReadIO(bm), "read-ahead stops at the last page");
+    CHECK(shutdownBufferPool(bm));
+
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// Test bulk reads through a ring: a long scan only cycles through the
+// ring's frames and leaves the other pages alone
+void
+testBulkRing(void)
+{
+    // expected results
+    const char *poolContents[]= {
+   // pages 0 to 7 are used normally, the scan of pages 20 to 59 only takes two frames
+   "[0 0],[1 0],[2 0],[3 0],[4 0],[5 0],[6 0],[7 0],[58 0],[59 0],[-1 0],[-1 0],[-1 0],[-1 0],[-1 0],[-1 0]",
+   // page 59 is pinned normally and stays, so the ring takes a new frame for it
+   "[0 0],[1 0],[2 0],[3 0],[4 0],[5 0],[6 0],[7 0],[60 0],[59 0],[61 0],[-1 0],[-1 0],[-1 0],[-1 0],[-1 0]",
+   // in a full pool the ring's pages are replaced first
+   "[0 0],[1 0],[2 0],[3 0],[4 0],[5 0],[6 0],[7 0],[200 0],[59 0],[61 0],[100 0],[101 0],[102 0],[103 0],[104 0]"
+    };
+    BM_BulkRing ring;
+    char expected[32];
+
+    int i;
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    testName = "Testing bulk read ring";
+
+    CHECK(createPageFile("testbuffer.bin"));
+    createDummyPages(bm, 300);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 16, RS_LRU, NULL));
+    CHECK(initBulkRing(bm, &ring, 2));
+
+    for (i=0;i<8;i++)
+    {
+        CHECK(pinPage(bm,h,i));
+        CHECK(unpinPage(bm,h));
+    }
+    for (i=20;i<60;i++)
+    {
+        CHECK(pinPageBulk(bm,h,i,&ring));
+        sprintf(expected, "%s-%i", "Page", i);
+        ASSERT_EQUALS_STRING(expected, h->data, "page read through the ring");
+        CHECK(unpinPage(bm,h));
+    }
+    ASSERT_EQUALS_POOL(poolContents[0], bm, "check pool content after the scan");
+
+    CHECK(pinPage(bm,h,59));
+    CHECK(unpinPage(bm,h));
+    for (i=60;i<62;i++)
+    {
+        CHECK(pinPageBulk(bm,h,i,&ring));
+        CHECK(unpinPage(bm,h));
+    }
+    ASSERT_EQUALS_POOL(poolContents[1], bm, "check pool content using pages");
+    ASSERT_EQUALS_INT(50, getNumReadIO(bm), "check number of read I/Os");
+
+    for (i=100;i<105;i++)
+    {
+        CHECK(pinPage(bm,h,i));
+        CHECK(unpinPage(bm,h));
+    }
+    CHECK(pinPageBulk(bm,h,62,&ring));
+    CHECK(unpinPage(bm,h));
+    CHECK(pinPage(bm,h,200));
+    CHECK(unpinPage(bm,h));
+    ASSERT_EQUALS_POOL(poolContents[2], bm, "check pool content using pages");
+
+    // the hot pages are all still buffered
+    for (i=0;i<8;i++)
+    {
+        CHECK(pinPage(bm,h,i));
+        CHECK(unpinPage(bm,h));
+    }
+    ASSERT_EQUALS_INT(57, getNumReadIO(bm), "check number of read I/Os");
+
+    CHECK(freeBulkRing(bm, &ring));
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// Test batched pins: hits are pinned in place, the misses are read in page
+// order into the next free frames, and a batch that does not fit pins nothing
+void
+testPinPages(void)
+{
+    // expected results
+    const char *poolContents[]= {
+   "[0 0],[1 0],[2 0],[-1 0],[-1 0],[-1 0],[-1 0],[-1 0]",
+   // page 2 is pinned twice, 7 8 9 and 20 are read in order
+   "[0 0],[1 0],[2 2],[7 1],[8 1],[9 1],[20 1],[-1 0]"
+    };
+    const PageNumber batch[] = {9, 2, 7, 8, 2, 20};
+    PageNumber tooMany[9];
+    BM_PageHandle handles[9];
+    char expected[32];
+    int *fixCounts;
+
+    int i;
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    testName = "Testing batched pins";
+
+    CHECK(createPageFile("testbuffer.bin"));
+    createDummyPages(bm, 50);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 8, RS_LRU, NULL));
+
+    for (i=0;i<3;i++)
+    {
+        CHECK(pinPage(bm,h,i));
+        CHECK(unpinPage(bm,h));
+    }
+    ASSERT_EQUALS_POOL(poolContents[0], bm, "check pool content");
+
+    CHECK(pinPages(bm, handles, batch, 6));
+    ASSERT_EQUALS_POOL(poolContents[1], bm, "check pool content after the batch");
+    ASSERT_EQUALS_INT(7, getNumReadIO(bm), "check number of read I/Os");
+    for (i=0;i<6;i++)
+    {
+        ASSERT_EQUALS_INT(batch[i], handles[i].pageNum, "handle gets its page");
+        sprintf(expected, "%s-%i", "Page", batch[i]);
+        ASSERT_EQUALS_STRING(expected, handles[i].data, "batched page content");
+    }
+    for (i=0;i<6;i++)
+        CHECK(unpinPage(bm,&handles[i]));
+
+    // nine new pages never fit into eight frames
+    for (i=0;i<9;i++)
+        tooMany[i] = 30 + i;
+    ASSERT_EQUALS_INT(RC_NO_FREE_FRAME, pinPages(bm, handles, tooMany, 9), "batch larger than the pool fails");
+    fixCounts = getFixCounts(bm);
+    for (i=0;i<8;i++)
+        ASSERT_EQUALS_INT(0, fixCounts[i], "a failed batch leaves no page pinned");
+    free(fixCounts);
+    ASSERT_EQUALS_INT(7, getNumReadIO(bm), "a failed batch reads nothing");
+
+    CHECK(pinPages(bm, handles, tooMany, 8));
+    for (i=0;i<8;i++)
+    {
+        sprintf(expected, "%s-%i", "Page", tooMany[i]);
+        ASSERT_EQUALS_STRING(expected, handles[i].data, "batched page content");
+        CHECK(unpinPage(bm,&handles[i]));
+    }
+    ASSERT_EQUALS_INT(15, getNumReadIO(bm), "check number of read I/Os");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// Test read-only pins of a mapped page file: unbuffered pages come straight
+// from the mapping without a frame or a read, buffered pages from their frame
+void
+testMappedReadOnly(void)
+{
+    // expected results
+    const char *poolContents[]= {
+   "[-1 0],[-1 0],[-1 0],[-1 0]",
+   "[13 0],[10 0],[11 0],[12 0]"
+    };
+    BM_PoolOptions options = { .mmapFile = true, .accessPattern = BM_ACCESS_RANDOM };
+    BM_PageHandle first;
+    char expected[32];
+
+    int i;
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    testName = "Testing mapped read-only pins";
+
+    CHECK(createPageFile("testbuffer.bin"));
+    createDummyPages(bm, 20);
+    CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", 4, RS_LRU, NULL, &options));
+
+    for (i=0;i<10;i++)
+    {
+        CHECK(pinPageReadOnly(bm,h,i));
+        sprintf(expected, "%s-%i", "Page", i);
+        ASSERT_EQUALS_STRING(expected, h->data, "mapped page content");
+        CHECK(unpinPage(bm,h));
+    }
+    ASSERT_EQUALS_POOL(poolContents[0], bm, "mapped pins take no frame");
+    ASSERT_EQUALS_INT(0, getNumReadIO(bm), "mapped pins read nothing");
+
+    CHECK(pinPageReadOnly(bm,&first,0));
+    ASSERT_EQUALS_INT(RC_ERROR, markDirty(bm,&first), "a mapped page cannot be dirtied");
+
+    // a changed page is read from its frame until it is written back
+    CHECK(pinPage(bm,h,3));
+    sprintf(h->data, "%s-%i", "Changed", 3);
+    CHECK(markDirty(bm,h));
+    CHECK(unpinPage(bm,h));
+    CHECK(pinPageReadOnly(bm,h,3));
+    ASSERT_EQUALS_STRING("Changed-3", h->data, "buffered page comes from its frame");
+    CHECK(unpinPage(bm,h));
+    CHECK(forcePage(bm,h));
+    for (i=10;i<14;i++)
+    {
+        CHECK(pinPage(bm,h,i));
+        CHECK(unpinPage(bm,h));
+    }
+    ASSERT_EQUALS_POOL(poolContents[1], bm, "check pool content");
+    CHECK(pinPageReadOnly(bm,h,3));
+    ASSERT_EQUALS_STRING("Changed-3", h->data, "written page seen through the mapping");
+    CHECK(unpinPage(bm,h));
+
+    // growing the file within the mapping, pages handed out before stay valid
+    CHECK(pinPage(bm,h,40));
+    CHECK(unpinPage(bm,h));
+    CHECK(pinPageReadOnly(bm,h,35));
+    ASSERT_EQUALS_INT(0, h->data[0], "new page of the grown file is empty");
+    CHECK(unpinPage(bm,h));
+    ASSERT_EQUALS_STRING("Page-0", first.data, "page pinned before the remap");
+    CHECK(unpinPage(bm,&first));
+    ASSERT_EQUALS_INT(RC_READ_NON_EXISTING_PAGE, pinPageReadOnly(bm,h,41), "read-only pins do not grow the file");
+
+    // the file grows into the mapping, and past it only with a new one
+    CHECK(pinPageReadOnly(bm,&first,1));
+    CHECK(pinPage(bm,h,600));
+    CHECK(unpinPage(bm,h));
+    CHECK(pinPageReadOnly(bm,h,599));
+    ASSERT_EQUALS_INT(0, h->data[0], "page of the mapping the file grew past");
+    CHECK(unpinPage(bm,h));
+    ASSERT_EQUALS_STRING("Page-1", first.data, "page pinned from the old mapping");
+    CHECK(unpinPage(bm,&first));
+    ASSERT_TRUE(first.data == NULL, "unpinning a mapped page clears the handle");
+
+    CHECK(setAccessPattern(bm, BM_ACCESS_SEQUENTIAL));
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// Test the counters and histograms of getPoolStats
+void
+testPoolStats(void)
+{
+    BM_PoolOptions options = { .readAheadPages = 4 };
+    BM_PoolStats stats;
+    long long bucketSum;
+
+    int i;
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    testName = "Testing pool statistics";
+
+    CHECK(createPageFile("testbuffer.bin"));
+    createDummyPages(bm, 10);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_LRU, NULL));
+
+    // three misses filling the pool, every page dirty
+    for (i=0;i<3;i++)
+    {
+        CHECK(pinPage(bm,h,i));
+        CHECK(markDirty(bm,h));
+        CHECK(unpinPage(bm,h));
+    }
+    // two hits, then a miss that has to write page 0 back first
+    CHECK(pinPage(bm,h,1));
+    CHECK(unpinPage(bm,h));
+    CHECK(pinPage(bm,h,2));
+    CHECK(unpinPage(bm,h));
+    CHECK(pinPage(bm,h,3));
+    CHECK(unpinPage(bm,h));
+
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(6, (int) stats.pins, "pins");
+    ASSERT_EQUALS_INT(2, (int) stats.hits, "hits");
+    ASSERT_EQUALS_INT(4, (int) stats.misses, "misses");
+    ASSERT_EQUALS_INT(4, (int) stats.reads, "reads");
+    ASSERT_EQUALS_INT(4, getNumReadIO(bm), "getNumReadIO counts reads");
+    ASSERT_EQUALS_INT(1, (int) stats.evictions, "evictions");
+    ASSERT_EQUALS_INT(1, (int) stats.syncEvictions, "evictions by pins");
+    ASSERT_EQUALS_INT(1, (int) stats.dirtyEvictions, "dirty evictions");
+    ASSERT_EQUALS_INT(1, (int) stats.writes, "writes");
+    ASSERT_EQUALS_INT(4, (int) stats.pinMiss.count, "timed misses");
+    ASSERT_TRUE(stats.pinHit.count <= stats.hits, "hits are sampled");
+
+    bucketSum = 0;
+    for (i = 0; i < BM_LATENCY_BUCKETS; i++)
+        bucketSum += stats.pinMiss.buckets[i];
+    ASSERT_EQUALS_INT(4, (int) bucketSum, "every miss in a bucket");
+    ASSERT_TRUE(latencyPercentile(&stats.pinMiss, 0.5) <= latencyPercentile(&stats.pinMiss, 1.0),
+                "percentiles are ordered");
+
+    CHECK(forceFlushPool(bm));
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(3, (int) stats.writes, "writes after flush");
+    ASSERT_EQUALS_INT(1, (int) stats.flush.count, "timed flushes");
+    CHECK(shutdownBufferPool(bm));
+
+    // a scan dirtying every page: read-ahead writes dirty victims back too,
+    // but only the victims of pins count as dirty evictions
+    CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", 8, RS_FIFO, NULL, &options));
+    for (i=0;i<20;i++)
+    {
+        CHECK(pinPage(bm,h,i));
+        CHECK(markDirty(bm,h));
+        CHECK(unpinPage(bm,h));
+    }
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT((int) stats.writes, (int) (stats.dirtyEvictions + stats.prefetchWrites), "every write was an eviction");
+    ASSERT_TRUE(stats.prefetchWrites > 0, "read-ahead wrote victims back");
+    ASSERT_TRUE(stats.dirtyEvictions <= stats.syncEvictions, "dirty evictions are evictions by pins");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// Test getPoolSnapshot with caller-owned arrays
+void
+testPoolSnapshot(void)
+{
+    PageNumber pageNums[10];
+    bool dirty[10];
+    int fixCounts[10];
+    BM_PoolSnapshot snapshot = { 0, 10, pageNums, dirty, fixCounts };
+    BM_PageHandle handles[5];
+
+    int i;
+    BM_BufferPool *bm = MAKE_POOL();
+    testName = "Testing pool snapshots";
+
+    CHECK(createPageFile("testbuffer.bin"));
+    createDummyPages(bm, 10);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 8, RS_FIFO, NULL));
+
+    // pages 0 to 4 in frames 0 to 4, page 3 stays pinned and 1 is dirty
+    for (i=0;i<5;i++)
+        CHECK(pinPage(bm,&handles[i],i));
+    CHECK(markDirty(bm,&handles[1]));
+    for (i=0;i<5;i++)
+        if (i != 3)
+            CHECK(unpinPage(bm,&handles[i]));
+
+    CHECK(getPoolSnapshot(bm, &snapshot));
+    ASSERT_EQUALS_INT(8, snapshot.numFrames, "whole pool copied");
+    ASSERT_EQUALS_INT(4, pageNums[4], "page of frame 4");
+    ASSERT_EQUALS_INT(NO_PAGE, pageNums[5], "empty frame");
+    ASSERT_TRUE(dirty[1] && !dirty[0], "dirty flags");
+    ASSERT_EQUALS_INT(1, fixCounts[3], "fix count of the pinned page");
+
+    // a window starting at frame 3, without dirty flags
+    snapshot = (BM_PoolSnapshot) { 3, 2, pageNums, NULL, fixCounts };
+    dirty[0] = true;
+    CHECK(getPoolSnapshot(bm, &snapshot));
+    ASSERT_EQUALS_INT(2, snapshot.numFrames, "window copied");
+    ASSERT_TRUE(pageNums[0] == 3 && pageNums[1] == 4, "pages of the window");
+    ASSERT_TRUE(fixCounts[0] == 1 && fixCounts[1] == 0, "fix counts of the window");
+    ASSERT_TRUE(dirty[0], "skipped array left alone");
+
+    snapshot = (BM_PoolSnapshot) { 6, 10, pageNums, NULL, NULL };
+    CHECK(getPoolSnapshot(bm, &snapshot));
+    ASSERT_EQUALS_INT(2, snapshot.numFrames, "window clipped at the end of the pool");
+
+    CHECK(unpinPage(bm,&handles[3]));
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    TEST_DONE();
+}
@@ -0,0 +1,1094 @@
+#include "storage_mgr.h"
+#include "buffer_mgr_stat.h"
+#include "buffer_mgr.h"
+#include "dberror.h"
+#include "test_helper.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// var to store the current test's name
+char *testName;
+
+// test and helper methods
+static void createDummyPages(BM_BufferPool *bm, int num);
+
+static void testConcurrentStress (void);
+static void testHugePageArena (void);
+static void testBackgroundWriter (void);
+static void testPrefetch (void);
+static void testCoalescedFlush (void);
+static void testDirectIO (void);
+static void testAsyncIO (void);
+static void testFileGrowth (void);
+static void testPageLatches (void);
+static void testOptimisticReads (void);
+static void testBatchedReferences (void);
+
+// main method
+int
+main (void)
+{
+  initStorageManager();
+  testName = "";
+
+  testConcurrentStress();
+  testHugePageArena();
+  testBackgroundWriter();
+  testPrefetch();
+  testCoalescedFlush();
+  testDirectIO();
+  testAsyncIO();
+  testFileGrowth();
+  testPageLatches();
+  testOptimisticReads();
+  testBatchedReferences();
+  return 0;
+}
+
+// create n pages with content "Page X"
+void
+createDummyPages(BM_BufferPool *bm, int num)
+{
+  int i;
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+
+  CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_FIFO, NULL));
+
+  for (i = 0; i < num; i++)
+    {
+      CHECK(pinPage(bm, h, i));
+      memset(h->data, 0, PAGE_SIZE);
+      sprintf(h->data, "%s-%i", "Page", h->pageNum);
+      CHECK(markDirty(bm, h));
+      CHECK(unpinPage(bm,h));
+    }
+
+  CHECK(shutdownBufferPool(bm));
+
+  free(h);
+}
+
+/************************************************************
+ *                  concurrent stress test                  *
+ ************************************************************/
+
+#define STRESS_PAGES 200
+#define STRESS_FRAMES 32
+#define STRESS_THREADS 8
+#define STRESS_OPS 20000
+#define STRESS_SLOT(data, t) ((int *) ((data) + 64) + (t))
+#define STRESS_SCANS 20
+
+typedef struct StressWorker {
+  BM_BufferPool *bm;
+  int id;
+  int errors;
+  int updates[STRESS_PAGES];
+} StressWorker;
+
+// every thread owns one counter slot in each page, so threads sharing a page
+// never write the same bytes and every lost update is the pool's fault
+static void *
+runStressWorker (void *arg)
+{
+  StressWorker *w = (StressWorker *) arg;
+  BM_PageHandle h;
+  char expected[32];
+  unsigned int state = 17 + w->id;
+  int i;
+
+  for (i = 0; i < STRESS_OPS; i++)
+    {
+      int pageNum = rand_r(&state) % STRESS_PAGES;
+
+      if (pinPage(w->bm, &h, pageNum) != RC_OK || h.pageNum != pageNum)
+        {
+          w->errors++;
+          continue;
+        }
+
+      sprintf(expected, "%s-%i", "Page", pageNum);
+      if (strcmp(expected, h.data) != 0)
+        w->errors++;
+
+      (*STRESS_SLOT(h.data, w->id))++;
+      w->updates[pageNum]++;
+      if (markDirty(w->bm, &h) != RC_OK)
+        w->errors++;
+      if (i % 97 == 0 && forcePage(w->bm, &h) != RC_OK)
+        w->errors++;
+      if (unpinPage(w->bm, &h) != RC_OK)
+        w->errors++;
+    }
+  return NULL;
+}
+
+// sweeps over all pages through a bulk ring while the others update them
+static void *
+runStressScanner (void *arg)
+{
+  StressWorker *w = (StressWorker *) arg;
+  BM_BulkRing ring;
+  BM_PageHandle h;
+  char expected[32];
+  int i, pass;
+
+  if (initBulkRing(w->bm, &ring, 4) != RC_OK)
+    {
+      w->errors++;
+      return NULL;
+    }
+  for (pass = 0; pass < STRESS_SCANS; pass++)
+    for (i = 0; i < STRESS_PAGES; i++)
+      {
+        if (pinPageBulk(w->bm, &h, i, &ring) != RC_OK || h.pageNum != i)
+          {
+            w->errors++;
+            continue;
+          }
+        sprintf(expected, "%s-%i", "Page", i);
+        if (strcmp(expected, h.data) != 0)
+          w->errors++;
+        if (unpinPage(w->bm, &h) != RC_OK)
+          w->errors++;
+      }
+  freeBulkRing(w->bm, &ring);
+  return NULL;
+}
+
+static void
+runStress (ReplacementStrategy strategy)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  BM_PoolOptions options = { .concurrent = true, .numPartitions = 8 };
+  StressWorker workers[STRESS_THREADS], scanner;
+  pthread_t threads[STRESS_THREADS], scannerThread;
+  int i, t, errors = 0, mismatches = 0;
+
+  CHECK(createPageFile("testbuffer.bin"));
+  createDummyPages(bm, STRESS_PAGES);
+
+  CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", STRESS_FRAMES, strategy, NULL, &options));
+  memset(&scanner, 0, sizeof(StressWorker));
+  scanner.bm = bm;
+  pthread_create(&scannerThread, NULL, runStressScanner, &scanner);
+  for (t = 0; t < STRESS_THREADS; t++)
+    {
+      memset(&workers[t], 0, sizeof(StressWorker));
+      workers[t].bm = bm;
+      workers[t].id = t;
+      pthread_create(&threads[t], NULL, runStressWorker, &workers[t]);
+    }
+  for (t = 0; t < STRESS_THREADS; t++)
+    {
+      pthread_join(threads[t], NULL);
+      errors += workers[t].errors;
+    }
+  pthread_join(scannerThread, NULL);
+  errors += scanner.errors;
+  ASSERT_EQUALS_INT(0, errors, "no failed operation or wrong page content under concurrency");
+  CHECK(shutdownBufferPool(bm));
+
+  // read everything back single threaded and compare every thread's counters
+  CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_FIFO, NULL));
+  for (i = 0; i < STRESS_PAGES; i++)
+    {
+      CHECK(pinPage(bm, h, i));
+      for (t = 0; t < STRESS_THREADS; t++)
+        if (*STRESS_SLOT(h->data, t) != workers[t].updates[i])
+          mismatches++;
+      CHECK(unpinPage(bm, h));
+    }
+  ASSERT_EQUALS_INT(0, mismatches, "every update survived eviction and write back");
+  CHECK(shutdownBufferPool(bm));
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+}
+
+// several threads pin, modify, force and unpin pages of one shared pool
+void
+testConcurrentStress (void)
+{
+  testName = "Concurrent pin/unpin stress test";
+
+  runStress(RS_FIFO);
+  runStress(RS_LRU);
+  runStress(RS_CLOCK);
+  runStress(RS_LFU);
+  runStress(RS_LRU_K);
+  runStress(RS_ARC);
+  runStress(RS_GCLOCK);
+
+  TEST_DONE();
+}
+
+// a pool whose frame arena asks for huge pages behaves like any other pool,
+// whether or not the system can actually hand them out
+void
+testHugePageArena (void)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  BM_PoolOptions options = { .hugePages = true };
+  char expected[32];
+  int i;
+
+  testName = "Huge page frame arena";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  createDummyPages(bm, 20);
+
+  CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", 5, RS_LRU, NULL, &options));
+  for (i = 0; i < 20; i++)
+    {
+      CHECK(pinPage(bm, h, i));
+      sprintf(expected, "%s-%i", "Page", i);
+      ASSERT_EQUALS_STRING(expected, h->data, "reading back dummy page content");
+      CHECK(unpinPage(bm, h));
+    }
+  CHECK(shutdownBufferPool(bm));
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+// dirty pages that are next in line for eviction get written back by the
+// writer thread, so the misses after that never have to write a victim
+void
+testBackgroundWriter (void)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  BM_PoolOptions options = { .backgroundWriter = true, .writerDelayMs = 1, .writerBatchSize = 4 };
+  char expected[32];
+  bool *dirty;
+  int i, waited;
+
+  testName = "Background writer";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  createDummyPages(bm, 40);
+
+  CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", 16, RS_LRU, NULL, &options));
+  for (i = 0; i < 10; i++)
+    {
+      CHECK(pinPage(bm, h, i));
+      sprintf(h->data, "%s-%i", "Clean", i);
+      CHECK(markDirty(bm, h));
+      CHECK(unpinPage(bm, h));
+    }
+
+  for (waited = 0; getNumBackgroundWriteIO(bm) < 10 && waited < 5000; waited++)
+    usleep(1000);
+  ASSERT_EQUALS_INT(10, getNumBackgroundWriteIO(bm), "the writer cleaned every dirty page");
+  dirty = getDirtyFlags(bm);
+  for (i = 0; i < 16; i++)
+    ASSERT_TRUE(!dirty[i], "no frame is dirty any more");
+  free(dirty);
+
+  // replace the cleaned pages
+  for (i = 10; i < 40; i++)
+    {
+      CHECK(pinPage(bm, h, i));
+      CHECK(unpinPage(bm, h));
+    }
+  ASSERT_EQUALS_INT(0, getNumSyncWriteIO(bm), "no victim had to be written inside pinPage");
+  CHECK(shutdownBufferPool(bm));
+
+  CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_FIFO, NULL));
+  for (i = 0; i < 10; i++)
+    {
+      CHECK(pinPage(bm, h, i));
+      sprintf(expected, "%s-%i", "Clean", i);
+      ASSERT_EQUALS_STRING(expected, h->data, "background writes reached the file");
+      CHECK(unpinPage(bm, h));
+    }
+  CHECK(shutdownBufferPool(bm));
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+// pages read ahead by the prefetch threads are hits for the pins that follow
+void
+testPrefetch (void)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  BM_PoolOptions options = { .prefetchThreads = 2 };
+  PageNumber pages[10];
+  char expected[32];
+  int i, waited;
+
+  testName = "Prefetch pages";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  createDummyPages(bm, 20);
+
+  CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", 16, RS_LRU, NULL, &options));
+  for (i = 0; i < 10; i++)
+    pages[i] = i;
+  CHECK(prefetchPages(bm, pages, 10));
+  for (waited = 0; getNumPrefetchIO(bm) < 10 && waited < 5000; waited++)
+    usleep(1000);
+  ASSERT_EQUALS_INT(10, getNumPrefetchIO(bm), "every requested page was read ahead");
+
+  for (i = 0; i < 10; i++)
+    {
+      CHECK(pinPage(bm, h, i));
+      sprintf(expected, "%s-%i", "Page", i);
+      ASSERT_EQUALS_STRING(expected, h->data, "prefetched page content");
+      CHECK(unpinPage(bm, h));
+    }
+  ASSERT_EQUALS_INT(10, getNumReadIO(bm), "pins of prefetched pages are hits");
+
+  // pages racing with their prefetch are still read only once
+  for (i = 0; i < 10; i++)
+    pages[i] = 10 + i;
+  CHECK(prefetchPages(bm, pages, 10));
+  for (i = 10; i < 20; i++)
+    {
+      CHECK(pinPage(bm, h, i));
+      sprintf(expected, "%s-%i", "Page", i);
+      ASSERT_EQUALS_STRING(expected, h->data, "page pinned during its prefetch");
+      CHECK(unpinPage(bm, h));
+    }
+  ASSERT_EQUALS_INT(20, getNumReadIO(bm), "no page was read twice");
+  CHECK(shutdownBufferPool(bm));
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+// a flush writes the dirty pages in page order, split over several threads,
+// and leaves pinned pages alone
+void
+testCoalescedFlush (void)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  BM_PageHandle pinned;
+  BM_PoolOptions options = { .flushThreads = 3 };
+  unsigned int state = 3;
+  PageNumber order[1000];
+  PageNumber *frameContents;
+  bool *dirty;
+  char expected[32];
+  int i;
+
+  testName = "Coalesced flush";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", 1000, RS_LRU, NULL, &options));
+
+  // fill the frames in random page order
+  for (i = 0; i < 1000; i++)
+    order[i] = i;
+  for (i = 999; i > 0; i--)
+    {
+      int k = rand_r(&state) % (i + 1);
+      PageNumber tmp = order[i];
+
+      order[i] = order[k];
+      order[k] = tmp;
+    }
+  for (i = 0; i < 1000; i++)
+    {
+      CHECK(pinPage(bm, h, order[i]));
+      sprintf(h->data, "%s-%i", "Flush", order[i]);
+      CHECK(markDirty(bm, h));
+      CHECK(unpinPage(bm, h));
+    }
+  CHECK(pinPage(bm, &pinned, 500));
+
+  CHECK(forceFlushPool(bm));
+  ASSERT_EQUALS_INT(999, getNumWriteIO(bm), "every unpinned dirty page was written once");
+  frameContents = getFrameContents(bm);
+  dirty = getDirtyFlags(bm);
+  for (i = 0; i < 1000; i++)
+    ASSERT_TRUE(dirty[i] == (frameContents[i] == 500), "only the pinned page is still dirty");
+  free(frameContents);
+  free(dirty);
+
+  CHECK(unpinPage(bm, &pinned));
+  CHECK(shutdownBufferPool(bm));
+
+  CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_FIFO, NULL));
+  for (i = 0; i < 1000; i++)
+    {
+      CHECK(pinPage(bm, h, i));
+      sprintf(expected, "%s-%i", "Flush", i);
+      ASSERT_EQUALS_STRING(expected, h->data, "flushed page content");
+      CHECK(unpinPage(bm, h));
+    }
+  CHECK(shutdownBufferPool(bm));
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+// a pool doing direct I/O reads and writes the same pages as any other pool,
+// and the storage manager copes with buffers that are not aligned
+void
+testDirectIO (void)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  BM_PoolOptions options = { .directIO = true };
+  SM_FileHandle fh;
+  char *buffer = malloc(PAGE_SIZE + 1);
+  char expected[32];
+  int i;
+
+  testName = "Direct I/O";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  createDummyPages(bm, 10);
+
+  CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", 5, RS_LRU, NULL, &options));
+  for (i = 0; i < 30; i++)
+    {
+      CHECK(pinPage(bm, h, i));
+      if (i < 10)
+        {
+          sprintf(expected, "%s-%i", "Page", i);
+          ASSERT_EQUALS_STRING(expected, h->data, "reading back dummy page content");
+        }
+      sprintf(h->data, "%s-%i", "Direct", i);
+      CHECK(markDirty(bm, h));
+      CHECK(unpinPage(bm, h));
+    }
+  CHECK(shutdownBufferPool(bm));
+
+  // read back without direct I/O, the page cache must not hide stale pages
+  CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_FIFO, NULL));
+  for (i = 0; i < 30; i++)
+    {
+      CHECK(pinPage(bm, h, i));
+      sprintf(expected, "%s-%i", "Direct", i);
+      ASSERT_EQUALS_STRING(expected, h->data, "pages written with direct I/O");
+      CHECK(unpinPage(bm, h));
+    }
+  CHECK(shutdownBufferPool(bm));
+
+  // a misaligned buffer is read and written through an aligned copy
+  if (openPageFileDirect("testbuffer.bin", &fh) == RC_OK)
+    {
+      CHECK(readBlock(7, &fh, buffer + 1));
+      ASSERT_EQUALS_STRING("Direct-7", buffer + 1, "misaligned direct read");
+      sprintf(buffer + 1, "%s-%i", "Unaligned", 7);
+      CHECK(writeBlock(7, &fh, buffer + 1));
+      memset(buffer, 0, PAGE_SIZE + 1);
+      CHECK(readBlock(7, &fh, buffer + 1));
+      ASSERT_EQUALS_STRING("Unaligned-7", buffer + 1, "misaligned direct write");
+      CHECK(closePageFile(&fh));
+    }
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(buffer);
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+/************************************************************
+ *                   asynchronous I/O test                  *
+ ************************************************************/
+
+typedef struct AsyncCheck {
+  int done;
+  int errors;
+} AsyncCheck;
+
+static void
+countCompletion (RC rc, void *arg)
+{
+  AsyncCheck *check = (AsyncCheck *) arg;
+
+  check->done++;
+  if (rc != RC_OK)
+    check->errors++;
+}
+
+void
+testAsyncIO (void)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  BM_PageHandle handles[10];
+  BM_PoolOptions options = { .ioQueueDepth = 8 };
+  SM_FileHandle fh;
+  SM_AsyncEngine engine;
+  SM_PageHandle data[4];
+  PageNumber pages[10];
+  char expected[32];
+  int backends[] = { SM_ASYNC_ANY, SM_ASYNC_THREAD_POOL };
+  int b, i;
+
+  testName = "Asynchronous I/O";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  createDummyPages(bm, 20);
+
+  // the engine itself, with io_uring where the kernel has it and with threads
+  for (i = 0; i < 4; i++)
+    data[i] = calloc(PAGE_SIZE, 1);
+  CHECK(openPageFile("testbuffer.bin", &fh));
+  for (b = 0; b < 2; b++)
+    {
+      AsyncCheck check = { 0, 0 };
+
+      CHECK(openAsyncEngine(&fh, 2, backends[b], &engine));
+      for (i = 0; i < 4; i++)
+        sprintf(data[i], "%s-%i-%i", "Async", b, i);
+      CHECK(writeBlocksAsync(4, 4, &engine, data, countCompletion, &check));
+      CHECK(waitAsyncIO(&engine));
+      ASSERT_TRUE(check.done == 1 && check.errors == 0, "vectored write completed");
+
+      for (i = 0; i < 4; i++)
+        {
+          memset(data[i], 0, PAGE_SIZE);
+          CHECK(readBlockAsync(4 + i, &engine, data[i], countCompletion, &check));
+        }
+      while (check.done < 5)
+        pollAsyncIO(&engine, 1);
+      ASSERT_TRUE(check.errors == 0, "single page reads completed");
+      for (i = 0; i < 4; i++)
+        {
+          sprintf(expected, "%s-%i-%i", "Async", b, i);
+          ASSERT_EQUALS_STRING(expected, data[i], "reading back asynchronous write");
+        }
+
+      // writes may not grow the file
+      ASSERT_TRUE(writeBlockAsync(20, &engine, data[0], countCompletion, &check) != RC_OK,
+                  "write past the end of file rejected");
+
+      // a read running into the end of the file comes back short: the rest
+      // is read again from where it stopped, which finds nothing and fails
+      ASSERT_TRUE(truncate("testbuffer.bin", 19 * PAGE_SIZE + PAGE_SIZE / 2) == 0, "file cut in page 19");
+      check.done = check.errors = 0;
+      CHECK(readBlocksAsync(16, 4, &engine, data, countCompletion, &check));
+      CHECK(submitAsyncIO(&engine));
+      CHECK(waitAsyncIO(&engine));
+      ASSERT_TRUE(check.done == 1 && check.errors == 1, "short read failed");
+      for (i = 0; i < 3; i++)
+        {
+          sprintf(expected, "%s-%i", "Page", 16 + i);
+          ASSERT_EQUALS_STRING(expected, data[i], "pages before the end were read");
+        }
+      ASSERT_TRUE(truncate("testbuffer.bin", 20 * PAGE_SIZE) == 0, "file restored");
+      memset(data[0], 0, PAGE_SIZE);
+      sprintf(data[0], "%s-%i", "Page", 19);
+      CHECK(writeBlock(19, &fh, data[0]));
+      CHECK(closeAsyncEngine(&engine));
+    }
+  CHECK(closePageFile(&fh));
+  for (i = 0; i < 4; i++)
+    free(data[i]);
+
+  // a pool with a queue depth prefetches without threads and reads batches and
+  // flushes through the engine
+  CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", 16, RS_LRU, NULL, &options));
+  for (i = 0; i < 4; i++)
+    pages[i] = i;
+  CHECK(prefetchPages(bm, pages, 4));
+  for (i = 0; i < 4; i++)
+    {
+      CHECK(pinPage(bm, h, i));
+      sprintf(expected, "%s-%i", "Page", i);
+      ASSERT_EQUALS_STRING(expected, h->data, "reading prefetched page");
+      CHECK(unpinPage(bm, h));
+    }
+  ASSERT_EQUALS_INT(4, getNumPrefetchIO(bm), "pages read by prefetchPages");
+
+  for (i = 0; i < 10; i++)
+    pages[i] = 10 + (i * 3) % 10;
+  CHECK(pinPages(bm, handles, pages, 10));
+  for (i = 0; i < 10; i++)
+    {
+      sprintf(expected, "%s-%i", "Page", pages[i]);
+      ASSERT_EQUALS_STRING(expected, handles[i].data, "reading batched page");
+      sprintf(handles[i].data, "%s-%i", "Flushed", pages[i]);
+      CHECK(markDirty(bm, &handles[i]));
+      CHECK(unpinPage(bm, &handles[i]));
+    }
+  ASSERT_EQUALS_INT(14, getNumReadIO(bm), "reads of prefetch and batch");
+  CHECK(forceFlushPool(bm));
+  ASSERT_EQUALS_INT(10, getNumWriteIO(bm), "pages written by forceFlushPool");
+  CHECK(shutdownBufferPool(bm));
+
+  CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_FIFO, NULL));
+  for (i = 10; i < 20; i++)
+    {
+      CHECK(pinPage(bm, h, i));
+      sprintf(expected, "%s-%i", "Flushed", i);
+      ASSERT_EQUALS_STRING(expected, h->data, "pages flushed asynchronously");
+      CHECK(unpinPage(bm, h));
+    }
+  CHECK(shutdownBufferPool(bm));
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+/************************************************************
+ *                    file growth test                      *
+ ************************************************************/
+
+static long
+fileSize (char *fileName)
+{
+  struct stat info;
+
+  return stat(fileName, &info) == 0 ? (long) info.st_size : -1;
+}
+
+// disk space held by the file, reserved space past its end included
+static long
+fileAllocated (char *fileName)
+{
+  struct stat info;
+
+  return stat(fileName, &info) == 0 ? (long) info.st_blocks * 512 : -1;
+}
+
+void
+testFileGrowth (void)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle *h = MAKE_PAGE_HANDLE();
+  BM_PoolOptions options = { .fileExtentPages = 64 };
+  SM_FileHandle fh;
+  char *page = malloc(PAGE_SIZE);
+  int i, zeros;
+
+  testName = "File growth";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  CHECK(openPageFile("testbuffer.bin", &fh));
+
+  // one call for many pages, which read as zeros
+  CHECK(appendEmptyBlocks(1000, &fh));
+  ASSERT_EQUALS_INT(1001, fh.totalNumPages, "pages after appendEmptyBlocks");
+  ASSERT_TRUE(fileSize("testbuffer.bin") == 1001L * PAGE_SIZE, "file size after appendEmptyBlocks");
+  memset(page, 1, PAGE_SIZE);
+  CHECK(readBlock(777, &fh, page));
+  for (i = 0, zeros = 0; i < PAGE_SIZE; i++)
+    zeros += page[i] == 0;
+  ASSERT_EQUALS_INT(PAGE_SIZE, zeros, "appended page is empty");
+  CHECK(ensureCapacity(1500, &fh));
+  ASSERT_EQUALS_INT(1500, fh.totalNumPages, "pages after ensureCapacity");
+  CHECK(ensureCapacity(10, &fh));
+  ASSERT_EQUALS_INT(1500, fh.totalNumPages, "ensureCapacity never shrinks");
+
+  // with an extent the size still grows page by page
+  CHECK(setGrowthExtent(&fh, 64));
+  for (i = 0; i < 10; i++)
+    CHECK(appendEmptyBlock(&fh));
+  ASSERT_EQUALS_INT(1510, fh.totalNumPages, "pages after appends with an extent");
+  ASSERT_TRUE(fileSize("testbuffer.bin") == 1510L * PAGE_SIZE, "file size after appends with an extent");
+  sprintf(page, "%s-%i", "Page", 1509);
+  CHECK(writeBlock(1509, &fh, page));
+  CHECK(closePageFile(&fh));
+  ASSERT_TRUE(fileSize("testbuffer.bin") == 1510L * PAGE_SIZE, "file size after close");
+  ASSERT_TRUE(fileAllocated("testbuffer.bin") <= 1510L * PAGE_SIZE, "close gives back the reserved space");
+
+  // a pool growing the file by pinning past its end
+  CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", 4, RS_LRU, NULL, &options));
+  for (i = 1510; i < 1530; i++)
+    {
+      CHECK(pinPage(bm, h, i));
+      CHECK(unpinPage(bm, h));
+    }
+  CHECK(pinPage(bm, h, 1509));
+  ASSERT_EQUALS_STRING("Page-1509", h->data, "page written before the pool grew the file");
+  CHECK(unpinPage(bm, h));
+  CHECK(shutdownBufferPool(bm));
+  ASSERT_TRUE(fileSize("testbuffer.bin") == 1530L * PAGE_SIZE, "file size after the pool grew it");
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(page);
+  free(bm);
+  free(h);
+  TEST_DONE();
+}
+
+/************************************************************
+ *                  shared/exclusive page latches           *
+ ************************************************************/
+
+#define LATCH_PAGES 4
+#define LATCH_THREADS 6
+#define LATCH_OPS 4000
+#define LATCH_WORDS 64
+
+typedef struct LatchWorker {
+  BM_BufferPool *bm;
+  int id;
+  int errors;
+  int writes[LATCH_PAGES];
+} LatchWorker;
+
+// writers bump every word of a page one at a time under the exclusive latch,
+// so a reader holding the shared latch must see all words equal
+static void *
+runLatchWorker (void *arg)
+{
+  LatchWorker *w = (LatchWorker *) arg;
+  BM_PageHandle h;
+  unsigned int state = 31 + w->id;
+  int i, k;
+
+  for (i = 0; i < LATCH_OPS; i++)
+    {
+      int pageNum = rand_r(&state) % LATCH_PAGES;
+      int *words;
+
+      if (rand_r(&state) % 4 == 0)
+        {
+          if (pinPageExclusive(w->bm, &h, pageNum) != RC_OK)
+            {
+              w->errors++;
+              continue;
+            }
+          words = (int *) h.data;
+          for (k = 0; k < LATCH_WORDS; k++)
+            {
+              words[k]++;
+              if (k == LATCH_WORDS / 2)
+                sched_yield();
+            }
+          w->writes[pageNum]++;
+          if (markDirty(w->bm, &h) != RC_OK)
+            w->errors++;
+        }
+      else
+        {
+          if (pinPageShared(w->bm, &h, pageNum) != RC_OK)
+            {
+              w->errors++;
+              continue;
+            }
+          words = (int *) h.data;
+          for (k = 1; k < LATCH_WORDS; k++)
+            if (words[k] != words[0])
+              w->errors++;
+          if (markDirty(w->bm, &h) != RC_PAGE_NOT_EXCLUSIVE)
+            w->errors++;
+        }
+      if (unpinPage(w->bm, &h) != RC_OK)
+        w->errors++;
+    }
+  return NULL;
+}
+
+void
+testPageLatches (void)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle reader1, reader2, writer, plain, forged;
+  BM_PoolOptions options = { .concurrent = true };
+  BM_PoolOptions strict = { .strictLatches = true };
+  LatchWorker workers[LATCH_THREADS];
+  pthread_t threads[LATCH_THREADS];
+  int *fixCounts;
+  bool *dirty;
+  int i, t, errors = 0, expected;
+
+  testName = "Shared and exclusive page latches";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_LRU, NULL));
+
+  // shared holders of one page do not wait for each other, and cannot dirty it
+  CHECK(pinPageShared(bm, &reader1, LATCH_PAGES));
+  CHECK(pinPageShared(bm, &reader2, LATCH_PAGES));
+  ASSERT_EQUALS_INT(BM_LATCH_SHARED, reader2.latch, "handle holds the shared latch");
+  // a thread never waits for a latch it holds itself
+  ASSERT_EQUALS_INT(RC_LATCH_HELD, pinPageExclusive(bm, &writer, LATCH_PAGES), "no exclusive latch over the thread's shared one");
+  ASSERT_EQUALS_INT(RC_PAGE_NOT_EXCLUSIVE, markDirty(bm, &reader1), "no markDirty under a shared latch");
+  CHECK(pinPage(bm, &plain, LATCH_PAGES));
+  ASSERT_EQUALS_INT(RC_PAGE_NOT_EXCLUSIVE, markDirty(bm, &plain), "no markDirty while others latch the page");
+  // a handle filled in by the caller, with whatever its latch field holds, drops only its pin
+  forged = (BM_PageHandle) { LATCH_PAGES, NULL, BM_LATCH_SHARED };
+  CHECK(unpinPage(bm, &forged));
+  forged = (BM_PageHandle) { LATCH_PAGES, plain.data, BM_LATCH_EXCLUSIVE };
+  ASSERT_EQUALS_INT(RC_PAGE_NOT_EXCLUSIVE, markDirty(bm, &forged), "a latch field alone does not allow markDirty");
+  ASSERT_EQUALS_INT(RC_PAGE_NOT_EXCLUSIVE, markDirty(bm, &plain), "the readers still hold the latch");
+  CHECK(unpinPage(bm, &reader1));
+  ASSERT_EQUALS_INT(BM_LATCH_NONE, reader1.latch, "unpinPage releases the latch");
+  CHECK(unpinPage(bm, &reader2));
+
+  // once the readers are gone the page can be latched exclusively and changed
+  CHECK(pinPageExclusive(bm, &writer, LATCH_PAGES));
+  ASSERT_EQUALS_INT(RC_LATCH_HELD, pinPageExclusive(bm, &reader1, LATCH_PAGES), "no second exclusive latch");
+  ASSERT_EQUALS_INT(RC_LATCH_HELD, pinPageShared(bm, &reader1, LATCH_PAGES), "no shared latch over the exclusive one");
+  sprintf(writer.data, "%s-%i", "Page", LATCH_PAGES);
+  CHECK(markDirty(bm, &writer));
+  CHECK(unpinPage(bm, &writer));
+  fixCounts = getFixCounts(bm);
+  dirty = getDirtyFlags(bm);
+  ASSERT_TRUE(fixCounts[0] == 0 && dirty[0], "latched page unpinned and dirty");
+  free(fixCounts);
+  free(dirty);
+
+  // pins without a latch can still dirty a page nobody latches
+  CHECK(pinPage(bm, &plain, 0));
+  CHECK(markDirty(bm, &plain));
+  CHECK(unpinPage(bm, &plain));
+  CHECK(shutdownBufferPool(bm));
+
+  // but not in a pool with strict latches
+  CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", 3, RS_LRU, NULL, &strict));
+  CHECK(pinPage(bm, &plain, 0));
+  ASSERT_EQUALS_INT(RC_PAGE_NOT_EXCLUSIVE, markDirty(bm, &plain), "no markDirty without the exclusive latch");
+  CHECK(unpinPage(bm, &plain));
+  CHECK(pinPageExclusive(bm, &writer, 0));
+  CHECK(markDirty(bm, &writer));
+  CHECK(unpinPage(bm, &writer));
+  CHECK(shutdownBufferPool(bm));
+
+  // readers and writers of a few hot pages in a concurrent pool
+  CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", LATCH_PAGES, RS_CLOCK, NULL, &options));
+  for (t = 0; t < LATCH_THREADS; t++)
+    {
+      memset(&workers[t], 0, sizeof(LatchWorker));
+      workers[t].bm = bm;
+      workers[t].id = t;
+      pthread_create(&threads[t], NULL, runLatchWorker, &workers[t]);
+    }
+  for (t = 0; t < LATCH_THREADS; t++)
+    {
+      pthread_join(threads[t], NULL);
+      errors += workers[t].errors;
+    }
+  ASSERT_EQUALS_INT(0, errors, "readers never see a page half written");
+  fixCounts = getFixCounts(bm);
+  for (i = 0; i < LATCH_PAGES; i++)
+    ASSERT_EQUALS_INT(0, fixCounts[i], "no pin left behind");
+  free(fixCounts);
+  for (i = 0; i < LATCH_PAGES; i++)
+    {
+      CHECK(pinPageShared(bm, &reader1, i));
+      for (t = 0, expected = 0; t < LATCH_THREADS; t++)
+        expected += workers[t].writes[i];
+      ASSERT_EQUALS_INT(expected, *(int *) reader1.data, "every exclusive update survived");
+      CHECK(unpinPage(bm, &reader1));
+    }
+  CHECK(shutdownBufferPool(bm));
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  TEST_DONE();
+}
+
+/************************************************************
+ *                  optimistic reads                        *
+ ************************************************************/
+
+#define OPTIMISTIC_THREADS 6
+#define OPTIMISTIC_OPS 4000
+#define OPTIMISTIC_FIRST 8 // hot pages start here, after the dummy pages
+
+typedef struct OptimisticWorker {
+  BM_BufferPool *bm;
+  int id;
+  int errors;
+  int validated;
+} OptimisticWorker;
+
+// readers copy the words of a page without a pin and keep the copy only if
+// it validates, writers change all words under the exclusive latch and now
+// and then a miss on another page replaces the hot pages
+static void *
+runOptimisticWorker (void *arg)
+{
+  OptimisticWorker *w = (OptimisticWorker *) arg;
+  BM_OptimisticRead read;
+  BM_PageHandle h;
+  unsigned int state = 53 + w->id;
+  int copy[LATCH_WORDS];
+  int i, k;
+
+  for (i = 0; i < OPTIMISTIC_OPS; i++)
+    {
+      int pageNum = OPTIMISTIC_FIRST + rand_r(&state) % LATCH_PAGES;
+      int kind = rand_r(&state) % 10;
+
+      if (kind == 0)
+        {
+          if (pinPageExclusive(w->bm, &h, pageNum) != RC_OK)
+            {
+              w->errors++;
+              continue;
+            }
+          for (k = 0; k < LATCH_WORDS; k++)
+            {
+              ((int *) h.data)[k]++;
+              if (k == LATCH_WORDS / 2)
+                sched_yield();
+            }
+          if (markDirty(w->bm, &h) != RC_OK || unpinPage(w->bm, &h) != RC_OK)
+            w->errors++;
+        }
+      else if (kind == 1)
+        {
+          if (pinPage(w->bm, &h, LATCH_PAGES + pageNum) != RC_OK || unpinPage(w->bm, &h) != RC_OK)
+            w->errors++;
+        }
+      else
+        {
+          if (startOptimisticRead(w->bm, &read, pageNum) != RC_OK)
+            {
+              w->errors++;
+              continue;
+            }
+          for (k = 0; k < LATCH_WORDS; k++)
+            {
+              copy[k] = ((volatile int *) read.data)[k];
+              if (k == LATCH_WORDS / 2 && i % 7 == 0)
+                sched_yield();
+            }
+          if (validateOptimisticRead(w->bm, &read) != RC_OK)
+            continue;
+          w->validated++;
+          for (k = 1; k < LATCH_WORDS; k++)
+            if (copy[k] != copy[0])
+              w->errors++;
+        }
+    }
+  return NULL;
+}
+
+void
+testOptimisticReads (void)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle h;
+  BM_OptimisticRead read;
+  BM_PoolOptions options = { .concurrent = true };
+  OptimisticWorker workers[OPTIMISTIC_THREADS];
+  pthread_t threads[OPTIMISTIC_THREADS];
+  int *fixCounts;
+  int i, t, errors = 0, validated = 0;
+
+  testName = "Optimistic page reads";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  createDummyPages(bm, 4);
+  CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_FIFO, NULL));
+
+  // a page that is not buffered is read in, and an untouched read validates
+  CHECK(startOptimisticRead(bm, &read, 2));
+  ASSERT_EQUALS_STRING("Page-2", read.data, "optimistic read sees the page");
+  ASSERT_EQUALS_INT(1, getNumReadIO(bm), "the page was read in");
+  fixCounts = getFixCounts(bm);
+  ASSERT_EQUALS_INT(0, fixCounts[0], "an optimistic read holds no pin");
+  free(fixCounts);
+  CHECK(validateOptimisticRead(bm, &read));
+
+  // shared pins change nothing, an exclusive latch does
+  CHECK(pinPageShared(bm, &h, 2));
+  CHECK(unpinPage(bm, &h));
+  CHECK(validateOptimisticRead(bm, &read));
+  CHECK(pinPageExclusive(bm, &h, 2));
+  CHECK(unpinPage(bm, &h));
+  ASSERT_EQUALS_INT(RC_READ_CONFLICT, validateOptimisticRead(bm, &read), "writer invalidates the read");
+
+  // a change under a plain pin is seen once it is marked dirty
+  CHECK(startOptimisticRead(bm, &read, 2));
+  CHECK(pinPage(bm, &h, 2));
+  CHECK(markDirty(bm, &h));
+  CHECK(unpinPage(bm, &h));
+  ASSERT_EQUALS_INT(RC_READ_CONFLICT, validateOptimisticRead(bm, &read), "markDirty invalidates the read");
+
+  // so does replacing the page
+  CHECK(startOptimisticRead(bm, &read, 2));
+  for (i = 0; i < 3; i++)
+    {
+      CHECK(pinPage(bm, &h, i == 2 ? 3 : i));
+      CHECK(unpinPage(bm, &h));
+    }
+  ASSERT_EQUALS_INT(RC_READ_CONFLICT, validateOptimisticRead(bm, &read), "eviction invalidates the read");
+  CHECK(shutdownBufferPool(bm));
+
+  // readers, writers and evictions in a concurrent pool barely larger than the hot pages
+  CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", LATCH_PAGES + 1, RS_CLOCK, NULL, &options));
+  for (t = 0; t < OPTIMISTIC_THREADS; t++)
+    {
+      memset(&workers[t], 0, sizeof(OptimisticWorker));
+      workers[t].bm = bm;
+      workers[t].id = t;
+      pthread_create(&threads[t], NULL, runOptimisticWorker, &workers[t]);
+    }
+  for (t = 0; t < OPTIMISTIC_THREADS; t++)
+    {
+      pthread_join(threads[t], NULL);
+      errors += workers[t].errors;
+      validated += workers[t].validated;
+    }
+  ASSERT_EQUALS_INT(0, errors, "no validated read saw a page half written");
+  ASSERT_TRUE(validated > 0, "optimistic reads validate");
+  CHECK(shutdownBufferPool(bm));
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  TEST_DONE();
+}
+
+// hits queued in a concurrent pool reach the strategy before it picks a victim
+void
+testBatchedReferences (void)
+{
+  BM_BufferPool *bm = MAKE_POOL();
+  BM_PageHandle h;
+  BM_PoolOptions options = { .concurrent = true };
+  ReplacementStrategy strategies[] = { RS_LRU, RS_LFU, RS_LRU_K, RS_ARC };
+  PageNumber refs[] = { 0, 1, 2, 0, 2, 0 };
+  PageNumber *contents;
+  int i, s;
+
+  testName = "Batched references";
+
+  CHECK(createPageFile("testbuffer.bin"));
+  createDummyPages(bm, 4);
+
+  for (s = 0; s < 4; s++)
+    {
+      // page 1 is the least recent and the least frequently used page
+      CHECK(initBufferPoolWithOptions(bm, "testbuffer.bin", 3, strategies[s], NULL, &options));
+      for (i = 0; i < 6; i++)
+        {
+          CHECK(pinPage(bm, &h, refs[i]));
+          CHECK(unpinPage(bm, &h));
+        }
+      CHECK(pinPage(bm, &h, 3));
+      CHECK(unpinPage(bm, &h));
+      contents = getFrameContents(bm);
+      ASSERT_TRUE(contents[0] == 0 && contents[1] == 3 && contents[2] == 2, "queued hits protect pages 0 and 2");
+      free(contents);
+      CHECK(shutdownBufferPool(bm));
+    }
+  CHECK(destroyPageFile("testbuffer.bin"));
+
+  free(bm);
+  TEST_DONE();
+}